@@ -1,18 +1,5 @@
 // flight_booking.cpp
-#include <iostream>
-#include <vector>
-#include <string>
-#include <map>
-#include <queue>
-#include <iomanip>
-#include <ctime>
-#include <fstream>
-#include <sstream>
-#include <memory>
-#include <algorithm>
-#include <cctype>
-
-using namespace std;
+#include "ams_core.h"
 
 // ----------------- Utilities -----------------
 void clearScreen() {
@@ -29,29 +16,6 @@ void pressEnterToContinue() {
     cin.get();
 }
 
-string getCurrentDateTime() {
-    time_t now = time(0);
-    char buf[80];
-    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", localtime(&now));
-    return string(buf);
-}
-
-bool isValidEmail(const string& email) {
-    auto at = email.find('@');
-    auto dot = email.find('.', at == string::npos ? 0 : at);
-    return (at != string::npos && dot != string::npos && at < dot);
-}
-
-bool isValidPhone(const string& phone) {
-    int digits = 0;
-    for (char c : phone) {
-        if (isdigit(c)) digits++;
-        else if (c == '+' || c == '-' || c == ' ') continue;
-        else return false;
-    }
-    return digits >= 10;
-}
-
 int readIntInRange(int minv, int maxv) {
     while (true) {
         int x;
@@ -72,302 +36,8 @@ int readIntInRange(int minv, int maxv) {
 // ----------------- Credentials -----------------
 const string ADMIN_USER = "admin";
 const string ADMIN_PASS = "admin123";
-
-// ----------------- Enums -----------------
-enum MealPreference { VEGETARIAN = 0, NON_VEG = 1, VEGAN = 2, NO_MEAL = 3 };
-enum PaymentMethod { CREDIT_CARD = 0, DEBIT_CARD = 1, UPI = 2, CASH = 3 };
-
-// ----------------- Passenger -----------------
-struct Passenger {
-    string name;
-    string phone;
-    string email;
-    string gender;
-    MealPreference meal = NO_MEAL;
-    bool wheelchair = false;
-    int luggageKg = 0;
-
-    Passenger() = default;
-    Passenger(string n, string p, string e, string g, MealPreference m, bool w, int l)
-        : name(move(n)), phone(move(p)), email(move(e)), gender(move(g)), meal(m), wheelchair(w), luggageKg(l) {}
-
-    string mealString() const {
-        switch (meal) {
-            case VEGETARIAN: return "Vegetarian";
-            case NON_VEG: return "Non-Veg";
-            case VEGAN: return "Vegan";
-            default: return "No Meal";
-        }
-    }
-
-    void displayFull() const {
-        cout << "Name: " << name << ", Phone: " << phone;
-        if (!email.empty()) cout << ", Email: " << email;
-        if (!gender.empty()) cout << ", Gender: " << gender;
-        cout << "\nMeal: " << mealString();
-        cout << ", Wheelchair: " << (wheelchair ? "YES" : "NO");
-        cout << ", Luggage: " << luggageKg << "kg\n";
-    }
-
-    void displayLimited() const {
-        cout << "Name: " << name << ", Phone: " << phone << "\n";
-    }
-};
-
-// ----------------- Seats -----------------
-class Seat {
-public:
-    string seatNo;
-    double basePrice;
-    bool booked = false;
-    string preference; // Window, Aisle, Middle
-
-    Seat(string s="", double p=0.0, string pref="Middle") : seatNo(move(s)), basePrice(p), preference(move(pref)) {}
-    virtual ~Seat() = default;
-    virtual double price() const = 0;
-    virtual string type() const = 0;
-    void display() const {
-        cout << left << setw(6) << seatNo << setw(12) << type() << setw(10) << preference
-             << "$" << fixed << setprecision(2) << setw(8) << price()
-             << (booked ? "BOOKED" : "AVAILABLE") << "\n";
-    }
-};
-
-class Economy : public Seat {
-public:
-    Economy(string s, double p, string pref="Middle") : Seat(move(s), p, move(pref)) {}
-    double price() const override { return basePrice; }
-    string type() const override { return "Economy"; }
-};
-
-class Business : public Seat {
-public:
-    Business(string s, double p, string pref="Middle") : Seat(move(s), p, move(pref)) {}
-    double price() const override { return basePrice * 2.0; }
-    string type() const override { return "Business"; }
-};
-
-class FirstClass : public Seat {
-public:
-    FirstClass(string s, double p, string pref="Middle") : Seat(move(s), p, move(pref)) {}
-    double price() const override { return basePrice * 3.0; }
-    string type() const override { return "First Class"; }
-};
-
-// ----------------- Payment -----------------
-struct Payment {
-    double amount = 0.0;
-    PaymentMethod method = CASH;
-    string txnId;
-    string timestamp;
-
-    Payment() = default;
-    Payment(double a, PaymentMethod m) : amount(a), method(m) {
-        timestamp = getCurrentDateTime();
-        txnId = "TXN" + to_string(rand() % 900000 + 100000);
-    }
-
-    string methodStr() const {
-        switch (method) {
-            case CREDIT_CARD: return "Credit Card";
-            case DEBIT_CARD: return "Debit Card";
-            case UPI: return "UPI";
-            case CASH: return "Cash";
-            default: return "Unknown";
-        }
-    }
-
-    void printReceipt() const {
-        cout << "\n========== PAYMENT RECEIPT ==========\n";
-        cout << "Transaction ID: " << txnId << "\n";
-        cout << "Amount: $" << fixed << setprecision(2) << amount << "\n";
-        cout << "Method: " << methodStr() << "\n";
-        cout << "Time: " << timestamp << "\n";
-        cout << "=====================================\n";
-    }
-};
-
-// ----------------- Booking -----------------
-struct Booking {
-    int id;
-    Passenger passenger;
-    Seat* seat = nullptr; // pointer to flight seat
-    unique_ptr<Payment> payment;
-    string bookingTime;
-    bool cancelled = false;
-
-    Booking() = default;
-    Booking(int i, Passenger p, Seat* s, unique_ptr<Payment> pay)
-        : id(i), passenger(move(p)), seat(s), payment(move(pay)), cancelled(false) {
-        bookingTime = getCurrentDateTime();
-    }
-
-    double totalAmount() const {
-        if (!seat) return 0.0;
-        double total = seat->price();
-        if (passenger.luggageKg > 20) {
-            total += (passenger.luggageKg - 20) * 10;
-        }
-        return total;
-    }
-
-    void displayLimited() const {
-        cout << "\n--- Booking #" << id << " ---\n";
-        passenger.displayLimited();
-        if (seat) cout << "Seat: " << seat->seatNo << " (" << seat->type() << ")\n";
-        cout << (cancelled ? "Status: CANCELLED\n" : "Status: CONFIRMED\n");
-    }
-
-    void displayFull() const {
-        cout << "\n========== BOOKING DETAILS ==========\n";
-        cout << "Booking ID: #" << id << "\n";
-        cout << "Status: " << (cancelled ? "CANCELLED" : "CONFIRMED") << "\n";
-        cout << "Booking Time: " << bookingTime << "\n\n";
-        cout << "--- Passenger Info ---\n";
-        passenger.displayFull();
-        cout << "\n--- Seat Info ---\n";
-        if (seat) seat->display();
-        cout << "\n--- Payment Info ---\n";
-        if (payment) {
-            cout << "Base Fare: $" << fixed << setprecision(2) << seat->price() << "\n";
-            if (passenger.luggageKg > 20) {
-                cout << "Extra Luggage: $" << (passenger.luggageKg - 20) * 10 << "\n";
-            }
-            cout << "Total: $" << totalAmount() << "\n";
-            cout << "Payment Method: " << payment->methodStr() << "\n";
-            cout << "Transaction ID: " << payment->txnId << "\n";
-        }
-        cout << "=====================================\n";
-    }
-
-    void printBoardingPass() const {
-        cout << "\n------------------------------------------\n";
-        cout << "--         BOARDING PASS                  --\n";
-        cout << "-----------------------------------------------\n";
-        cout << " Booking ID: " << left << setw(27) << id << "\n";
-        cout << " Passenger: " << left << setw(28) << passenger.name << "\n";
-        cout << " Seat: " << left << setw(33) << (seat ? seat->seatNo : string("N/A")) << "\n";
-        cout << " Class: " << left << setw(32) << (seat ? seat->type() : string("N/A")) << "\n";
-        cout << " Meal: " << left << setw(33) << passenger.mealString() << "║\n";
-        cout << "------------------------------------------------------\n";
-    }
-};
-
-// ----------------- Flight -----------------
-class Flight {
-public:
-    string flightNo;
-    string src, dest;
-    string depTime, arrTime;
-    vector<unique_ptr<Seat>> seats;
-
-    Flight() = default;
-    Flight(string f, string s, string d, string dep, string arr)
-        : flightNo(move(f)), src(move(s)), dest(move(d)), depTime(move(dep)), arrTime(move(arr)) {}
-
-    void initDefaultSeats() {
-        seats.clear();
-        // Economy rows 1-5: A-D
-        for (int r=1; r<=5; ++r) {
-            seats.emplace_back(make_unique<Economy>(to_string(r)+"A", 100.0, "Window"));
-            seats.emplace_back(make_unique<Economy>(to_string(r)+"B", 100.0, "Middle"));
-            seats.emplace_back(make_unique<Economy>(to_string(r)+"C", 100.0, "Aisle"));
-            seats.emplace_back(make_unique<Economy>(to_string(r)+"D", 100.0, "Window"));
-        }
-        // Business 6-8: A-C
-        for (int r=6; r<=8; ++r) {
-            seats.emplace_back(make_unique<Business>(to_string(r)+"A", 150.0, "Window"));
-            seats.emplace_back(make_unique<Business>(to_string(r)+"B", 150.0, "Aisle"));
-            seats.emplace_back(make_unique<Business>(to_string(r)+"C", 150.0, "Window"));
-        }
-        // First 9-10: A-B
-        for (int r=9; r<=10; ++r) {
-            seats.emplace_back(make_unique<FirstClass>(to_string(r)+"A", 200.0, "Window"));
-            seats.emplace_back(make_unique<FirstClass>(to_string(r)+"B", 200.0, "Aisle"));
-        }
-    }
-
-    Seat* findSeat(const string& seatNo) {
-        for (auto& s : seats) {
-            if (s->seatNo == seatNo) return s.get();
-        }
-        return nullptr;
-    }
-
-    void displayInfo() const {
-        cout << flightNo << " : " << src << " -> " << dest
-             << " | Dep: " << depTime << " Arr: " << arrTime << "\n";
-    }
-
-    void displaySeatMap() const {
-        cout << "\n========== SEAT MAP ==========\n";
-        // Group by row number - gather rows
-        map<int, vector<const Seat*>> rows;
-        for (const auto& s : seats) {
-            string num = s->seatNo.substr(0, s->seatNo.size()-1);
-            int r = stoi(num);
-            rows[r].push_back(s.get());
-        }
-        cout << "   A    B    C    D\n";
-        for (const auto& kv : rows) {
-            cout << setw(2) << kv.first << " ";
-            // ensure ordering A B C D by checking letters A-D
-            vector<char> order = {'A','B','C','D'};
-            for (char ch : order) {
-                const Seat* match = nullptr;
-                for (const Seat* s : kv.second) if (!s->seatNo.empty() && s->seatNo.back() == ch) match = s;
-                if (match) {
-                    cout << "[" << (match->booked ? 'X' : match->seatNo.back()) << "] ";
-                } else {
-                    cout << "     ";
-                }
-            }
-            cout << "\n";
-        }
-        cout << "\n[X] = Booked, [Letter] = Available\n";
-    }
-};
-
-// ----------------- Waitlist -----------------
-class Waitlist {
-    queue<pair<Passenger,string>> q; // passenger, desired class
-public:
-    void add(const Passenger& p, const string& classType) {
-        q.push({p, classType});
-        cout << "Added to waitlist. Position: " << q.size() << "\n";
-    }
-    bool empty() const { return q.empty(); }
-    pair<Passenger,string> pop() {
-        if (q.empty()) return {{}, ""};
-        auto front = q.front(); q.pop(); return front;
-    }
-    void display() const {
-        if (q.empty()) {
-            cout << "Waitlist is empty\n"; return;
-        }
-        cout << "\n=== WAITLIST ===\n";
-        queue<pair<Passenger,string>> copy = q;
-        int pos=1;
-        while (!copy.empty()) {
-            auto &p = copy.front();
-            cout << pos++ << ". " << p.first.name << " (" << p.second << ")\n";
-            copy.pop();
-        }
-    }
-};
-
-// ----------------- Globals -----------------
-Flight flight;
-map<int, unique_ptr<Booking>> bookings; // active bookings
-vector<unique_ptr<Booking>> cancelledBookings;
-Waitlist waitlist;
-int bookingCounter = 1;
 bool adminLogged = false;
 
-// ----------------- Forward decl -----------------
-void saveBookingsToFile();
-void loadBookingsFromFile();
-
 // ----------------- Auth -----------------
 bool adminLogin() {
     string u, p;
@@ -387,35 +57,94 @@ bool adminLogin() {
 // ----------------- UI Helpers -----------------
 void showMenu() {
     cout << "\nFLIGHT BOOKING SYSTEM \n";
-    flight.displayInfo();
+    if (currentFlight) currentFlight->displayInfo();
+    cout << "(" << catalog.size() << " flights scheduled)\n";
     cout << "--------------------------------------------------\n";
-    cout << "1. Book Ticket\n2. Cancel Ticket\n3. Modify Booking\n4. View All Bookings\n5. Search Bookings\n6. View Seat Map\n7. Generate Reports (Admin)\n8. View Waitlist\n9. View Cancelled Bookings (Admin)\n10. " << (adminLogged ? "Logout" : "Admin Login") << "\n11. Save & Exit\n";
+    cout << "1. Book Ticket\n2. Cancel Ticket\n3. Modify Booking\n4. View All Bookings\n5. Search Bookings\n6. View Seat Map\n7. Generate Reports (Admin)\n8. Performance Metrics (Admin)\n9. View Waitlist\n10. View Cancelled Bookings (Admin)\n11. " << (adminLogged ? "Logout" : "Admin Login") << "\n12. Select Flight\n13. Group Booking\n14. Save & Exit\n";
     cout << "----------------------------------------------------\n";
     cout << "Choice: ";
 }
 
 // ----------------- Core Features -----------------
-void showAvailableSeatsByClassAndPref(const string& classType, const string& pref="") {
-    bool found=false;
-    cout << left << setw(6) << "Seat" << setw(12) << "Class" << setw(10) << "Pref" << setw(10) << "Price" << "Status\n";
-    cout << string(50, '-') << "\n";
-    for (const auto& s : flight.seats) {
-        if (s->type() == classType && !s->booked) {
-            if (pref.empty() || s->preference == pref) {
-                s->display();
-                found = true;
+// Tells the user a freed seat went to someone on the waitlist
+void reportReassigned(const Booking* reassigned) {
+    if (!reassigned) return;
+    cout << "Seat " << reassigned->seatNo() << " assigned to " << reassigned->passenger.name
+         << " from the waitlist (booking #" << reassigned->id << ")\n";
+}
+
+void selectFlight() {
+    cout << "\nSelect flight:\n1. By flight number\n2. By route and date\nChoice: ";
+    int ch = readIntInRange(1,2);
+    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+    if (ch == 1) {
+        cout << "Flight number: ";
+        string no; getline(cin, no);
+        Flight* f = catalog.find(no);
+        if (!f) { cout << "No such flight\n"; pressEnterToContinue(); return; }
+        currentFlight = f;
+    } else {
+        string src, dest, date;
+        cout << "From: "; getline(cin, src);
+        cout << "To: "; getline(cin, dest);
+        cout << "Date (YYYY-MM-DD): "; getline(cin, date);
+        const vector<Flight*>& matches = catalog.findRoute(src, dest, date);
+        if (matches.empty()) {
+            RouteQuery q;
+            q.from = src;
+            q.to = dest;
+            q.date = date;
+            vector<Itinerary> found;
+            if (!routePlanner.search(q, found) || found.empty()) {
+                cout << "No flights on that route and date\n";
+            } else {
+                cout << "No direct flights. Connections (book each leg by its flight number):\n";
+                for (size_t i = 0; i < found.size(); ++i) {
+                    const Itinerary& it = found[i];
+                    cout << (i+1) << ". " << it.legs.size() - 1 << " stop(s), " << (it.arrives - it.departs) / 60 << "h"
+                         << setw(2) << setfill('0') << (it.arrives - it.departs) % 60 << setfill(' ') << ", from $"
+                         << fixed << setprecision(2) << it.fare << "\n";
+                    for (const Flight* leg : it.legs) {
+                        cout << "     ";
+                        leg->displayInfo();
+                    }
+                }
             }
+            pressEnterToContinue();
+            return;
+        }
+        for (size_t i = 0; i < matches.size(); ++i) {
+            cout << (i+1) << ". ";
+            matches[i]->displayInfo();
         }
+        cout << "Choice: ";
+        currentFlight = matches[readIntInRange(1, (int)matches.size()) - 1];
     }
+    cout << "Now booking: ";
+    currentFlight->displayInfo();
+    pressEnterToContinue();
+}
+
+// pref < 0 means any preference
+void showAvailableSeatsByClassAndPref(const Flight& flight, SeatClass classType, int pref = -1) {
+    bool found=false;
+    cout << left << setw(6) << "Seat" << setw(12) << "Class" << setw(10) << "Pref" << setw(10) << "Price" << "Status\n";
+    cout << string(50, '-') << "\n";
+    FareQuote q;
+    fareEngine.quote(flight.seats, q);
+    flight.seats.forEachAvailable(classType, pref, [&](int i) {
+        flight.seats.display(i, q.fare[i]);
+        found = true;
+    });
     if (!found) cout << "No available seats matching criteria\n";
 }
 
-void bookTicket() {
+// Prompts for one passenger's details
+Passenger readPassenger() {
     cin.ignore(numeric_limits<streamsize>::max(), '\n');
     string name, phone, email, gender;
-    int mealChoice, classChoice, prefChoice, luggageKg;
+    int mealChoice, luggageKg;
     char wheelChoice;
-    cout << "\n=== PASSENGER DETAILS ===\n";
     while (true) {
         cout << "Name: "; getline(cin, name);
         if (!name.empty()) break;
@@ -446,46 +175,70 @@ void bookTicket() {
         cin.clear(); cin.ignore(numeric_limits<streamsize>::max(), '\n');
         cout << "Enter a number for luggage: ";
     }
-    if (luggageKg > 20) cout << "Note: extra luggage charges apply ($10 per kg over 20kg)\n";
+    const LuggageRule& luggage = fareEngine.current().luggage;
+    if (luggageKg > luggage.freeKg) {
+        cout << "Note: extra luggage charges apply ($" << luggage.perKg << " per kg over " << luggage.freeKg << "kg)\n";
+    }
+    return Passenger{name, phone, email, gender, meal, wheelchair, luggageKg};
+}
 
+SeatClass readSeatClass() {
     cout << "\nSelect class:\n1. Economy\n2. Business\n3. First Class\nChoice: ";
-    classChoice = readIntInRange(1,3);
-    string classType = (classChoice==1 ? "Economy" : classChoice==2 ? "Business" : "First Class");
+    return static_cast<SeatClass>(readIntInRange(1,3)-1);
+}
 
+// -1 for any
+int readSeatPref() {
     cout << "\nSeat preference:\n1. Window\n2. Aisle\n3. Middle\n4. Any\nChoice: ";
-    prefChoice = readIntInRange(1,4);
-    string preference = "";
-    if (prefChoice==1) preference="Window";
-    else if (prefChoice==2) preference="Aisle";
-    else if (prefChoice==3) preference="Middle";
+    int prefChoice = readIntInRange(1,4);
+    if (prefChoice==1) return WINDOW;
+    if (prefChoice==2) return AISLE;
+    if (prefChoice==3) return MIDDLE;
+    return -1;
+}
+
+void bookTicket() {
+    if (!currentFlight) { cout << "No flight selected\n"; pressEnterToContinue(); return; }
+    Flight& flight = *currentFlight;
+    cout << "\n=== PASSENGER DETAILS ===\n";
+    Passenger passenger = readPassenger();
+    SeatClass classType = readSeatClass();
+    int preference = readSeatPref();
 
     flight.displaySeatMap();
-    showAvailableSeatsByClassAndPref(classType, preference);
+    showAvailableSeatsByClassAndPref(flight, classType, preference);
 
     cout << "\nEnter seat number (e.g. 1A) or W for waitlist: ";
     string seatInput; cin >> seatInput;
+    // waitlisted passengers are charged once a seat is assigned to them
+    auto joinWaitlist = [&] {
+        WaitlistEntry e;
+        e.passenger = passenger;
+        e.cls = classType;
+        e.pref = preference;
+        cout << "\nPayment method when a seat is assigned:\n1. Credit Card\n2. Debit Card\n3. UPI\n4. Cash\nChoice: ";
+        e.method = static_cast<PaymentMethod>(readIntInRange(1,4)-1);
+        size_t place = flight.waitlist.add(move(e));
+        cout << "Added to the " << seatClassString(classType) << " waitlist of " << flight.flightNo << ". Position: " << place << "\n";
+    };
     if (seatInput == "W" || seatInput == "w") {
-        Passenger p{name, phone, email, gender, meal, wheelchair, luggageKg};
-        waitlist.add(p, classType);
+        joinWaitlist();
         pressEnterToContinue();
         return;
     }
 
-    Seat* chosen = flight.findSeat(seatInput);
-    if (!chosen || chosen->booked || chosen->type() != classType) {
+    int chosen = flight.findSeat(seatInput);
+    if (chosen < 0 || flight.seats.isBooked(chosen) || flight.seats.cls(chosen) != classType) {
         cout << "Seat not available or invalid. Would you like to join waitlist? (y/n): ";
         char c; cin >> c;
-        if (c=='y' || c=='Y') {
-            Passenger p{name, phone, email, gender, meal, wheelchair, luggageKg};
-            waitlist.add(p, classType);
-        }
+        if (c=='y' || c=='Y') joinWaitlist();
         pressEnterToContinue();
         return;
     }
 
-    double base = chosen->price();
-    double luggageCharge = (luggageKg > 20) ? (luggageKg-20)*10 : 0;
-    double total = base + luggageCharge;
+    double base = fareEngine.seatFare(flight.seats, chosen);
+    double total = ticketPrice(flight, chosen, passenger.luggageKg);
+    double luggageCharge = total - base;
     cout << fixed << setprecision(2);
     cout << "\nBase Fare: $" << base << "\n";
     if (luggageCharge > 0) cout << "Extra Luggage: $" << luggageCharge << "\n";
@@ -493,21 +246,64 @@ void bookTicket() {
 
     cout << "\nPayment Method:\n1. Credit Card\n2. Debit Card\n3. UPI\n4. Cash\nChoice: ";
     int payChoice = readIntInRange(1,4);
-    PaymentMethod pm = static_cast<PaymentMethod>(payChoice-1);
-    auto pay = make_unique<Payment>(total, pm);
 
-    // finalize booking
-    chosen->booked = true;
-    Passenger passenger{name, phone, email, gender, meal, wheelchair, luggageKg};
-    auto booking = make_unique<Booking>(bookingCounter++, passenger, chosen, move(pay));
-    booking->bookingTime = getCurrentDateTime();
+    // finalize booking; only report success once it is durable
+    BookingRequest req;
+    req.flight = &flight;
+    req.passenger = move(passenger);
+    req.cls = classType;
+    req.seatNo = seatInput;
+    req.method = static_cast<PaymentMethod>(payChoice-1);
+    string error;
+    Booking* b = bookSeat(req, error);
+    if (!b) {
+        cout << "Booking failed: " << error << "\n";
+        pressEnterToContinue();
+        return;
+    }
+    journal.waitDurable();
 
     cout << "\nBooking successful!\n";
-    booking->payment->printReceipt();
-    booking->printBoardingPass();
+    b->payment->printReceipt();
+    b->printBoardingPass();
+
+    pressEnterToContinue();
+}
+
+void bookGroupTicket() {
+    if (!currentFlight) { cout << "No flight selected\n"; pressEnterToContinue(); return; }
+    Flight& flight = *currentFlight;
+    cout << "\nNumber of passengers: ";
+    GroupRequest req;
+    req.flight = &flight;
+    int n = readIntInRange(1, SeatLayout::LETTERS);
+    for (int k = 1; k <= n; ++k) {
+        cout << "\n=== PASSENGER " << k << " OF " << n << " ===\n";
+        req.passengers.push_back(readPassenger());
+    }
+    req.cls = readSeatClass();
+    req.pref = readSeatPref();
+    cout << "\nPayment Method:\n1. Credit Card\n2. Debit Card\n3. UPI\n4. Cash\nChoice: ";
+    req.method = static_cast<PaymentMethod>(readIntInRange(1,4)-1);
 
-    bookings[booking->id] = move(booking);
+    string error;
+    bool together = false;
+    vector<Booking*> party = bookGroup(req, error, &together);
+    if (party.empty()) {
+        cout << "Group booking failed: " << error << "\n";
+        pressEnterToContinue();
+        return;
+    }
+    journal.waitDurable();
 
+    cout << "\nGroup booked" << (together ? ", seated together" : "; no row had " + to_string(n) + " seats side by side, seated as close as possible") << ":\n";
+    double total = 0;
+    for (Booking* b : party) {
+        cout << "  #" << b->id << "  " << left << setw(6) << b->seatNo() << b->passenger.name << "\n";
+        total += b->payment->amount;
+    }
+    cout << fixed << setprecision(2) << "Total charged: $" << total << "\n";
+    for (Booking* b : party) b->printBoardingPass();
     pressEnterToContinue();
 }
 
@@ -515,39 +311,23 @@ void cancelTicket() {
     cout << "\nEnter Booking ID to cancel: ";
     int id; if (!(cin >> id)) { cin.clear(); cin.ignore(numeric_limits<streamsize>::max(), '\n'); cout << "Invalid ID\n"; pressEnterToContinue(); return; }
 
-    auto it = bookings.find(id);
-    if (it == bookings.end()) {
+    Booking* b = findBooking(id);
+    if (!b) {
         cout << "Booking not found\n"; pressEnterToContinue(); return;
     }
-    Booking* b = it->second.get();
     cout << "Are you sure you want to cancel booking #" << id << " ? (y/n): ";
     char c; cin >> c;
     if (!(c=='y' || c=='Y')) { cout << "Cancellation aborted\n"; pressEnterToContinue(); return; }
 
-    // free seat
-    if (b->seat) b->seat->booked = false;
-    b->cancelled = true;
+    // free seat, move to cancelled list and hand the seat to the waitlist
+    Booking* reassigned;
+    Cancellation done = cancelAndRefill(id, reassigned);
+    journal.waitDurable();
+    if (!done.ok) { cout << "Booking was already cancelled\n"; pressEnterToContinue(); return; }
 
-    double refund = b->totalAmount() * 0.9;
     cout << fixed << setprecision(2);
-    cout << "Booking cancelled. Refund amount: $" << refund << " (90%)\n";
-
-    // move to cancelled list
-    cancelledBookings.push_back(move(bookings[id]));
-    bookings.erase(id);
-
-    // process waitlist: if someone waiting for the same class, notify (auto-assign not implemented)
-    if (!waitlist.empty()) {
-        auto next = waitlist.pop();
-        // if next wants same class as freed seat, we just inform (in real app we'd email/message)
-        if (b->seat && next.second == b->seat->type()) {
-            cout << "Notified " << next.first.name << " from waitlist for class " << next.second << "\n";
-        } else {
-            // push back if not matched
-            // For simplicity we won't push back: real app would reevaluate
-            cout << "Processed one waitlist entry (not auto-assigned)\n";
-        }
-    }
+    cout << "Booking cancelled. Refund amount: $" << done.refund << " (90%)\n";
+    reportReassigned(reassigned);
 
     pressEnterToContinue();
 }
@@ -555,73 +335,76 @@ void cancelTicket() {
 void modifyBooking() {
     cout << "\nEnter Booking ID to modify: ";
     int id; if (!(cin >> id)) { cin.clear(); cin.ignore(numeric_limits<streamsize>::max(), '\n'); cout << "Invalid ID\n"; pressEnterToContinue(); return; }
-    auto it = bookings.find(id);
-    if (it==bookings.end()) { cout << "Booking not found\n"; pressEnterToContinue(); return; }
-    Booking* b = it->second.get();
+    Booking* b = findBooking(id);
+    if (!b) { cout << "Booking not found\n"; pressEnterToContinue(); return; }
     b->displayFull();
     cout << "\nModify options:\n1. Change Seat\n2. Update Meal Preference\n3. Cancel Booking\nChoice: ";
     int ch = readIntInRange(1,3);
     if (ch==1) {
-        // show seats of same class
-        flight.displaySeatMap();
-        showAvailableSeatsByClassAndPref(b->seat->type());
+        // show seats of same class on the booking's own flight
+        b->flight->displaySeatMap();
+        showAvailableSeatsByClassAndPref(*b->flight, b->seatClass());
         cout << "Enter new seat number: ";
         string s; cin >> s;
-        Seat* newSeat = flight.findSeat(s);
-        if (!newSeat || newSeat->booked || newSeat->type() != b->seat->type()) {
+        Booking* reassigned;
+        bool changed = changeSeatAndRefill(id, b->flight->findSeat(s), reassigned);
+        journal.waitDurable();
+        if (!changed) {
             cout << "Seat not available\n";
         } else {
-            b->seat->booked = false;
-            newSeat->booked = true;
-            b->seat = newSeat;
             cout << "Seat changed successfully\n";
+            reportReassigned(reassigned);
         }
     } else if (ch==2) {
         cout << "Select new meal:\n1. Vegetarian\n2. Non-Veg\n3. Vegan\n4. No Meal\nChoice: ";
         int mc = readIntInRange(1,4);
-        b->passenger.meal = static_cast<MealPreference>(mc-1);
-        cout << "Meal preference updated\n";
+        // false when the booking was cancelled while the menu waited
+        if (!changeMeal(id, static_cast<MealPreference>(mc-1))) {
+            cout << "Booking #" << id << " not found\n";
+        } else {
+            journal.waitDurable();
+            cout << "Meal preference updated\n";
+        }
     } else {
         // cancel via modify
         cout << "Cancelling booking...\n";
-        b->seat->booked = false;
-        b->cancelled = true;
-        cancelledBookings.push_back(move(it->second));
-        bookings.erase(it);
-        cout << "Booking cancelled\n";
+        Booking* reassigned;
+        Cancellation done = cancelAndRefill(id, reassigned);
+        journal.waitDurable();
+        if (!done.ok) {
+            cout << "Booking was already cancelled\n";
+        } else {
+            cout << "Booking cancelled\n";
+            reportReassigned(reassigned);
+        }
     }
     pressEnterToContinue();
 }
 
 void searchBookings() {
     cin.ignore(numeric_limits<streamsize>::max(), '\n');
-    cout << "Search by name, phone, or booking ID: ";
+    cout << "Search by name, phone, email, or booking ID: ";
     string q; getline(cin, q);
-    bool found=false;
-    for (auto& kv : bookings) {
-        auto &b = kv.second;
-        if (to_string(kv.first) == q ||
-            b->passenger.name.find(q) != string::npos ||
-            b->passenger.phone.find(q) != string::npos) {
-            found = true;
-            if (adminLogged) b->displayFull();
-            else b->displayLimited();
-        }
+    vector<Booking*> found = findBookings(q);
+    for (Booking* b : found) {
+        if (adminLogged) b->displayFull();
+        else b->displayLimited();
     }
-    if (!found) cout << "No matching bookings found\n";
+    if (found.empty()) cout << "No matching bookings found\n";
     pressEnterToContinue();
 }
 
 void viewBookings() {
+    ensureHydrated();
     if (bookings.empty()) { cout << "No active bookings\n"; pressEnterToContinue(); return; }
     cout << "View options:\n1. Passenger View (Limited)\n2. Admin View (Full)\nChoice: ";
     int v = readIntInRange(1,2);
     if (v==2 && !adminLogged) {
         if (!adminLogin()) { cout << "Showing limited view\n"; v = 1; }
     }
-    for (auto& kv : bookings) {
-        if (v==2 && adminLogged) kv.second->displayFull();
-        else kv.second->displayLimited();
+    for (Booking* b : bookings.sorted()) {
+        if (v==2 && adminLogged) b->displayFull();
+        else b->displayLimited();
     }
     pressEnterToContinue();
 }
@@ -630,141 +413,412 @@ void generateReports() {
     if (!adminLogged) {
         if (!adminLogin()) { pressEnterToContinue(); return; }
     }
-    double revEco=0, revBus=0, revFirst=0;
-    int cntEco=0, cntBus=0, cntFirst=0;
-    int veg=0, nonveg=0, vegan=0, nomeal=0;
-
-    for (auto& kv : bookings) {
-        auto& b = kv.second;
-        string t = b->seat->type();
-        double amt = b->totalAmount();
-        if (t=="Economy") { revEco += amt; cntEco++; }
-        else if (t=="Business") { revBus += amt; cntBus++; }
-        else if (t=="First Class") { revFirst += amt; cntFirst++; }
-        switch (b->passenger.meal) {
-            case VEGETARIAN: veg++; break;
-            case NON_VEG: nonveg++; break;
-            case VEGAN: vegan++; break;
-            case NO_MEAL: nomeal++; break;
+    cout << "\n========== REPORTS ==========\n";
+    writeReports(cout, currentFlight);
+    cout << "\nExport all bookings: 1. bookings.csv  2. bookings.jsonl  3. Back\nChoice: ";
+    int ch = readIntInRange(1,3);
+    if (ch != 3) {
+        string path = ch == 1 ? "bookings.csv" : "bookings.jsonl";
+        ExportCounts n;
+        if (exportBookings(path, ExportFilter(), &n)) {
+            cout << n.active << " active and " << n.cancelled << " cancelled bookings written to " << path << "\n";
+        } else {
+            cout << "Could not write " << path << "\n";
         }
     }
-
-    int totalSeats = (int)flight.seats.size();
-    int bookedSeats = cntEco + cntBus + cntFirst;
-
-    cout << "\n========== REPORTS ==========\n";
-    cout << "-- Revenue by Class --\n";
-    cout << "Economy: " << cntEco << " bookings, $" << revEco << "\n";
-    cout << "Business: " << cntBus << " bookings, $" << revBus << "\n";
-    cout << "First Class: " << cntFirst << " bookings, $" << revFirst << "\n";
-    cout << "Total Revenue: $" << (revEco + revBus + revFirst) << "\n\n";
-    cout << "-- Occupancy --\n";
-    cout << "Booked: " << bookedSeats << "/" << totalSeats << " (" << fixed << setprecision(2) << (bookedSeats*100.0/totalSeats) << "%)\n\n";
-    cout << "-- Meal Preferences --\n";
-    cout << "Vegetarian: " << veg << ", Non-Veg: " << nonveg << ", Vegan: " << vegan << ", No Meal: " << nomeal << "\n\n";
-    cout << "-- Cancelled Bookings --\n";
-    cout << "Total Cancelled: " << cancelledBookings.size() << "\n";
-
     pressEnterToContinue();
 }
 
-void viewCancelledBookings() {
+void viewMetrics() {
     if (!adminLogged) {
         if (!adminLogin()) { pressEnterToContinue(); return; }
     }
-    if (cancelledBookings.empty()) { cout << "No cancelled bookings\n"; pressEnterToContinue(); return; }
-    for (const auto& bptr : cancelledBookings) {
-        bptr->displayFull();
+    cout << "\n========== PERFORMANCE METRICS ==========\n";
+    writeMetricsTable(cout, readMetrics());
+    cout << "\nExport: 1. metrics.txt (Prometheus)  2. metrics.json  3. Back\nChoice: ";
+    int ch = readIntInRange(1,3);
+    if (ch != 3) {
+        string path = ch == 1 ? "metrics.txt" : "metrics.json";
+        if (exportMetrics(path)) cout << "Metrics written to " << path << "\n";
+        else cout << "Could not write " << path << "\n";
     }
     pressEnterToContinue();
 }
 
-// ----------------- Save / Load -----------------
-// Format per booking:
-// id|name|phone|email|gender|meal|wheelchair|luggage|seatNo|bookingTime|paymentMethod|paymentAmount
-void saveBookingsToFile() {
-    ofstream f("bookings.txt");
-    if (!f) {
-        cout << "Error saving bookings to file\n";
-        return;
+// Booking::displayFull for a row read back from the archive
+void displayArchivedBooking(const ArchivedBooking& a) {
+    cout << "\n========== BOOKING DETAILS ==========\n";
+    cout << "Booking ID: #" << a.id << "\n";
+    cout << "Status: CANCELLED\n";
+    cout << "Booking Time: " << a.bookingTime << "\n\n";
+    if (Flight* fl = a.flightNo.empty() ? nullptr : catalog.find(string(a.flightNo))) {
+        cout << "--- Flight Info ---\n";
+        fl->displayInfo();
+        cout << "\n";
+    } else if (!a.flightNo.empty()) {
+        cout << "Flight: " << a.flightNo << "\n\n";
+    }
+    cout << "--- Passenger Info ---\n";
+    cout << "Name: " << a.name << ", Phone: " << a.phone;
+    if (!a.email.empty()) cout << ", Email: " << a.email;
+    if (!a.gender.empty()) cout << ", Gender: " << a.gender;
+    cout << "\nMeal: " << Passenger::mealString(static_cast<MealPreference>(a.meal & 3));
+    cout << ", Wheelchair: " << (a.wheelchair ? "YES" : "NO");
+    cout << ", Luggage: " << a.luggageKg << "kg\n";
+    cout << "\n--- Seat Info ---\n";
+    if (!a.seatNo.empty()) cout << "Seat: " << a.seatNo << " (" << seatClassString(static_cast<SeatClass>(a.seatClass)) << ")\n";
+    cout << "\n--- Payment Info ---\n";
+    cout << "Base Fare: $" << fixed << setprecision(2) << a.fare << "\n";
+    if (a.total > a.fare) cout << "Extra Luggage: $" << a.total - a.fare << "\n";
+    cout << "Total: $" << a.total << "\n";
+    cout << "Payment Method: " << Payment::methodStr(static_cast<PaymentMethod>(a.payMethod & 3)) << "\n";
+    cout << "Transaction ID: " << a.txnId << "\n";
+    cout << "=====================================\n";
+}
+
+void viewCancelledBookings() {
+    if (!adminLogged) {
+        if (!adminLogin()) { pressEnterToContinue(); return; }
     }
-    f << bookings.size() << "\n";
-    for (auto& kv : bookings) {
-        Booking* b = kv.second.get();
-        f << b->id << "|"
-          << b->passenger.name << "|"
-          << b->passenger.phone << "|"
-          << b->passenger.email << "|"
-          << b->passenger.gender << "|"
-          << static_cast<int>(b->passenger.meal) << "|"
-          << (b->passenger.wheelchair ? "1" : "0") << "|"
-          << b->passenger.luggageKg << "|"
-          << (b->seat ? b->seat->seatNo : "NONE") << "|"
-          << b->bookingTime << "|"
-          << (b->payment ? static_cast<int>(b->payment->method) : -1) << "|"
-          << (b->payment ? b->payment->amount : 0.0)
-          << "\n";
-    }
-    f.close();
-    cout << "Bookings saved to bookings.txt\n";
+    if (cancelledArchive.size() == 0) { cout << "No cancelled bookings\n"; pressEnterToContinue(); return; }
+    cancelledArchive.forEach(displayArchivedBooking);
+    pressEnterToContinue();
 }
 
-void loadBookingsFromFile() {
-    ifstream f("bookings.txt");
-    if (!f) {
-        // no file yet, not an error
-        return;
+// ----------------- Batch Mode -----------------
+// ./AMS --batch [file|-] [batchSize] runs commands without the menu, one
+// per line in the same pipe-delimited style as bookings.txt:
+//   book|flightNo|name|phone|email|gender|meal|wheelchair|luggage|class|pref|seatNo|payment[|idempotencyKey]
+//   waitlist|<same fields as book, seatNo empty>
+//   cancel|id
+//   modify|id|seat|seatNo
+//   modify|id|meal|meal
+//   search|query
+//   metrics[|path]
+//   export|path[|flightNo|class|from|to|active or cancelled]
+//   quote|flightNo[|luggage]
+//   group|flightNo|class|pref|payment|name|phone|email|gender|meal|wheelchair|luggage[|<7 more per passenger>]
+//   route|from|to|date|class[|count|sort|maxLegs]       sort: time (default) or fare
+// meal/class/pref/payment are the enum numbers used in bookings.txt; an
+// empty pref means any, an empty seatNo the first free seat of the class,
+// an empty flightNo the first flight (for export: every flight, and empty
+// filters match everything). Blank lines and # comments are skipped.
+// Each command produces one JSON object per line on stdout; all other
+// output goes to stderr. Results are written once their batch is durable,
+// so a batch shares one journal fsync. A batch ends after batchSize
+// commands or when no more input is waiting.
+vector<string_view> splitFields(string_view line) {
+    vector<string_view> f;
+    size_t start = 0;
+    while (true) {
+        size_t bar = line.find('|', start);
+        f.push_back(line.substr(start, bar == string_view::npos ? string_view::npos : bar - start));
+        if (bar == string_view::npos) return f;
+        start = bar + 1;
     }
-    int count = 0;
-    if (!(f >> count)) return;
-    string line; getline(f, line); // consume rest of first line
-    for (int i=0;i<count;i++) {
-        if (!getline(f, line)) break;
-        if (line.empty()) continue;
-        vector<string> parts;
-        string token;
-        stringstream ss(line);
-        while (getline(ss, token, '|')) parts.push_back(token);
-        if (parts.size() < 12) continue;
-        int id = stoi(parts[0]);
-        string name = parts[1];
-        string phone = parts[2];
-        string email = parts[3];
-        string gender = parts[4];
-        MealPreference meal = static_cast<MealPreference>(stoi(parts[5]));
-        bool wheelchair = (parts[6] == "1");
-        int luggage = stoi(parts[7]);
-        string seatNo = parts[8];
-        string bookingTime = parts[9];
-        int payMethod = stoi(parts[10]);
-        double payAmt = stod(parts[11]);
-
-        Seat* seatPtr = flight.findSeat(seatNo);
-        if (!seatPtr) {
-            // seat not found - skip
-            continue;
+}
+
+// Fills req from the fields of a book/waitlist command
+string parseBookingRequest(const vector<string_view>& f, BookingRequest& req) {
+    if (f[0] == "book" ? f.size() != 13 && f.size() != 14 : f.size() != 13) {
+        return f[0] == "book" ? "book needs 13 or 14 fields" : "waitlist needs 13 fields";
+    }
+    int meal, wheelchair, luggage, cls, pref = -1, method;
+    if (!parseNumber(f[6], meal) || meal < 0 || meal > 3 || !parseNumber(f[7], wheelchair) ||
+        !parseNumber(f[8], luggage) || luggage < 0 || !parseNumber(f[9], cls) || cls < 0 || cls >= NUM_SEAT_CLASSES ||
+        (!f[10].empty() && (!parseNumber(f[10], pref) || pref < -1 || pref >= NUM_SEAT_PREFS)) ||
+        !parseNumber(f[12], method) || method < 0 || method > 3) {
+        return "bad number field";
+    }
+    req.flight = f[1].empty() ? catalog.front() : catalog.find(string(f[1]));
+    if (!req.flight) return "unknown flight " + string(f[1]);
+    req.passenger = Passenger{string(f[2]), string(f[3]), string(f[4]), string(f[5]),
+                              static_cast<MealPreference>(meal), wheelchair != 0, luggage};
+    req.cls = static_cast<SeatClass>(cls);
+    req.pref = pref;
+    req.seatNo = string(f[11]);
+    req.method = static_cast<PaymentMethod>(method);
+    if (f.size() > 13) req.idempotencyKey = string(f[13]);
+    return "";
+}
+
+// Runs one command, appending its result line to out. Returns success.
+bool runBatchCommand(string_view line, uint32_t lineNo, string& out) {
+    vector<string_view> f = splitFields(line);
+    string head = "{\"line\":" + to_string(lineNo) + ",\"op\":" + jsonString(f[0]) + ",";
+    auto fail = [&](const string& why) {
+        out += head + "\"ok\":false,\"error\":" + jsonString(why) + "}\n";
+        return false;
+    };
+    auto succeed = [&](const string& fields) {
+        out += head + "\"ok\":true," + fields + "}\n";
+        return true;
+    };
+    int id = 0;
+    if ((f[0] == "cancel" || f[0] == "modify") && (f.size() < 2 || !parseNumber(f[1], id))) return fail("missing or bad booking id");
+
+    if (f[0] == "book" || f[0] == "waitlist") {
+        BookingRequest req;
+        string error = parseBookingRequest(f, req);
+        if (!error.empty()) return fail(error);
+        if (f[0] == "waitlist") {
+            if (!req.seatNo.empty()) return fail("waitlist takes no seat");
+            error = checkPassenger(req.passenger);
+            if (!error.empty()) return fail(error);
+            WaitlistEntry e;
+            e.passenger = move(req.passenger);
+            e.cls = req.cls;
+            e.pref = req.pref;
+            e.method = req.method;
+            size_t place = req.flight->waitlist.add(move(e));
+            return succeed("\"flight\":" + jsonString(req.flight->flightNo) + ",\"position\":" + to_string(place));
+        }
+        BookResult result;
+        Booking* b = bookSeat(req, error, &result);
+        if (!b) return fail(error);
+        return succeed("\"id\":" + to_string(b->id) + ",\"flight\":" + jsonString(b->flight->flightNo) +
+                       ",\"seat\":" + jsonString(b->seatNo()) + ",\"amount\":" + jsonMoney(b->totalAmount()) +
+                       ",\"txn\":" + jsonString(b->payment->txnId.view()) + (result == REPLAYED ? ",\"replayed\":true" : ""));
+    }
+    // a seat freed by cancel or modify is reassigned from the waitlist at once
+    Booking* reassigned = nullptr;
+    auto reassignedField = [&] {
+        return reassigned ? ",\"reassigned\":{\"id\":" + to_string(reassigned->id) + ",\"seat\":" + jsonString(reassigned->seatNo()) + "}" : string();
+    };
+    if (f[0] == "cancel") {
+        Cancellation done = cancelAndRefill(id, reassigned);
+        if (!done.ok) return fail("booking #" + to_string(id) + " not found");
+        return succeed("\"id\":" + to_string(id) + ",\"refund\":" + jsonMoney(done.refund) + reassignedField());
+    }
+    if (f[0] == "modify") {
+        if (f.size() != 4) return fail("modify needs 4 fields");
+        Booking* b = findBooking(id);
+        if (!b) return fail("booking #" + to_string(id) + " not found");
+        if (f[2] == "seat") {
+            int seat = b->flight->findSeat(f[3]);
+            if (!changeSeatAndRefill(id, seat, reassigned)) return fail("seat " + string(f[3]) + " not available");
+            return succeed("\"id\":" + to_string(id) + ",\"seat\":" + jsonString(b->flight->seats.code(seat)) + reassignedField());
+        }
+        int meal;
+        if (f[2] != "meal" || !parseNumber(f[3], meal) || meal < 0 || meal > 3) return fail("modify seat|<seatNo> or meal|<0-3>");
+        if (!changeMeal(id, static_cast<MealPreference>(meal))) return fail("booking #" + to_string(id) + " not found");
+        return succeed("\"id\":" + to_string(id) + ",\"meal\":" + to_string(meal));
+    }
+    if (f[0] == "search") {
+        if (f.size() < 2 || f[1].empty()) return fail("empty query");
+        string ids;
+        for (Booking* b : findBookings(string(line.substr(7)))) ids += (ids.empty() ? "" : ",") + to_string(b->id);
+        return succeed("\"ids\":[" + ids + "]");
+    }
+    if (f[0] == "metrics") {
+        // inline JSON, or written to a file for a scraper to pick up
+        if (f.size() > 1 && !f[1].empty()) {
+            if (!exportMetrics(string(f[1]))) return fail("cannot write " + string(f[1]));
+            return succeed("\"path\":" + jsonString(f[1]));
+        }
+        ostringstream json;
+        writeMetricsJson(json, readMetrics());
+        string s = json.str();
+        s.pop_back();
+        return succeed("\"metrics\":" + s);
+    }
+    if (f[0] == "group") {
+        if (f.size() < 12 || (f.size() - 5) % 7 != 0) return fail("group|flightNo|class|pref|payment then 7 fields per passenger");
+        GroupRequest req;
+        int cls, method;
+        if (!parseNumber(f[2], cls) || cls < 0 || cls >= NUM_SEAT_CLASSES ||
+            (!f[3].empty() && (!parseNumber(f[3], req.pref) || req.pref < -1 || req.pref >= NUM_SEAT_PREFS)) ||
+            !parseNumber(f[4], method) || method < 0 || method > 3) {
+            return fail("bad number field");
+        }
+        req.flight = f[1].empty() ? catalog.front() : catalog.find(string(f[1]));
+        if (!req.flight) return fail("unknown flight " + string(f[1]));
+        req.cls = static_cast<SeatClass>(cls);
+        req.method = static_cast<PaymentMethod>(method);
+        for (size_t k = 5; k + 7 <= f.size(); k += 7) {
+            int meal, wheelchair, luggage;
+            if (!parseNumber(f[k + 4], meal) || meal < 0 || meal > 3 || !parseNumber(f[k + 5], wheelchair) ||
+                !parseNumber(f[k + 6], luggage) || luggage < 0) {
+                return fail("bad number field");
+            }
+            req.passengers.push_back(Passenger{string(f[k]), string(f[k + 1]), string(f[k + 2]), string(f[k + 3]),
+                                               static_cast<MealPreference>(meal), wheelchair != 0, luggage});
+        }
+        string error;
+        bool together = false;
+        vector<Booking*> party = bookGroup(req, error, &together);
+        if (party.empty()) return fail(error);
+        string seats;
+        double amount = 0;
+        for (Booking* b : party) {
+            if (!seats.empty()) seats += ",";
+            seats += "{\"id\":" + to_string(b->id) + ",\"seat\":" + jsonString(b->seatNo()) + "}";
+            amount += b->payment->amount;
         }
-        seatPtr->booked = true;
-        Passenger p{name, phone, email, gender, meal, wheelchair, luggage};
-        auto pay = make_unique<Payment>(payAmt, static_cast<PaymentMethod>(max(0, payMethod)));
-        auto booking = make_unique<Booking>(id, p, seatPtr, move(pay));
-        booking->bookingTime = bookingTime;
-        bookings[id] = move(booking);
-        if (id >= bookingCounter) bookingCounter = id + 1;
-    }
-    f.close();
-    cout << "Previous bookings loaded (" << bookings.size() << ")\n";
+        return succeed("\"flight\":" + jsonString(req.flight->flightNo) + ",\"together\":" + (together ? "true" : "false") +
+                       ",\"amount\":" + jsonMoney(amount) + ",\"bookings\":[" + seats + "]");
+    }
+    if (f[0] == "quote") {
+        if (f.size() < 2 || f.size() > 3) return fail("quote|flightNo[|luggage]");
+        Flight* fl = f[1].empty() ? catalog.front() : catalog.find(string(f[1]));
+        if (!fl) return fail("unknown flight " + string(f[1]));
+        int luggage = 0;
+        if (f.size() > 2 && !f[2].empty() && (!parseNumber(f[2], luggage) || luggage < 0)) return fail("bad luggage");
+        FareQuote q;
+        fareEngine.quote(fl->seats, q);
+        double fee = fareEngine.luggageFee(luggage);
+        string classes;
+        for (int c = 0; c < NUM_SEAT_CLASSES; ++c) {
+            if (c) classes += ",";
+            classes += "{\"class\":" + jsonString(seatClassString(static_cast<SeatClass>(c))) + ",\"available\":" +
+                       to_string(q.available[c]) + ",\"from\":" + (q.available[c] ? jsonMoney(q.lowest[c] + fee) : "null") + "}";
+        }
+        return succeed("\"flight\":" + jsonString(fl->flightNo) + ",\"load\":" + jsonNumber(q.load) +
+                       ",\"multiplier\":" + jsonNumber(q.multiplier) + ",\"luggageFee\":" + jsonMoney(fee) +
+                       ",\"classes\":[" + classes + "]");
+    }
+    if (f[0] == "route") {
+        if (f.size() < 5 || f.size() > 8) return fail("route|from|to|date|class[|count|sort|maxLegs]");
+        RouteQuery q;
+        q.from = string(f[1]);
+        q.to = string(f[2]);
+        q.date = string(f[3]);
+        int cls;
+        if (!parseNumber(f[4], cls) || cls < 0 || cls >= NUM_SEAT_CLASSES) return fail("bad class");
+        q.cls = static_cast<SeatClass>(cls);
+        if (f.size() > 5 && !f[5].empty() && (!parseNumber(f[5], q.count) || q.count < 1 || q.count > 50)) return fail("count is 1-50");
+        if (f.size() > 6 && !f[6].empty() && f[6] != "time" && f[6] != "fare") return fail("sort is time or fare");
+        q.byFare = f.size() > 6 && f[6] == "fare";
+        if (f.size() > 7 && !f[7].empty() && (!parseNumber(f[7], q.maxLegs) || q.maxLegs < 1 || q.maxLegs > 4)) return fail("maxLegs is 1-4");
+        vector<Itinerary> found;
+        if (!routePlanner.search(q, found)) return fail("unknown airport or bad date");
+        string list;
+        for (const Itinerary& it : found) list += (list.empty() ? "" : ",") + itineraryJson(it);
+        return succeed("\"itineraries\":[" + list + "]");
+    }
+    if (f[0] == "export") {
+        if (f.size() < 2 || f[1].empty() || f.size() > 7) return fail("export|path[|flightNo|class|from|to|status]");
+        ExportFilter filter;
+        if (f.size() > 2) filter.flightNo = string(f[2]);
+        if (f.size() > 3 && !f[3].empty() && (!parseNumber(f[3], filter.cls) || filter.cls < 0 || filter.cls >= NUM_SEAT_CLASSES)) {
+            return fail("bad class");
+        }
+        int64_t t;
+        if (f.size() > 4) filter.from = string(f[4]);
+        if (f.size() > 5) filter.to = string(f[5]);
+        if ((!filter.from.empty() && !parseTime(filter.from, t)) || (!filter.to.empty() && !parseTime(filter.to, t))) {
+            return fail("times are YYYY-MM-DD HH:MM:SS or a prefix of it");
+        }
+        if (f.size() > 6 && !f[6].empty()) {
+            if (f[6] != "active" && f[6] != "cancelled") return fail("status is active or cancelled");
+            filter.active = f[6] == "active";
+            filter.cancelled = !filter.active;
+        }
+        ExportCounts n;
+        if (!exportBookings(string(f[1]), filter, &n)) return fail("cannot write " + string(f[1]));
+        return succeed("\"path\":" + jsonString(f[1]) + ",\"active\":" + to_string(n.active) +
+                       ",\"cancelled\":" + to_string(n.cancelled) + ",\"bytes\":" + to_string(n.bytes));
+    }
+    return fail("unknown command");
 }
 
-// ----------------- Main -----------------
-int main() {
-    srand((unsigned)time(nullptr));
-    // Initialize flight details & seats
-    flight = Flight("AI101", "New York", "Los Angeles", "10:00 AM", "1:30 PM");
-    flight.initDefaultSeats();
+int runBatch(const string& path, int batchSize) {
+    ios::sync_with_stdio(false); // lets us see whether more input is buffered
+    ifstream file;
+    istream* in = &cin;
+    if (!path.empty() && path != "-") {
+        file.open(path);
+        if (!file) { cerr << "Cannot open " << path << "\n"; return 1; }
+        in = &file;
+    }
+    // stdout carries only results
+    ostream results(cout.rdbuf());
+    streambuf* console = cout.rdbuf(cerr.rdbuf());
+    openStore();
+
+    auto t0 = chrono::steady_clock::now();
+    string line, out;
+    uint32_t lineNo = 0;
+    long ok = 0, failed = 0;
+    int inBatch = 0;
+    auto commit = [&] {
+        journal.waitDurable();
+        results << out << flush;
+        out.clear();
+        inBatch = 0;
+    };
+    while (getline(*in, line)) {
+        lineNo++;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty() || line[0] == '#') continue;
+        if (runBatchCommand(line, lineNo, out)) ok++;
+        else failed++;
+        if (++inBatch >= batchSize || in->rdbuf()->in_avail() <= 0) commit();
+    }
+    commit();
+    checkpoint();
+    journal.close();
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+    cerr << "Batch: " << ok << " ok, " << failed << " failed in " << fixed << setprecision(1) << ms << " ms\n";
+    cout.rdbuf(console);
+    return 0;
+}
 
-    // load previous bookings
-    loadBookingsFromFile();
+// ----------------- Checkpoints -----------------
+// The menu and the server checkpoint in the background every
+// AMS_CHECKPOINT_SECS seconds (default 300, 0 = only at exit), so the
+// journal and recovery time stay bounded in a long session.
+void startCheckpoints() {
+    const char* env = getenv("AMS_CHECKPOINT_SECS");
+    checkpointer.start(env ? atoi(env) : 300);
+}
+
+void finalCheckpoint() {
+    checkpointer.stop();
+    checkpoint();
+    journal.close();
+}
+
+// ----------------- Web Server -----------------
+// ./AMS --serve [port] [threads] serves the web UI and its JSON API (see
+// HttpServer) on 127.0.0.1 until Ctrl+C, then saves like "Save & Exit".
+HttpServer* activeServer = nullptr;
+
+void stopServer(int) {
+    if (activeServer) activeServer->stop();
+}
+
+int runServer(int port, int threads) {
+    openStore();
+    HttpServer server;
+    string error = server.listen("127.0.0.1", port);
+    if (!error.empty()) { cerr << "Cannot listen on port " << port << ": " << error << "\n"; return 1; }
+    server.loadStatic(".");
+    activeServer = &server;
+    signal(SIGINT, stopServer);
+    signal(SIGTERM, stopServer);
+    cout << "Serving on http://127.0.0.1:" << server.port() << "/ (Ctrl+C to stop)" << endl;
+    startCheckpoints();
+    server.run(threads);
+    activeServer = nullptr;
+    finalCheckpoint();
+    cout << "Server stopped, bookings saved\n";
+    return 0;
+}
+
+// ----------------- Main -----------------
+int main(int argc, char** argv) {
+    if (argc == 4 && (string(argv[1]) == "--to-snapshot" || string(argv[1]) == "--to-text")) {
+        return convertBookings(argv[1], argv[2], argv[3]);
+    }
+    if (argc > 1 && string(argv[1]) == "--serve") {
+        return runServer(argc > 2 ? atoi(argv[2]) : 8080, argc > 3 ? atoi(argv[3]) : 0);
+    }
+    if (argc > 1 && string(argv[1]) == "--batch") {
+        return runBatch(argc > 2 ? argv[2] : "-", argc > 3 ? max(1, atoi(argv[3])) : 1024);
+    }
+    openStore();
+    startCheckpoints();
 
     while (true) {
         clearScreen();
@@ -784,16 +838,19 @@ int main() {
             case 3: modifyBooking(); break;
             case 4: viewBookings(); break;
             case 5: searchBookings(); break;
-            case 6: flight.displaySeatMap(); pressEnterToContinue(); break;
+            case 6: currentFlight->displaySeatMap(); pressEnterToContinue(); break;
             case 7: generateReports(); break;
-            case 8: waitlist.display(); pressEnterToContinue(); break;
-            case 9: viewCancelledBookings(); break;
-            case 10:
+            case 8: viewMetrics(); break;
+            case 9: currentFlight->waitlist.display(); pressEnterToContinue(); break;
+            case 10: viewCancelledBookings(); break;
+            case 11:
                 if (adminLogged) { adminLogged = false; cout << "Logged out\n"; pressEnterToContinue(); }
                 else { adminLogin(); pressEnterToContinue(); }
                 break;
-            case 11:
-                saveBookingsToFile();
+            case 12: selectFlight(); break;
+            case 13: bookGroupTicket(); break;
+            case 14:
+                finalCheckpoint();
                 cout << "Exiting... thank you\n";
                 // cleanup handled by RAII
                 return 0;
@@ -803,4 +860,4 @@ int main() {
     }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,1796 @@
+// ams_bench.cpp
+#include "ams_core.h"
+
+// ----------------- Benchmarks -----------------
+// Run with: ./ams_bench <name> [args]. Benchmarks use the global catalog
+// and booking maps, so they are only meant for a dedicated process.
+using BenchClock = chrono::steady_clock;
+
+double elapsedMs(BenchClock::time_point since) {
+    return chrono::duration<double, milli>(BenchClock::now() - since).count();
+}
+
+// Wide-body style cabin: rows x letters, class by row band
+shared_ptr<const SeatLayout> makeBenchLayout(int rows, const string& letters) {
+    auto l = make_shared<SeatLayout>("bench-" + to_string(rows) + "x" + to_string(letters.size()));
+    for (int r = 1; r <= rows; ++r) {
+        SeatClass c = r <= rows / 10 ? FIRST_CLASS : r <= rows / 4 ? BUSINESS : ECONOMY;
+        for (size_t k = 0; k < letters.size(); ++k) {
+            SeatPref p = (k == 0 || k + 1 == letters.size()) ? WINDOW : MIDDLE;
+            l->add(r, letters[k], c, p, 100.0);
+        }
+    }
+    return l;
+}
+
+// Load time of a large bookings file, plus index vs linear seat lookup
+int benchSeatLookup(int nBookings) {
+    const string path = "bench_bookings.tmp";
+    auto layout = makeBenchLayout(60, "ABCDEFGHJK");
+    int perFlight = layout->size() * 8 / 10;
+    int nFlights = (nBookings + perFlight - 1) / perFlight;
+    for (int f = 0; f < nFlights; ++f) {
+        auto fl = make_unique<Flight>("BX" + to_string(1000 + f), "AAA", "BBB", "2025-01-01", "08:00 AM", "11:00 AM");
+        fl->seats.reset(layout);
+        catalog.add(move(fl));
+    }
+
+    vector<string> codes;
+    {
+        ofstream out(path);
+        out << nBookings << "\n";
+        for (int i = 0; i < nBookings; ++i) {
+            int slot = (i % perFlight) * 10 / 8;
+            string code = layout->code(slot);
+            codes.push_back(code);
+            out << (i+1) << "|Bench Passenger " << i << "|9999999999|p" << i << "@bench.test|O|3|0|20|"
+                << code << "|2025-01-01 00:00:00|3|100|BX" << (1000 + i / perFlight) << "\n";
+        }
+    }
+
+    auto t0 = BenchClock::now();
+    loadBookingsFromFile(path);
+    double loadMs = elapsedMs(t0);
+    remove(path.c_str());
+
+    long sink = 0;
+    t0 = BenchClock::now();
+    for (const string& c : codes) sink += layout->find(c);
+    double indexMs = elapsedMs(t0);
+
+    // What findSeat used to do: compare the code against every seat's string in turn
+    vector<string> seatNos;
+    for (int i = 0; i < layout->size(); ++i) seatNos.push_back(layout->code(i));
+    t0 = BenchClock::now();
+    for (const string& c : codes) {
+        for (int i = 0; i < (int)seatNos.size(); ++i) {
+            if (seatNos[i] == c) { sink += i; break; }
+        }
+    }
+    double linearMs = elapsedMs(t0);
+
+    cout << fixed << setprecision(2);
+    cout << "layout " << layout->name << " (" << layout->size() << " seats), "
+         << nFlights << " flights, " << bookings.size() << " bookings loaded\n";
+    cout << "load bookings file:   " << loadMs << " ms\n";
+    cout << "indexed lookups:      " << indexMs << " ms (" << (codes.size() / max(indexMs, 1e-6) / 1000.0) << " M/s)\n";
+    cout << "linear-scan lookups:  " << linearMs << " ms (" << (codes.size() / max(linearMs, 1e-6) / 1000.0) << " M/s)\n";
+    cout << "(checksum " << sink << ")\n";
+    return 0;
+}
+
+// Deterministic synthetic passenger #i
+Passenger makeBenchPassenger(int i) {
+    static const char* first[] = { "Ava", "Liam", "Noah", "Emma", "Olivia", "Arjun", "Priya", "Wei", "Sofia", "Mateo", "Yuki", "Omar" };
+    static const char* last[] = { "Smith", "Patel", "Garcia", "Chen", "Kumar", "Nguyen", "Silva", "Khan", "Mueller", "Rossi", "Tanaka" };
+    static const char* domains[] = { "gmail.com", "yahoo.com", "outlook.com", "corp.example" };
+    string name = string(first[i % 12]) + " " + last[(i / 12) % 11] + " " + to_string(i);
+    string phone = "+91" + to_string(7000000000LL + (long long)i * 7919 % 3000000000LL);
+    string email = "user" + to_string(i) + "@" + domains[i % 4];
+    return Passenger{name, phone, email, (i % 2) ? "F" : "M", static_cast<MealPreference>(i % 4), i % 50 == 0, 15 + i % 15};
+}
+
+// Fills the catalog with enough flights for nBookings at the given load
+// factor and books them through addBooking. Returns elapsed ms.
+void addBenchFlights(int nFlights, const shared_ptr<const SeatLayout>& layout) {
+    for (int f = 0; f < nFlights; ++f) {
+        auto fl = make_unique<Flight>("BX" + to_string(1000 + f), "AAA", "BBB", "2025-01-01", "08:00 AM", "11:00 AM");
+        fl->seats.reset(layout);
+        catalog.add(move(fl));
+    }
+}
+
+double seedBenchBookings(int nBookings, double loadFactor = 1.0) {
+    auto layout = makeBenchLayout(60, "ABCDEFGHJK");
+    int perFlight = max(1, (int)(layout->size() * loadFactor));
+    addBenchFlights((nBookings + perFlight - 1) / perFlight, layout);
+    auto t0 = BenchClock::now();
+    for (int i = 0; i < nBookings; ++i) {
+        Flight* fl = catalog.all()[i / perFlight].get();
+        int slot = i % perFlight;
+        fl->seats.setBooked(slot, true);
+        addBooking(make_unique<Booking>(nextBookingId(), makeBenchPassenger(i), fl, slot, make_unique<Payment>(100.0, CASH)));
+    }
+    return elapsedMs(t0);
+}
+
+// Substring search through the trigram index vs a scan of every booking
+int benchSearch(int nBookings, int nQueries) {
+    double buildMs = seedBenchBookings(nBookings);
+
+    vector<string> queries;
+    for (int k = 0; k < nQueries; ++k) {
+        Passenger p = makeBenchPassenger((int)((k * 2654435761u) % nBookings));
+        string_view src = (k % 3 == 0) ? p.phone : (k % 3 == 1) ? p.name : p.email;
+        queries.push_back(string(src.substr(src.size() / 3, 5)));
+    }
+
+    size_t hitsIndexed = 0, hitsScan = 0;
+    auto t0 = BenchClock::now();
+    for (const string& q : queries) hitsIndexed += findBookings(q).size();
+    double indexMs = elapsedMs(t0);
+
+    t0 = BenchClock::now();
+    for (const string& q : queries) {
+        bookings.forEach([&](const Booking& b) {
+            if (to_string(b.id) == q || bookingMatches(b, q)) hitsScan++;
+        });
+    }
+    double scanMs = elapsedMs(t0);
+
+    cout << fixed << setprecision(3);
+    cout << nBookings << " bookings, " << nQueries << " queries\n";
+    cout << "index build (incremental): " << buildMs << " ms\n";
+    cout << "indexed search:  " << indexMs / nQueries << " ms/query (" << hitsIndexed << " hits)\n";
+    cout << "full scan:       " << scanMs / nQueries << " ms/query (" << hitsScan << " hits)\n";
+    return hitsIndexed == hitsScan ? 0 : 1;
+}
+
+// Random cancel/seat/meal/rebook churn, then O(1) report read vs a full
+// recomputation, followed by the aggregate consistency check
+int benchReports(int nBookings, int nOps) {
+    seedBenchBookings(nBookings, 0.8);
+    uint64_t rng = 88172645463325252ULL;
+    auto next = [&rng]() { rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17; return rng; };
+
+    auto t0 = BenchClock::now();
+    for (int k = 0; k < nOps; ++k) {
+        int id = 1 + (int)(next() % (bookingCounter - 1));
+        Booking* b = bookings.find(id);
+        if (!b) continue;
+        switch (next() % 4) {
+            case 0: {
+                Flight* fl = b->flight;
+                SeatClass c = b->seatClass();
+                cancelBooking(id);
+                int slot = -1;
+                fl->seats.forEachAvailable(c, -1, [&](int i) { if (slot < 0) slot = i; });
+                if (slot >= 0) {
+                    fl->seats.setBooked(slot, true);
+                    addBooking(make_unique<Booking>(nextBookingId(), makeBenchPassenger(k), fl, slot, make_unique<Payment>(100.0, CASH)));
+                }
+                break;
+            }
+            case 1: {
+                int slot = -1;
+                b->flight->seats.forEachAvailable(b->seatClass(), -1, [&](int i) { if (slot < 0) slot = i; });
+                changeSeat(id, slot);
+                break;
+            }
+            default:
+                changeMeal(id, static_cast<MealPreference>(next() % 4));
+        }
+    }
+    double churnMs = elapsedMs(t0);
+
+    t0 = BenchClock::now();
+    double sink = 0;
+    for (int k = 0; k < 1000; ++k) sink += reportTotals.totalRevenue() + reportTotals.booked();
+    double readUs = elapsedMs(t0) * 1000.0 / 1000;
+
+    t0 = BenchClock::now();
+    ReportStats full;
+    bookings.forEach([&](const Booking& b) { full.apply(b.seatClass(), b.totalAmount(), b.passenger.meal, +1); });
+    double recomputeMs = elapsedMs(t0);
+
+    t0 = BenchClock::now();
+    bool ok = verifyReportAggregates();
+    double verifyMs = elapsedMs(t0);
+
+    cout << fixed << setprecision(3);
+    cout << bookings.size() << " active, " << cancelledArchive.size() << " cancelled, " << catalog.size() << " flights\n";
+    cout << "churn:               " << nOps << " ops in " << churnMs << " ms\n";
+    cout << "report (aggregates): " << readUs << " us\n";
+    cout << "report (recompute):  " << recomputeMs << " ms\n";
+    cout << "consistency check:   " << (ok ? "OK" : "MISMATCH") << " (" << verifyMs << " ms)\n";
+    cout << "(checksum " << sink + full.totalRevenue() << ")\n";
+    return ok ? 0 : 1;
+}
+
+// Journal append throughput (per-record commit, group commit across
+// threads, one batch) and recovery time for the resulting file
+int benchJournal(int nRecords, int nThreads) {
+    const string path = "bench_journal.tmp";
+    remove(path.c_str());
+    auto layout = makeBenchLayout(60, "ABCDEFGHJK");
+    int nFlights = (nRecords * 3 + layout->size() - 1) / layout->size();
+    addBenchFlights(nFlights, layout);
+
+    // Booking k of the run: flight/seat spread so replay never collides
+    auto record = [&](int k) {
+        Booking b(k + 1, makeBenchPassenger(k), catalog.all()[k / layout->size()].get(), k % layout->size(),
+                  make_unique<Payment>(100.0, CASH));
+        return encodeBookRecord(b);
+    };
+    journal.open(path);
+    cout << fixed << setprecision(0);
+
+    int perRecord = min(nRecords, 2000);
+    uint64_t syncs0 = journal.syncs;
+    auto t0 = BenchClock::now();
+    for (int k = 0; k < perRecord; ++k) journal.waitDurable(journal.append(record(k)));
+    double ms = elapsedMs(t0);
+    cout << "commit per record, 1 thread:  " << perRecord / ms * 1000 << " appends/s ("
+         << journal.syncs - syncs0 << " fsyncs)\n";
+
+    int grouped = min(nRecords, 20000);
+    syncs0 = journal.syncs;
+    t0 = BenchClock::now();
+    {
+        vector<thread> workers;
+        for (int t = 0; t < nThreads; ++t) {
+            workers.emplace_back([&, t] {
+                for (int k = perRecord + t; k < perRecord + grouped; k += nThreads) journal.waitDurable(journal.append(record(k)));
+            });
+        }
+        for (auto& w : workers) w.join();
+    }
+    ms = elapsedMs(t0);
+    cout << "commit per record, " << nThreads << " threads: " << grouped / ms * 1000 << " appends/s ("
+         << journal.syncs - syncs0 << " fsyncs)\n";
+
+    int batched = nRecords;
+    syncs0 = journal.syncs;
+    t0 = BenchClock::now();
+    for (int k = perRecord + grouped; k < perRecord + grouped + batched; ++k) journal.append(record(k));
+    journal.waitDurable();
+    ms = elapsedMs(t0);
+    cout << "one batch, 1 commit:          " << batched / ms * 1000 << " appends/s ("
+         << journal.syncs - syncs0 << " fsyncs)\n";
+    journal.close();
+
+    t0 = BenchClock::now();
+    long n = Journal::replay(path, applyJournalRecord);
+    ms = elapsedMs(t0);
+    cout << setprecision(2) << "recovery: " << n << " records in " << ms << " ms, "
+         << bookings.size() << " bookings restored\n";
+    remove(path.c_str());
+    return (size_t)n == bookings.size() ? 0 : 1;
+}
+
+// Forgets every booking and frees every seat, keeping the catalog
+void resetBenchState() {
+    bookings.clear();
+    cancelledArchive.clear();
+    searchIndex.clear();
+    reportTotals = ReportStats();
+    bookingCounter = 1;
+    for (const auto& f : catalog.all()) {
+        f->seats.reset(f->seats.layoutPtr());
+        f->stats = ReportStats();
+    }
+}
+
+// Cold start from bookings.txt vs the mmapped snapshot
+int benchSnapshot(int nBookings) {
+    const string text = "bench_bookings.tmp", snap = "bench_snapshot.tmp";
+    seedBenchBookings(nBookings, 0.8);
+    auto t0 = BenchClock::now();
+    writeSnapshot(snap);
+    double writeSnapMs = elapsedMs(t0);
+    t0 = BenchClock::now();
+    saveBookingsToFile(text);
+    double writeTextMs = elapsedMs(t0);
+    ReportStats expected = reportTotals;
+
+    resetBenchState();
+    t0 = BenchClock::now();
+    loadBookingsFromFile(text);
+    double loadTextMs = elapsedMs(t0);
+
+    resetBenchState();
+    t0 = BenchClock::now();
+    snapshot.open(snap);
+    double openMs = elapsedMs(t0);
+    bool ok = reportTotals.matches(expected);
+    t0 = BenchClock::now();
+    Booking* b = findBooking(nBookings / 2);
+    double firstMs = elapsedMs(t0);
+    ok = ok && b && b->id == nBookings / 2;
+    t0 = BenchClock::now();
+    ensureHydrated();
+    double hydrateMs = elapsedMs(t0);
+    ok = ok && (int)bookings.size() == nBookings && verifyReportAggregates();
+
+    remove(text.c_str());
+    remove(snap.c_str());
+    cout << fixed << setprecision(3);
+    cout << nBookings << " bookings, " << catalog.size() << " flights\n";
+    cout << "write snapshot:        " << writeSnapMs << " ms\n";
+    cout << "write bookings.txt:    " << writeTextMs << " ms\n";
+    cout << "startup, text parse:   " << loadTextMs << " ms\n";
+    cout << "startup, snapshot:     " << openMs << " ms (seat maps + reports ready)\n";
+    cout << "first booking lookup:  " << firstMs << " ms\n";
+    cout << "full hydration:        " << hydrateMs << " ms\n";
+    cout << "consistency:           " << (ok ? "OK" : "MISMATCH") << "\n";
+    return ok ? 0 : 1;
+}
+
+// Writes a synthetic bookings.txt with n bookings over the catalog's flights
+void writeBenchBookingsFile(const string& path, int n, int perFlight) {
+    ofstream out(path);
+    out << n << "\n";
+    for (int i = 0; i < n; ++i) {
+        Flight* fl = catalog.all()[i / perFlight].get();
+        Passenger p = makeBenchPassenger(i);
+        out << (i+1) << "|" << p.name << "|" << p.phone << "|" << p.email << "|" << p.gender << "|"
+            << (int)p.meal << "|" << (p.wheelchair ? 1 : 0) << "|" << p.luggageKg << "|"
+            << fl->seats.code(i % perFlight) << "|2025-01-01 00:00:00|3|100.0|" << fl->flightNo << "\n";
+    }
+}
+
+// Tokenizing bookings.txt the old way (getline + stringstream + stoi/stod)
+// vs the mmapped from_chars loader, then full loads at 1 and N threads
+int benchLoad(int nBookings, int threads) {
+    const string path = "bench_bookings.tmp";
+    auto layout = makeBenchLayout(60, "ABCDEFGHJK");
+    int perFlight = layout->size() * 8 / 10;
+    addBenchFlights((nBookings + perFlight - 1) / perFlight, layout);
+    writeBenchBookingsFile(path, nBookings, perFlight);
+    if (threads <= 0) threads = (int)max(1u, thread::hardware_concurrency());
+
+    auto t0 = BenchClock::now();
+    long sink = 0;
+    {
+        ifstream f(path);
+        string line;
+        getline(f, line);
+        while (getline(f, line)) {
+            vector<string> parts;
+            string token;
+            stringstream ss(line);
+            while (getline(ss, token, '|')) parts.push_back(token);
+            sink += stoi(parts[0]) + stoi(parts[5]) + stoi(parts[7]) + stoi(parts[10]) + (long)stod(parts[11]);
+        }
+    }
+    double legacyMs = elapsedMs(t0);
+
+    t0 = BenchClock::now();
+    {
+        ifstream f(path, ios::binary);
+        string data((istreambuf_iterator<char>(f)), istreambuf_iterator<char>());
+        ParsedChunk chunk;
+        parseBookingChunk(data.data() + data.find('\n') + 1, data.data() + data.size(), chunk);
+        sink += chunk.rows.size();
+    }
+    double tokenizeMs = elapsedMs(t0);
+
+    t0 = BenchClock::now();
+    loadBookingsFromFile(path, 1);
+    double load1Ms = elapsedMs(t0);
+    size_t loaded1 = bookings.size();
+    resetBenchState();
+    t0 = BenchClock::now();
+    loadBookingsFromFile(path, threads);
+    double loadNMs = elapsedMs(t0);
+    remove(path.c_str());
+
+    cout << fixed << setprecision(1);
+    cout << nBookings << " bookings\n";
+    cout << "tokenize, getline/stringstream: " << legacyMs << " ms (" << nBookings / legacyMs << "K lines/s)\n";
+    cout << "tokenize, from_chars:           " << tokenizeMs << " ms (" << nBookings / tokenizeMs << "K lines/s)\n";
+    cout << "full load, 1 thread:            " << load1Ms << " ms\n";
+    cout << "full load, " << threads << " threads:           " << loadNMs << " ms\n";
+    cout << "(checksum " << sink << ")\n";
+    return loaded1 == bookings.size() && (int)loaded1 == nBookings ? 0 : 1;
+}
+
+// Cancellation storm: a full flight with `depth` passengers waitlisted
+// across classes and preferences, then `nCancels` random cancellations,
+// each refilled from the waitlist. Picking who gets a freed seat is also
+// timed on its own, against scanning one shared FIFO for the best
+// matching entry (wheelchair first, then arrival).
+int benchWaitlist(int depth, int nCancels) {
+    auto layout = makeBenchLayout(30, "ABCDEF");
+    addBenchFlights(1, layout);
+    Flight& fl = *catalog.front();
+    vector<int> holder(fl.seats.size());
+    for (int i = 0; i < fl.seats.size(); ++i) {
+        fl.seats.setBooked(i, true);
+        holder[i] = addBooking(make_unique<Booking>(nextBookingId(), makeBenchPassenger(i), &fl, i, make_unique<Payment>(100.0, CASH)))->id;
+    }
+    uint64_t rng = 88172645463325252ULL;
+    auto next = [&rng]() { rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17; return rng; };
+    struct Flat { SeatClass cls; int pref; bool wheelchair; };
+    deque<Flat> fifo;
+    Waitlist picks; // same entries, for timing takeNext alone
+    double addMs = 0;
+    for (int k = 0; k < depth; ++k) {
+        WaitlistEntry e;
+        e.passenger = makeBenchPassenger(k);
+        e.cls = static_cast<SeatClass>(next() % 10 < 7 ? ECONOMY : next() % 2 ? BUSINESS : FIRST_CLASS);
+        e.pref = (int)(next() % (NUM_SEAT_PREFS + 1)) - 1;
+        fifo.push_back({ e.cls, e.pref, e.passenger.wheelchair });
+        picks.add(e);
+        auto t0 = BenchClock::now();
+        fl.waitlist.add(move(e));
+        addMs += elapsedMs(t0);
+    }
+
+    // the same sequence of freed seats for both
+    vector<int> freed;
+    for (int k = 0; k < nCancels; ++k) freed.push_back((int)(next() % fl.seats.size()));
+
+    int scanOps = min(nCancels, 2000);
+    auto t0 = BenchClock::now();
+    long found = 0;
+    for (int k = 0; k < scanOps; ++k) {
+        SeatClass c = fl.seats.cls(freed[k]);
+        int p = fl.seats.pref(freed[k]);
+        auto best = fifo.end();
+        for (auto it = fifo.begin(); it != fifo.end(); ++it) {
+            if (it->cls != c || (it->pref >= 0 && it->pref != p)) continue;
+            if (best == fifo.end()) best = it;
+            if (it->wheelchair) { best = it; break; }
+        }
+        if (best != fifo.end()) { fifo.erase(best); found++; }
+    }
+    double scanMs = elapsedMs(t0);
+
+    t0 = BenchClock::now();
+    long taken = 0;
+    for (int slot : freed) {
+        WaitlistEntry e;
+        taken += picks.takeNext(fl.seats.cls(slot), fl.seats.pref(slot), e);
+    }
+    double pickMs = elapsedMs(t0);
+
+    t0 = BenchClock::now();
+    long refilled = 0;
+    for (int slot : freed) {
+        Booking* reassigned;
+        cancelAndRefill(holder[slot], reassigned);
+        if (reassigned) { holder[slot] = reassigned->id; refilled++; }
+    }
+    double stormMs = elapsedMs(t0);
+
+    int free = 0;
+    for (int i = 0; i < fl.seats.size(); ++i) free += !fl.seats.isBooked(i);
+    bool ok = (size_t)(depth - refilled) == fl.waitlist.size() && (int)bookings.size() == fl.seats.size() - free &&
+              verifyReportAggregates();
+    cout << fixed << setprecision(3);
+    cout << depth << " waitlisted, " << nCancels << " cancellations on " << fl.seats.size() << " seats\n";
+    cout << "enqueue:            " << addMs * 1000 / depth << " us/entry\n";
+    cout << "pick, shared FIFO:  " << scanMs * 1000 / scanOps << " us (" << scanOps << " picks, " << found << " found)\n";
+    cout << "pick, per class:    " << pickMs * 1000 / nCancels << " us (" << nCancels << " picks, " << taken << " found)\n";
+    cout << "cancel + refill:    " << stormMs * 1000 / nCancels << " us/cancel (" << refilled << " seats reassigned, "
+         << fl.waitlist.size() << " still waiting, " << free << " seats free)\n";
+    cout << "consistency:        " << (ok ? "OK" : "MISMATCH") << "\n";
+    return ok ? 0 : 1;
+}
+
+// Churn: every booking is cancelled and its seat rebooked, three times
+// over, then all the cancellations are streamed back from the archive. The
+// first round warms up (the search index and the archive's memory tier
+// reach their working size); heap growth over the other two is what
+// cancellations cost in memory, and must stay flat.
+int benchArchive(int n) {
+    seedBenchBookings(n);
+    vector<int> ids, next, cancelled;
+    bookings.forEach([&](const Booking& b) { ids.push_back(b.id); });
+    next.reserve(ids.size());
+    cancelled.reserve(ids.size() * 3);
+    int k = 0;
+    auto churn = [&] {
+        next.clear();
+        for (int id : ids) {
+            Cancellation c = cancelBooking(id);
+            cancelled.push_back(id);
+            c.flight->seats.setBooked(c.seat, true);
+            next.push_back(addBooking(make_unique<Booking>(nextBookingId(), makeBenchPassenger(n + k++), c.flight, c.seat,
+                                                           make_unique<Payment>(100.0, CASH)))->id);
+        }
+        ids.swap(next);
+    };
+    churn();
+    size_t heap0 = heapInUse();
+    auto t0 = BenchClock::now();
+    churn();
+    churn();
+    double churnMs = elapsedMs(t0);
+    size_t heap1 = heapInUse();
+    size_t cycles = 2 * (size_t)n;
+
+    vector<int> streamed;
+    streamed.reserve(cancelled.size());
+    double total = 0.0;
+    t0 = BenchClock::now();
+    cancelledArchive.forEach([&](const ArchivedBooking& a) { streamed.push_back(a.id); total += a.total; });
+    double streamMs = elapsedMs(t0);
+
+    // a few bytes per cycle of slack for allocator noise; text that is
+    // never reclaimed costs over a hundred
+    double growth = heap1 ? ((double)heap1 - (double)heap0) / cycles : 0.0;
+    bool flat = growth < 8.0;
+    cout << fixed << setprecision(1);
+    cout << cycles << " cancel + rebook cycles in " << churnMs << " ms (" << churnMs * 1000 / cycles << " us each)\n";
+    if (heap1) cout << "heap growth:  " << growth << " bytes per cycle after a warm-up round ("
+                    << CancelledArchive::BATCH * 2 << " newest cancellations kept in memory)" << (flat ? "" : "  GROWING") << "\n";
+    cout << "archive:      " << (double)cancelledArchive.fileBytes() / cancelled.size() << " bytes per cancellation on disk\n";
+    cout << "stream all:   " << streamMs << " ms (" << streamed.size() / streamMs / 1000 << " M rows/s)\n";
+    sort(streamed.begin(), streamed.end());
+    sort(cancelled.begin(), cancelled.end());
+    bool ok = streamed == cancelled && cancelledArchive.size() == cancelled.size() && bookings.size() == (size_t)n;
+    cout << "consistency:  " << (ok ? "OK" : "MISMATCH") << "\n";
+    cout << "(checksum " << setprecision(2) << total << ")\n";
+    return ok && flat ? 0 : 1;
+}
+
+// Bulk export of n bookings, a tenth of them cancelled into the archive:
+// an ostream writer with setprecision formatting (as the booking views
+// print) vs exportBookings to CSV and JSON Lines
+int benchExport(int n) {
+    seedBenchBookings(n);
+    int nCancel = n / 10;
+    for (int id = 1; id <= nCancel; ++id) cancelBooking(id * 10 - 9);
+    const string path = "bench_export.tmp";
+
+    auto t0 = BenchClock::now();
+    {
+        ofstream out(path);
+        out << "status,id,flight,seat,class,name,phone,email,base_fare,total,payment_method,booking_time\n";
+        for (Booking* b : bookings.sorted()) {
+            out << "active," << b->id << "," << b->flight->flightNo << "," << b->seatNo() << ","
+                << seatClassString(b->seatClass()) << "," << b->passenger.name << "," << b->passenger.phone << ","
+                << b->passenger.email << "," << fixed << setprecision(2) << b->fare() << "," << b->totalAmount() << ","
+                << b->payment->methodStr() << "," << formatTime(b->bookedAt) << "\n";
+        }
+        cancelledArchive.forEach([&](const ArchivedBooking& a) {
+            out << "cancelled," << a.id << "," << a.flightNo << "," << a.seatNo << ","
+                << seatClassString(static_cast<SeatClass>(a.seatClass)) << "," << a.name << "," << a.phone << ","
+                << a.email << "," << fixed << setprecision(2) << a.fare << "," << a.total << ","
+                << Payment::methodStr(static_cast<PaymentMethod>(a.payMethod)) << "," << a.bookingTime << "\n";
+        });
+    }
+    double streamMs = elapsedMs(t0);
+
+    bool ok = true;
+    cout << fixed << setprecision(1);
+    cout << n - nCancel << " active + " << nCancel << " cancelled bookings\n";
+    cout << "ostream (fewer columns):  " << streamMs << " ms (" << n / streamMs / 1000 << " M rows/s)\n";
+    for (const string& ext : { string(".csv"), string(".jsonl") }) {
+        size_t heap0 = heapInUse();
+        ExportCounts c;
+        t0 = BenchClock::now();
+        ok = exportBookings(path + ext, ExportFilter(), &c) && ok;
+        double ms = elapsedMs(t0);
+        size_t heap1 = heapInUse();
+        ok = ok && c.active == (size_t)(n - nCancel) && c.cancelled == (size_t)nCancel;
+        cout << "exportBookings " << left << setw(10) << ext << right << ms << " ms (" << n / ms / 1000 << " M rows/s, "
+             << c.bytes / ms / 1000 << " MB/s, " << (double)c.bytes / n << " bytes/row";
+        if (heap1) cout << ", heap " << ((double)heap1 - (double)heap0) / 1024 << " KB";
+        cout << ")\n";
+        remove((path + ext).c_str());
+    }
+    ExportCounts c;
+    ExportFilter economyFirstFlight;
+    economyFirstFlight.flightNo = catalog.front()->flightNo;
+    economyFirstFlight.cls = ECONOMY;
+    t0 = BenchClock::now();
+    ok = exportBookings(path + ".csv", economyFirstFlight, &c) && ok;
+    cout << "one flight, economy:      " << elapsedMs(t0) << " ms (" << c.active + c.cancelled << " rows)\n";
+    remove((path + ".csv").c_str());
+    remove(path.c_str());
+    cout << "row counts: " << (ok ? "OK" : "MISMATCH") << "\n";
+    return ok ? 0 : 1;
+}
+
+// Transaction IDs from `threads` threads at once, checked for
+// duplicates, against the old rand()-based IDs; then n keyed booking
+// requests each submitted twice, as a client retrying every request would
+int benchTxn(int n, int threads) {
+    threads = max(1, threads);
+    vector<vector<Str>> ids(threads);
+    auto t0 = BenchClock::now();
+    vector<thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            ids[t].reserve(n / threads);
+            for (int i = 0; i < n / threads; ++i) ids[t].push_back(newTxnId());
+        });
+    }
+    for (auto& w : workers) w.join();
+    double genMs = elapsedMs(t0);
+    vector<string_view> all;
+    for (auto& v : ids) for (Str s : v) all.push_back(s.view());
+    sort(all.begin(), all.end());
+    size_t dups = all.size() - (size_t)(unique(all.begin(), all.end()) - all.begin());
+
+    vector<int> old;
+    for (size_t i = 0; i < all.size(); ++i) old.push_back(rand() % 900000 + 100000);
+    sort(old.begin(), old.end());
+    size_t oldDups = old.size() - (size_t)(unique(old.begin(), old.end()) - old.begin());
+
+    cout << fixed << setprecision(1);
+    cout << all.size() << " txn IDs on " << threads << " threads: " << genMs << " ms (" << all.size() / genMs / 1000
+         << " M/s), " << dups << " duplicates (rand() % 900000: " << oldDups << ")\n";
+
+    auto layout = makeBenchLayout(60, "ABCDEFGHJK");
+    addBenchFlights((n + layout->size() - 1) / layout->size(), layout);
+    auto request = [&](int i) {
+        BookingRequest req;
+        req.flight = catalog.all()[i / layout->size()].get();
+        req.passenger = makeBenchPassenger(i);
+        req.cls = layout->cls[i % layout->size()];
+        req.seatNo = layout->code(i % layout->size());
+        req.idempotencyKey = "bench-" + to_string(i);
+        return req;
+    };
+    int booked = 0, replayed = 0;
+    string error;
+    t0 = BenchClock::now();
+    for (int i = 0; i < n; ++i) booked += bookSeat(request(i), error) != nullptr;
+    double firstMs = elapsedMs(t0);
+    t0 = BenchClock::now();
+    for (int i = 0; i < n; ++i) {
+        BookResult result;
+        bookSeat(request(i), error, &result);
+        replayed += result == REPLAYED;
+    }
+    double retryMs = elapsedMs(t0);
+    // past CAPACITY keys the oldest are forgotten; their retries must still not double-book
+    bool ok = dups == 0 && booked == n && bookings.size() == (size_t)n &&
+              ((size_t)n > IdempotencyCache::CAPACITY || replayed == n);
+    cout << "first submissions:  " << firstMs << " ms (" << n / firstMs * 1000 << " bookings/s)\n";
+    cout << "retries:            " << retryMs << " ms (" << n / retryMs * 1000 << " /s), " << replayed << " answered from "
+         << idempotencyKeys.size() << " remembered keys, " << bookings.size() << " bookings in total\n";
+    cout << "consistency: " << (ok ? "OK" : "MISMATCH") << "\n";
+    return ok ? 0 : 1;
+}
+
+// Connection search over a week's schedule: 40 hub and 260 spoke airports,
+// most flights touching a hub, one in ten sold out in economy. Queries
+// between random airports, best 5 by arrival and by fare with up to 3
+// legs. For up to 2 legs the results are checked against every
+// itinerary enumerated by scanning the whole schedule per leg.
+int benchRoutes(int nFlights, int nQueries) {
+    const int hubs = 40, airports = 300, days = 7;
+    auto code = [](int a) { return "P" + to_string(a); };
+    auto clock = [](int m) {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%d:%02d %s", (m / 60 + 11) % 12 + 1, m % 60, m < 720 ? "AM" : "PM");
+        return string(buf);
+    };
+    auto layout = defaultSeatLayout();
+    srand(5);
+    for (int i = 0; i < nFlights; ++i) {
+        int a = rand() % 10 < 8 ? rand() % hubs : rand() % airports, b;
+        do { b = rand() % 10 < 5 ? rand() % hubs : rand() % airports; } while (b == a);
+        if (rand() % 2) swap(a, b);
+        int dep = 6 * 60 + rand() % (16 * 60), arr = (dep + 60 + rand() % 300) % 1440;
+        char date[16];
+        snprintf(date, sizeof(date), "2025-03-%02d", 1 + rand() % days);
+        auto fl = make_unique<Flight>("RX" + to_string(i), code(a), code(b), date, clock(dep), clock(arr));
+        fl->seats.reset(layout);
+        if (i % 10 == 0) fl->seats.forEachAvailable(ECONOMY, -1, [&](int s) { fl->seats.setBooked(s, true); });
+        catalog.add(move(fl));
+    }
+    auto t0 = BenchClock::now();
+    int skipped = routePlanner.build(catalog);
+    double buildMs = elapsedMs(t0);
+
+    vector<RouteQuery> queries(nQueries);
+    for (auto& q : queries) {
+        int a = rand() % airports, b;
+        do { b = rand() % airports; } while (b == a);
+        q.from = code(a);
+        q.to = code(b);
+        q.date = "2025-03-0" + to_string(1 + rand() % (days - 1));
+    }
+    vector<Itinerary> found;
+    size_t results = 0;
+    double ms[2];
+    for (int byFare = 0; byFare < 2; ++byFare) {
+        t0 = BenchClock::now();
+        for (auto& q : queries) {
+            q.byFare = byFare;
+            routePlanner.search(q, found);
+            results += found.size();
+        }
+        ms[byFare] = elapsedMs(t0);
+    }
+
+    // every 1- and 2-leg itinerary, by scanning the schedule for each leg
+    struct Leg { const Flight* f; int dep, arr; double fare; };
+    vector<Leg> all;
+    auto minutes = [](const string& date, const string& t) {
+        int d = atoi(date.c_str() + 8), h = atoi(t.c_str()), m = atoi(t.c_str() + t.find(':') + 1);
+        h = h % 12 + (t.find("PM") != string::npos ? 12 : 0);
+        return d * 1440 + h * 60 + m;
+    };
+    for (auto& fl : catalog.all()) {
+        int dep = minutes(fl->date, fl->depTime), arr = minutes(fl->date, fl->arrTime);
+        double fare = -1;
+        fl->seats.forEachAvailable(ECONOMY, -1, [&](int s) { if (fare < 0 || fl->seats.price(s) < fare) fare = fl->seats.price(s); });
+        if (fare >= 0) fare *= fareEngine.multiplier(fl->seats);
+        all.push_back({ fl.get(), dep, arr < dep ? arr + 1440 : arr, fare });
+    }
+    int checked = min(nQueries, 200), mismatches = 0;
+    double scanMs = 0, plannerMs = 0;
+    for (int i = 0; i < checked; ++i) {
+        RouteQuery q = queries[i];
+        q.maxLegs = 2;
+        int day = atoi(q.date.c_str() + 8) * 1440;
+        for (int byFare = 0; byFare < 2; ++byFare) {
+            q.byFare = byFare;
+            t0 = BenchClock::now();
+            vector<pair<double, double>> keys;
+            for (const Leg& a : all) {
+                if (a.f->src != q.from || a.dep < day || a.dep >= day + 1440 || a.fare < 0) continue;
+                if (a.f->dest == q.to) keys.push_back({ byFare ? a.fare : a.arr, byFare ? a.arr : a.fare });
+                for (const Leg& b : all) {
+                    if (b.f->src != a.f->dest || b.f->dest != q.to || b.dep < a.arr + routePlanner.defaultConnect ||
+                        b.dep > a.arr + q.maxLayover || b.fare < 0) continue;
+                    keys.push_back({ byFare ? a.fare + b.fare : b.arr, byFare ? b.arr : a.fare + b.fare });
+                }
+            }
+            sort(keys.begin(), keys.end());
+            keys.resize(min(keys.size(), (size_t)q.count));
+            scanMs += elapsedMs(t0);
+            t0 = BenchClock::now();
+            routePlanner.search(q, found);
+            plannerMs += elapsedMs(t0);
+            // schedule minutes count from the 1st of the month here, from 1970 in the planner
+            bool same = found.size() == keys.size();
+            for (size_t k = 0; same && k < keys.size(); ++k) {
+                double arr = found[k].arrives - found[0].arrives, arr0 = byFare ? keys[0].second : keys[0].first;
+                double want = (byFare ? keys[k].second : keys[k].first) - arr0;
+                same = fabs(found[k].fare - (byFare ? keys[k].first : keys[k].second)) < 1e-6 && fabs(arr - want) < 1e-6;
+            }
+            if (!same) mismatches++;
+        }
+    }
+
+    cout << fixed << setprecision(3);
+    cout << catalog.size() << " flights between " << routePlanner.airportCount() << " airports indexed in " << buildMs << " ms"
+         << (skipped ? " (" + to_string(skipped) + " skipped)" : "") << "\n";
+    cout << "  by arrival: " << ms[0] / nQueries << " ms/query\n";
+    cout << "  by fare:    " << ms[1] / nQueries << " ms/query (" << setprecision(1) << (double)results / nQueries / 2
+         << " itineraries per query)\n" << setprecision(3);
+    cout << "  up to 2 legs, " << checked * 2 << " queries: schedule scan " << scanMs / checked / 2 << " ms/query, planner "
+         << plannerMs / checked / 2 << " ms/query\n";
+    cout << "consistency: " << (mismatches || skipped ? "MISMATCH (" + to_string(mismatches) + ")" : "OK") << "\n";
+    return mismatches || skipped ? 1 : 0;
+}
+
+// Heap per flight for a schedule of wide-body flights (358 seats, from a
+// layouts file) sharing one layout, vs each flight holding its own copy
+// of the layout as flights used to. Checks every flight points at the
+// shared layout and can sell every seat.
+int benchLayouts(int nFlights) {
+    const string path = "bench_layouts.tmp";
+    {
+        ofstream f(path);
+        f << "layout|B777\n"
+          << "cabin|2|1-2|ACDGHK|WAAAAW|300\n"
+          << "cabin|1|3-8|ACDFGK|WAAAAW|200\n"
+          << "cabin|0|10-40|ABCDEFGHJK|WMAAMMAAMW|100\n";
+    }
+    auto t0 = BenchClock::now();
+    int read = layouts.load(path);
+    double loadMs = elapsedMs(t0);
+    remove(path.c_str());
+    auto layout = layouts.find("B777");
+    if (read != 1 || !layout) {
+        cout << "layouts file not read\n";
+        return 1;
+    }
+
+    size_t heap0 = heapInUse();
+    addBenchFlights(nFlights, layout);
+    size_t heap1 = heapInUse();
+    bool ok = (int)catalog.size() == nFlights;
+    for (auto& fl : catalog.all()) {
+        if (&fl->seats.layout() != layout.get()) ok = false;
+        int sold = 0;
+        for (int i = 0; i < fl->seats.size(); ++i) sold += fl->seats.tryClaim(i);
+        if (sold != layout->size() || fl->seats.countAvailable() != 0) ok = false;
+    }
+
+    size_t heap2 = heapInUse();
+    for (auto& fl : catalog.all()) fl->seats.reset(make_shared<const SeatLayout>(*layout));
+    size_t heap3 = heapInUse();
+
+    cout << fixed << setprecision(1);
+    cout << "layout " << layout->name << ": " << layout->size() << " seats in " << layout->rowNumbers.size()
+         << " rows, read in " << setprecision(3) << loadMs << " ms\n" << setprecision(1);
+    if (heap1) {
+        double shared = (double)(heap1 - heap0) / nFlights, own = shared + (double)(heap3 - heap2) / nFlights;
+        cout << nFlights << " flights, shared layout: " << shared << " bytes per flight (" << shared / layout->size()
+             << " per seat)\n";
+        cout << nFlights << " flights, own layout:    " << own << " bytes per flight (" << own / layout->size()
+             << " per seat)\n";
+    } else {
+        cout << "heap in use: unknown on this platform\n";
+    }
+    cout << "consistency: " << (ok ? "OK" : "MISMATCH") << "\n";
+    return ok ? 0 : 1;
+}
+
+// Party seating on a wide-body cabin (rows x letters): parties of 1-6 in
+// a random class until the flights are full, seats found by a per-seat
+// walk of the cabin vs SeatStore::findGroup's row bitmasks, each claimed
+// with tryClaimAll. Then whole group bookings end to end. Checks that no
+// seat went to two parties and that every together party is in one row.
+int benchGroup(int rows, int parties) {
+    auto layout = makeBenchLayout(rows, "ABCDEFGHJK");
+    int perFlight = layout->size();
+    int nFlights = max(1, parties * 7 / 2 / perFlight); // 3.5 passengers per party
+    addBenchFlights(2 * nFlights, layout);
+    srand(11);
+    vector<pair<int, SeatClass>> plan(parties);
+    for (auto& p : plan) {
+        int r = rand() % 10;
+        p = { 1 + rand() % 6, r < 7 ? ECONOMY : r < 9 ? BUSINESS : FIRST_CLASS };
+    }
+
+    // the walk a caller would do without row masks: seat by seat, keeping a run length
+    auto walk = [](const SeatStore& st, SeatClass c, int n, vector<int>& out) {
+        out.clear();
+        const SeatLayout& l = st.layout();
+        int run = 0;
+        for (int i = 0; i < st.size(); ++i) {
+            if (i && l.row[i] != l.row[i - 1]) run = 0;
+            if (st.cls(i) == c && !st.isBooked(i)) {
+                if (++run == n) {
+                    for (int k = n - 1; k >= 0; --k) out.push_back(i - k);
+                    return true;
+                }
+            } else {
+                run = 0;
+            }
+        }
+        for (int i = 0; i < st.size() && (int)out.size() < n; ++i) if (st.cls(i) == c && !st.isBooked(i)) out.push_back(i);
+        return (int)out.size() == n;
+    };
+    auto run = [&](int firstFlight, bool masks, int& seated, int& together, bool& ok) {
+        vector<int> slots;
+        int f = firstFlight;
+        seated = together = 0;
+        for (auto& p : plan) {
+            SeatStore& st = catalog.all()[f]->seats;
+            bool side = false, found = masks ? st.findGroup(p.second, -1, p.first, slots, side) : walk(st, p.second, p.first, slots);
+            if (!found) {
+                if (++f == firstFlight + nFlights) break;
+                continue;
+            }
+            if (!st.tryClaimAll(slots)) { ok = false; break; }
+            seated += p.first;
+            if (masks && side) {
+                together++;
+                for (int s : slots) if (st.layout().row[s] != st.layout().row[slots[0]]) ok = false;
+            }
+        }
+    };
+    bool ok = true;
+    int walkSeated, walkTogether, maskSeated, maskTogether;
+    auto t0 = BenchClock::now();
+    run(0, false, walkSeated, walkTogether, ok);
+    double walkMs = elapsedMs(t0);
+    t0 = BenchClock::now();
+    run(nFlights, true, maskSeated, maskTogether, ok);
+    double maskMs = elapsedMs(t0);
+    int claimed = 0;
+    for (int f = nFlights; f < 2 * nFlights; ++f) claimed += perFlight - catalog.all()[f]->seats.countAvailable();
+    ok = ok && claimed == maskSeated;
+
+    // end to end from 4 threads sharing the flights: passengers, fares,
+    // journal records and the booking table, racing for the same rows
+    resetBenchState();
+    const int threads = 4;
+    atomic<int> booked{0};
+    vector<thread> pool;
+    t0 = BenchClock::now();
+    for (int t = 0; t < threads; ++t) {
+        pool.emplace_back([&, t] {
+            int f = 0;
+            for (int i = t; i < parties; i += threads) {
+                GroupRequest req;
+                req.cls = plan[i].second;
+                for (int k = 0; k < plan[i].first; ++k) req.passengers.push_back(makeBenchPassenger(i * 6 + k));
+                string error;
+                for (; f < (int)catalog.size(); ++f) {
+                    req.flight = catalog.all()[f].get();
+                    size_t got = bookGroup(req, error).size();
+                    if (got) { booked += (int)got; break; }
+                }
+            }
+        });
+    }
+    for (auto& th : pool) th.join();
+    double bookMs = elapsedMs(t0);
+    unordered_map<const Flight*, vector<char>> taken;
+    size_t held = 0, sold = 0;
+    bookings.forEach([&](const Booking& b) {
+        auto& seen = taken[b.flight];
+        seen.resize(b.flight->seats.size());
+        if (seen[b.seat]++ || !b.flight->seats.isBooked(b.seat)) ok = false;
+        held++;
+    });
+    for (auto& fl : catalog.all()) sold += fl->seats.size() - fl->seats.countAvailable();
+    ok = ok && held == (size_t)booked.load() && sold == held;
+
+    cout << fixed << setprecision(2);
+    cout << parties << " parties on " << nFlights << " flights of " << rows << " x 10 seats:\n";
+    cout << "  per-seat walk: " << walkMs * 1000 / parties << " us/party (" << walkSeated << " seated)\n";
+    cout << "  row bitmasks:  " << maskMs * 1000 / parties << " us/party (" << maskSeated << " seated, "
+         << setprecision(1) << 100.0 * maskTogether / parties << "% of parties side by side)\n";
+    cout << setprecision(2) << "  bookGroup:     " << bookMs * 1000 / parties << " us/party from " << threads << " threads (" << booked << " bookings)\n";
+    cout << "consistency: " << (ok ? "OK" : "MISMATCH") << "\n";
+    return ok ? 0 : 1;
+}
+
+// Full-schedule repricing under load-based fares: every seat of every
+// flight quoted one call at a time (fare engine per seat, as a seat map
+// priced seat by seat would) vs one batched quote per flight. Flights are
+// filled to random loads so they fall in different bands.
+int benchFares(int nFlights, int rounds) {
+    auto layout = makeBenchLayout(60, "ABCDEFGHJK");
+    addBenchFlights(nFlights, layout);
+    FareRules rules;
+    rules.bands = { {0.5, 1.15}, {0.7, 1.3}, {0.9, 1.6} };
+    fareEngine.setRules(rules);
+    srand(7);
+    for (auto& fl : catalog.all()) {
+        int sold = rand() % layout->size();
+        for (int i = 0; i < sold; ++i) fl->seats.setBooked(i, true);
+    }
+    size_t seats = (size_t)nFlights * layout->size() * rounds;
+
+    double perSeatSum = 0;
+    auto t0 = BenchClock::now();
+    for (int r = 0; r < rounds; ++r) {
+        for (auto& fl : catalog.all()) {
+            for (int i = 0; i < fl->seats.size(); ++i) perSeatSum += fareEngine.seatFare(fl->seats, i);
+        }
+    }
+    double perSeatMs = elapsedMs(t0);
+
+    double batchSum = 0;
+    FareQuote q;
+    t0 = BenchClock::now();
+    for (int r = 0; r < rounds; ++r) {
+        for (auto& fl : catalog.all()) {
+            fareEngine.quote(fl->seats, q);
+            for (double f : q.fare) batchSum += f;
+        }
+    }
+    double batchMs = elapsedMs(t0);
+
+    // the quote's cheapest free seat and counts against a seat-by-seat scan
+    bool ok = fabs(perSeatSum - batchSum) <= 1e-9 * perSeatSum;
+    for (auto& fl : catalog.all()) {
+        fareEngine.quote(fl->seats, q);
+        for (int c = 0; c < NUM_SEAT_CLASSES; ++c) {
+            double lowest = 0;
+            int n = 0;
+            fl->seats.forEachAvailable(static_cast<SeatClass>(c), -1, [&](int i) {
+                double f = fareEngine.seatFare(fl->seats, i);
+                if (!n++ || f < lowest) lowest = f;
+            });
+            if (n != q.available[c] || lowest != q.lowest[c]) ok = false;
+        }
+    }
+    fareEngine.setRules(FareRules());
+
+    cout << fixed << setprecision(1);
+    cout << nFlights << " flights x " << layout->size() << " seats, " << rounds << " repricing rounds:\n";
+    cout << "  per seat:  " << perSeatMs << " ms (" << seats / perSeatMs / 1000 << " M quotes/s)\n";
+    cout << "  batched:   " << batchMs << " ms (" << seats / batchMs / 1000 << " M quotes/s, "
+         << (double)nFlights * rounds / batchMs * 1000 << " flights/s)\n";
+    cout << "consistency: " << (ok ? "OK" : "MISMATCH") << "\n";
+    return ok ? 0 : 1;
+}
+
+// Stamping n bookings from `threads` threads: the old formatted string
+// per booking (time + localtime_r + strftime into the arena) vs the
+// coarse clock, then formatting and parsing the stored seconds back,
+// checked to round-trip over a year of times
+int benchClock(int n, int threads) {
+    threads = max(1, threads);
+    auto perThread = [&](auto stamp) {
+        auto t0 = BenchClock::now();
+        vector<thread> workers;
+        atomic<uint64_t> sink{0};
+        for (int t = 0; t < threads; ++t) {
+            workers.emplace_back([&] {
+                uint64_t local = 0;
+                for (int i = 0; i < n / threads; ++i) local += stamp();
+                sink += local; // keeps the stamps from being optimized away
+            });
+        }
+        for (auto& w : workers) w.join();
+        return elapsedMs(t0);
+    };
+    double oldMs = perThread([] {
+        char buf[80];
+        time_t now = time(0);
+        struct tm tmNow;
+        localtime_r(&now, &tmNow);
+        return (uint64_t)Str::store(string_view(buf, strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tmNow))).size();
+    });
+    double newMs = perThread([] { return (uint64_t)clockNow(); });
+
+    // formatting and parsing as a load or an export does: times a few
+    // seconds apart, so most share a minute with the one before
+    const int64_t start = clockNow() - 365 * 86400;
+    const int64_t step = 365 * 86400 / max(1, n) + 1;
+    size_t bad = 0;
+    string text;
+    auto t0 = BenchClock::now();
+    for (int i = 0; i < n; ++i) text += formatTime(start + i * step);
+    double formatMs = elapsedMs(t0);
+    t0 = BenchClock::now();
+    for (int i = 0; i < n; ++i) {
+        int64_t t = 0;
+        if (!parseTime(string_view(text).substr((size_t)i * (TIME_TEXT - 1), TIME_TEXT - 1), t) || t != start + i * step) {
+            // the repeated hour when clocks go back reads as its first pass
+            if (formatTime(t) != formatTime(start + i * step)) bad++;
+        }
+    }
+    double parseMs = elapsedMs(t0);
+
+    int64_t lo = 0, hi = 0;
+    bool prefixOk = parseTime("2025-01", lo) && parseTime("2025-01", hi, true) &&
+                    formatTime(lo) == "2025-01-01 00:00:00" && formatTime(hi) == "2025-01-31 23:59:59";
+
+    cout << fixed << setprecision(1);
+    cout << n << " booking stamps on " << threads << " threads:\n";
+    cout << "  localtime_r + strftime string: " << oldMs << " ms (" << n / oldMs / 1000 << " M/s)\n";
+    cout << "  coarse clock seconds:          " << newMs << " ms (" << n / newMs / 1000 << " M/s)\n";
+    cout << "format " << n << " stored times: " << formatMs << " ms, parse back: " << parseMs << " ms\n";
+    cout << "round trip: " << (bad == 0 ? "OK" : to_string(bad) + " MISMATCHES") << ", month prefix bounds: "
+         << (prefixOk ? "OK" : "MISMATCH") << "\n";
+    return bad == 0 && prefixOk ? 0 : 1;
+}
+
+// Heap cost of n bookings loaded from bookings.txt: allocations made per
+// booking (counted only when built with -DAMS_COUNT_ALLOCS) and heap
+// bytes still in use per booking afterwards, search index included.
+int benchMemory(int n) {
+    const string path = "bench_bookings.tmp";
+    auto layout = makeBenchLayout(60, "ABCDEFGHJK");
+    int perFlight = layout->size();
+    addBenchFlights((n + perFlight - 1) / perFlight, layout);
+    writeBenchBookingsFile(path, n, perFlight);
+
+    size_t heap0 = heapInUse();
+#ifdef AMS_COUNT_ALLOCS
+    uint64_t allocs0 = allocCount.load();
+#endif
+    auto t0 = BenchClock::now();
+    loadBookingsFromFile(path);
+    double loadMs = elapsedMs(t0);
+    size_t heap1 = heapInUse();
+    remove(path.c_str());
+
+    cout << fixed << setprecision(1);
+    cout << bookings.size() << " bookings loaded in " << loadMs << " ms\n";
+    cout << "sizeof Booking " << sizeof(Booking) << ", Passenger " << sizeof(Passenger) << ", Payment " << sizeof(Payment) << "\n";
+#ifdef AMS_COUNT_ALLOCS
+    cout << "allocations:  " << setprecision(3) << (double)(allocCount.load() - allocs0) / n
+         << setprecision(1) << " per booking\n";
+#else
+    cout << "allocations:  not counted (build with -DAMS_COUNT_ALLOCS)\n";
+#endif
+    if (heap1) cout << "heap in use:  " << (double)(heap1 - heap0) / n << " bytes per booking\n";
+    cout << "string arena: " << (double)stringArena().bytes() / n << " bytes per booking\n";
+    return (int)bookings.size() == n ? 0 : 1;
+}
+
+// Worker threads book, cancel and move seats on a handful of shared
+// flights at once, for 1, 2, 4 ... maxThreads threads. After each run the
+// store is checked: no seat held twice, seat bits matching the bookings,
+// no booking ID issued twice, every successful booking either active or
+// cancelled exactly once, and report aggregates consistent.
+int benchStress(int maxThreads, int opsPerThread) {
+    auto layout = makeBenchLayout(40, "ABCDEF");
+    addBenchFlights(32, layout);
+    if (maxThreads <= 0) maxThreads = (int)max(1u, thread::hardware_concurrency());
+    vector<int> steps;
+    for (int t = 1; t < maxThreads; t *= 2) steps.push_back(t);
+    steps.push_back(maxThreads);
+
+    cout << fixed << setprecision(0);
+    cout << opsPerThread << " ops/thread (40% book, 40% cancel, 20% seat change) on "
+         << catalog.size() << " flights x " << layout->size() << " seats\n";
+    bool allOk = true;
+    for (int threads : steps) {
+        resetBenchState();
+        atomic<long> booked{0}, cancelled{0}, moved{0}, lost{0};
+        vector<atomic<int>> recent(4096); // recently booked IDs, shared so threads race for them
+        for (auto& r : recent) r = 0;
+        atomic<unsigned> recentPos{0};
+        auto worker = [&](int t) {
+            uint64_t rng = 0x9E3779B97F4A7C15ULL * (uint64_t)(t + 1);
+            auto next = [&rng]() { rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17; return rng; };
+            const auto& flights = catalog.all();
+            long nb = 0, nc = 0, nm = 0, nl = 0;
+            for (int k = 0; k < opsPerThread; ++k) {
+                unsigned op = next() % 10;
+                Flight* fl = flights[next() % flights.size()].get();
+                int slot = (int)(next() % fl->seats.size());
+                if (op < 4) {
+                    // wanted seat, else the first free one of its class (where threads collide)
+                    if (fl->seats.isBooked(slot)) fl->seats.forEachAvailable(fl->seats.cls(slot), -1, [&](int i) { if (fl->seats.isBooked(slot)) slot = i; });
+                    auto b = make_unique<Booking>(nextBookingId(), makeBenchPassenger(k), fl, slot, make_unique<Payment>(100.0, CASH));
+                    if (Booking* done = confirmBooking(move(b))) {
+                        recent[recentPos++ % recent.size()] = done->id;
+                        nb++;
+                    } else {
+                        nl++;
+                    }
+                    continue;
+                }
+                int id = recent[next() % recent.size()];
+                if (op < 8) {
+                    if (cancelBooking(id).ok) nc++;
+                } else if (changeSeat(id, slot)) { // every flight shares the layout
+                    nm++;
+                }
+            }
+            booked += nb; cancelled += nc; moved += nm; lost += nl;
+        };
+
+        auto t0 = BenchClock::now();
+        vector<thread> workers;
+        for (int t = 0; t < threads; ++t) workers.emplace_back(worker, t);
+        for (auto& w : workers) w.join();
+        double ms = elapsedMs(t0);
+
+        bool ok = bookings.size() == (size_t)(booked - cancelled) && cancelledArchive.size() == (size_t)cancelled;
+        vector<int> ids;
+        unordered_map<const Flight*, vector<int>> holders;
+        bookings.forEach([&](const Booking& b) {
+            ids.push_back(b.id);
+            vector<int>& h = holders[b.flight];
+            h.resize(b.flight->seats.size());
+            h[b.seat]++;
+        });
+        cancelledArchive.forEach([&](const ArchivedBooking& a) { ids.push_back(a.id); });
+        sort(ids.begin(), ids.end());
+        ok = ok && adjacent_find(ids.begin(), ids.end()) == ids.end();
+        for (const auto& f : catalog.all()) {
+            vector<int>& h = holders[f.get()];
+            h.resize(f->seats.size());
+            for (int i = 0; i < f->seats.size(); ++i) {
+                if (h[i] > 1 || f->seats.isBooked(i) != (h[i] == 1)) ok = false;
+            }
+        }
+        ok = ok && verifyReportAggregates();
+        allOk = allOk && ok;
+
+        long ops = (long)threads * opsPerThread;
+        cout << setw(3) << threads << " threads: " << setw(9) << ops / ms * 1000 << " ops/s  ("
+             << booked << " booked, " << lost << " found no seat, " << cancelled << " cancelled, "
+             << moved << " moved; " << bookings.size() << " active)  " << (ok ? "OK" : "INCONSISTENT") << "\n";
+    }
+    return allOk ? 0 : 1;
+}
+
+// Per-call latencies of one operation
+struct LatencySamples {
+    vector<double> us;
+
+    template <class F> void time(F&& op) {
+        auto t0 = BenchClock::now();
+        op();
+        us.push_back(chrono::duration<double, micro>(BenchClock::now() - t0).count());
+    }
+
+    void report(const string& name) {
+        if (us.empty()) { cout << left << setw(14) << name << "no samples\n" << right; return; }
+        sort(us.begin(), us.end());
+        double total = 0;
+        for (double v : us) total += v;
+        auto pct = [&](double p) { return us[min(us.size() - 1, (size_t)(p / 100 * us.size()))]; };
+        cout << left << setw(14) << name << right << setw(9) << us.size() << setprecision(0) << setw(12)
+             << us.size() / total * 1e6 << setprecision(2) << setw(10) << pct(50) << setw(10) << pct(90) << setw(10) << pct(99) << setw(10) << pct(99.9)
+             << setw(11) << us.back() << "\n";
+    }
+};
+
+// Cost of recording one sample: per-thread histograms vs one shared
+// histogram bumped with atomic adds, at 1..maxThreads threads
+int benchMetrics(int maxThreads, int samplesPerThread) {
+    if (maxThreads <= 0) maxThreads = max(1u, thread::hardware_concurrency());
+    vector<atomic<uint64_t>> shared(LatencyHistogram::BUCKETS);
+    uint64_t before = readMetrics().ops[M_BOOK].count;
+    bool ok = true;
+    cout << "threads  per-thread ns/record  shared-atomic ns/record\n";
+    for (int t = 1; t <= maxThreads; t *= 2) {
+        auto run = [&](auto record) {
+            vector<thread> workers;
+            auto t0 = BenchClock::now();
+            for (int w = 0; w < t; ++w) {
+                workers.emplace_back([&, w] {
+                    uint64_t ns = 500 + w;
+                    for (int i = 0; i < samplesPerThread; ++i) {
+                        record(ns);
+                        ns = ns * 6364136223846793005ULL + 1442695040888963407ULL;
+                        ns = 200 + (ns >> 44); // 200ns .. ~1ms
+                    }
+                });
+            }
+            for (auto& w : workers) w.join();
+            return elapsedMs(t0) * 1e6 / samplesPerThread; // each thread records samplesPerThread
+        };
+        double local = run([](uint64_t ns) { recordMetric(M_BOOK, ns, true); });
+        double atomicAdd = run([&](uint64_t ns) { shared[LatencyHistogram::bucketOf(ns)].fetch_add(1, memory_order_relaxed); });
+        cout << setw(7) << t << setw(22) << fixed << setprecision(1) << local << setw(25) << atomicAdd << "\n";
+        before += (uint64_t)t * samplesPerThread;
+    }
+    MetricsSnapshot m = readMetrics();
+    ok = m.ops[M_BOOK].count == before;
+    cout << "samples recorded:  " << (ok ? "OK" : "MISMATCH") << " (" << m.ops[M_BOOK].count << ")\n";
+    cout << "p50/p99/max:       " << m.ops[M_BOOK].percentileNs(50) << " / " << m.ops[M_BOOK].percentileNs(99)
+         << " / " << m.ops[M_BOOK].maxNs << " ns\n";
+    return ok ? 0 : 1;
+}
+
+// Seat-map polling with one seat changing between polls: the text map
+// rebuilt from scratch (as displaySeatMap used to) vs the per-row cache,
+// and the full JSON seat list vs the delta since the last version
+int benchSeatMap(int rows, int polls) {
+    auto layout = makeBenchLayout(max(1, rows), "ABCDEFGHJK");
+    addBenchFlights(1, layout);
+    Flight& fl = *catalog.front();
+    for (int i = 0; i < fl.seats.size(); i += 2) fl.seats.setBooked(i, true);
+    auto churn = [&](int k) {
+        int slot = (int)((uint64_t)k * 2654435761u % (uint64_t)fl.seats.size());
+        fl.seats.setBooked(slot, !fl.seats.isBooked(slot));
+    };
+
+    size_t bytes = 0;
+    auto t0 = BenchClock::now();
+    for (int k = 0; k < polls; ++k) {
+        churn(k);
+        map<int, vector<int>> byRow;
+        for (int i = 0; i < fl.seats.size(); ++i) byRow[stoi(fl.seats.code(i).substr(0, fl.seats.code(i).size() - 1))].push_back(i);
+        ostringstream out;
+        for (const auto& kv : byRow) {
+            out << setw(2) << kv.first << " ";
+            for (char ch = 'A'; ch <= layout->lastLetter; ++ch) {
+                int match = -1;
+                for (int i : kv.second) if (layout->letter[i] == ch) match = i;
+                if (match >= 0) out << "[" << (fl.seats.isBooked(match) ? 'X' : ch) << "] ";
+                else out << "     ";
+            }
+            out << "\n";
+        }
+        bytes += out.str().size();
+    }
+    double rebuildMs = elapsedMs(t0);
+
+    t0 = BenchClock::now();
+    for (int k = 0; k < polls; ++k) {
+        churn(k);
+        string text;
+        fl.seats.render(text);
+        bytes += text.size();
+    }
+    double cachedMs = elapsedMs(t0);
+
+    HttpServer server;
+    bool wrote = false;
+    size_t fullBytes = 0, deltaBytes = 0;
+    t0 = BenchClock::now();
+    for (int k = 0; k < polls; ++k) {
+        churn(k);
+        fullBytes += server.route("GET", "/api/flight-info", "", wrote).body.size();
+    }
+    double fullMs = elapsedMs(t0);
+
+    uint64_t version = fl.seats.version();
+    t0 = BenchClock::now();
+    for (int k = 0; k < polls; ++k) {
+        churn(k);
+        deltaBytes += server.route("GET", "/api/flight-info?since=" + to_string(version), "", wrote).body.size();
+        version = fl.seats.version();
+    }
+    double deltaMs = elapsedMs(t0);
+
+    // A client following deltas must end up with the real seat states,
+    // and the row cache must match a map rendered from scratch
+    vector<char> mirror(fl.seats.size());
+    vector<int> changed;
+    bool full;
+    version = fl.seats.changesSince(0, changed, full);
+    for (int i : changed) mirror[i] = fl.seats.isBooked(i);
+    for (int k = 0; k < polls; ++k) {
+        churn(k * 7 + 1);
+        changed.clear();
+        version = fl.seats.changesSince(version, changed, full);
+        for (int i : changed) mirror[i] = fl.seats.isBooked(i);
+    }
+    bool ok = true;
+    for (int i = 0; i < fl.seats.size(); ++i) ok = ok && mirror[i] == fl.seats.isBooked(i);
+    SeatStore fresh;
+    fresh.reset(fl.seats.layoutPtr());
+    for (int i = 0; i < fl.seats.size(); ++i) fresh.setBooked(i, fl.seats.isBooked(i));
+    string cachedText, freshText;
+    fl.seats.render(cachedText);
+    fresh.render(freshText);
+    ok = ok && cachedText == freshText;
+
+    cout << fixed << setprecision(2);
+    cout << "layout " << layout->name << " (" << layout->size() << " seats), " << polls << " polls, one change between polls\n";
+    cout << "text map, rebuilt:    " << rebuildMs << " ms (" << polls / rebuildMs * 1000 << " maps/s)\n";
+    cout << "text map, row cache:  " << cachedMs << " ms (" << polls / cachedMs * 1000 << " maps/s)\n";
+    cout << "JSON, full map:       " << fullMs << " ms (" << polls / fullMs * 1000 << " polls/s, "
+         << fullBytes / polls << " bytes/poll)\n";
+    cout << "JSON, delta:          " << deltaMs << " ms (" << polls / deltaMs * 1000 << " polls/s, "
+         << deltaBytes / polls << " bytes/poll)\n";
+    cout << "delta client / cache: " << (ok ? "OK" : "MISMATCH") << "\n";
+    cout << "(checksum " << bytes << ")\n";
+    return ok ? 0 : 1;
+}
+
+// Load generator client: one connection at a time, reconnecting whenever
+// the server closes it (servers without keep-alive close after each reply)
+class BenchHttpClient {
+    sockaddr_in addr;
+    int fd = -1;
+    string buf;
+
+    bool fill() {
+        char tmp[64 * 1024];
+        ssize_t r = recv(fd, tmp, sizeof(tmp), 0);
+        if (r <= 0) return false;
+        buf.append(tmp, (size_t)r);
+        return true;
+    }
+    void drop() {
+        if (fd >= 0) close(fd);
+        fd = -1;
+        buf.clear();
+    }
+    // Reads one response; returns its status or -1
+    int readResponse() {
+        size_t end;
+        while ((end = buf.find("\r\n\r\n")) == string::npos) if (!fill()) return -1;
+        string head = buf.substr(0, end);
+        for (char& c : head) c = (char)tolower((unsigned char)c);
+        if (head.size() < 12 || head.compare(0, 5, "http/") != 0) return -1;
+        int status = atoi(head.c_str() + 9);
+        bool keepAlive = head.compare(0, 8, "http/1.1") == 0;
+        if (head.find("\r\nconnection: close") != string::npos) keepAlive = false;
+        if (head.find("\r\nconnection: keep-alive") != string::npos) keepAlive = true;
+        size_t cl = head.find("\r\ncontent-length:");
+        if (cl != string::npos) {
+            size_t total = end + 4 + (size_t)atol(head.c_str() + cl + 17);
+            while (buf.size() < total) if (!fill()) return -1;
+            buf.erase(0, total);
+        } else {
+            while (fill()) {}
+            keepAlive = false;
+        }
+        if (!keepAlive) drop();
+        return status;
+    }
+public:
+    long connects = 0;
+
+    explicit BenchHttpClient(const sockaddr_in& a) : addr(a) {}
+    ~BenchHttpClient() { drop(); }
+
+    // Sends one request and reads the reply; returns the status or -1
+    int roundTrip(const string& request) {
+        for (int attempt = 0; attempt < 2; ++attempt) { // a kept-alive connection may have been closed
+            if (fd < 0) {
+                fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+                int on = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+                if (connect(fd, (const sockaddr*)&addr, sizeof(addr)) != 0) { drop(); return -1; }
+                connects++;
+            }
+            if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) == (ssize_t)request.size()) {
+                int status = readResponse();
+                if (status >= 0) return status;
+            }
+            drop();
+        }
+        return -1;
+    }
+};
+
+// Requests/s and latency of the web API over `conns` concurrent
+// connections, against the built-in server (loaded from bookings.txt if
+// there is one) or any host:port, e.g. app.py on 127.0.0.1:5000
+int benchHttp(int conns, int requests, const string& target, const string& path) {
+    conns = max(1, conns);
+    HttpServer server;
+    thread serving;
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    if (target.empty()) {
+        initCatalog();
+        if (ifstream("bookings.txt")) loadBookingsFromFile("bookings.txt");
+        string error = server.listen("127.0.0.1", 0);
+        if (!error.empty()) { cout << "listen: " << error << "\n"; return 1; }
+        server.loadStatic(".");
+        serving = thread([&] { server.run(0); });
+        inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+        addr.sin_port = htons((uint16_t)server.port());
+        cout << "built-in server on port " << server.port() << ", " << bookings.size() << " bookings\n";
+    } else {
+        size_t colon = target.rfind(':');
+        string host = colon == string::npos ? target : target.substr(0, colon);
+        if (inet_pton(AF_INET, host == "localhost" ? "127.0.0.1" : host.c_str(), &addr.sin_addr) != 1) {
+            cout << "bad address " << target << " (want ipv4:port)\n";
+            return 1;
+        }
+        addr.sin_port = htons((uint16_t)(colon == string::npos ? 80 : atoi(target.c_str() + colon + 1)));
+    }
+
+    vector<string> paths = path.empty() ? vector<string>{ "/api/flight-info", "/api/bookings" } : vector<string>{ path };
+    long failed = 0;
+    cout << left << setw(20) << "path" << right << setw(9) << "requests" << setw(11) << "req/s" << setw(10) << "p50 ms"
+         << setw(10) << "p90 ms" << setw(10) << "p99 ms" << setw(10) << "max ms" << setw(8) << "failed" << setw(7) << "conns" << "\n";
+    for (const string& p : paths) {
+        const string request = "GET " + p + " HTTP/1.1\r\nHost: " + (target.empty() ? "127.0.0.1" : target) + "\r\n\r\n";
+        vector<vector<double>> ms(conns);
+        vector<long> errors(conns, 0), connects(conns, 0);
+        int perConn = max(1, requests / conns);
+        auto t0 = BenchClock::now();
+        vector<thread> clients;
+        for (int c = 0; c < conns; ++c) {
+            clients.emplace_back([&, c] {
+                BenchHttpClient client(addr);
+                for (int i = 0; i < perConn; ++i) {
+                    auto s = BenchClock::now();
+                    if (client.roundTrip(request) != 200) errors[c]++;
+                    ms[c].push_back(elapsedMs(s));
+                }
+                connects[c] = client.connects;
+            });
+        }
+        for (auto& t : clients) t.join();
+        double wallMs = elapsedMs(t0);
+        vector<double> all;
+        long errs = 0, opened = 0;
+        for (int c = 0; c < conns; ++c) {
+            all.insert(all.end(), ms[c].begin(), ms[c].end());
+            errs += errors[c];
+            opened += connects[c];
+        }
+        sort(all.begin(), all.end());
+        auto pct = [&](double q) { return all[min(all.size() - 1, (size_t)(q / 100 * all.size()))]; };
+        cout << left << setw(20) << p << right << setw(9) << all.size() << fixed << setprecision(0) << setw(11)
+             << all.size() / wallMs * 1000 << setprecision(3) << setw(10) << pct(50) << setw(10) << pct(90)
+             << setw(10) << pct(99) << setw(10) << all.back() << setw(8) << errs << setw(7) << opened << "\n";
+        failed += errs;
+    }
+    if (serving.joinable()) {
+        server.stop();
+        serving.join();
+    }
+    return failed ? 1 : 0;
+}
+
+// Background checkpoint under load: worker threads book, cancel and move
+// seats over n bookings (80% full) while nothing else runs, then while a
+// checkpoint runs for about as long. The store starts cold from the
+// snapshot, so most bookings are still only in the mapped file, which the
+// checkpoint must save without hydrating them. Reports the cut (how long
+// new operations were held off), the capture and write times, and
+// operation latency without and during the checkpoint. The store is then rebuilt
+// from the snapshot plus the journal written after the cut and compared
+// with the live state.
+int benchCheckpoint(int n, int threads) {
+    const string path = "bench_checkpoint.journal";
+    for (const auto& seg : journalSegments(path)) remove(seg.second.c_str());
+    remove(path.c_str());
+    checkpointer.snapshotPath = "bench_checkpoint.snap";
+    checkpointer.textPath = "bench_checkpoint.txt";
+    if (threads <= 0) threads = (int)max(1u, thread::hardware_concurrency());
+    seedBenchBookings(n, 0.8);
+    journal.open(path);
+    cout << fixed << setprecision(2);
+
+    auto t0 = BenchClock::now();
+    checkpointer.run();
+    double idleMs = elapsedMs(t0);
+    cout << n << " bookings on " << catalog.size() << " flights; idle checkpoint " << idleMs << " ms\n";
+    resetBenchState();
+    snapshot.open(checkpointer.snapshotPath);
+
+    atomic<bool> running{false};
+    auto worker = [&](int t, LatencySamples& lat) {
+        uint64_t rng = 0x9E3779B97F4A7C15ULL * (uint64_t)(t + 1);
+        auto next = [&rng]() { rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17; return rng; };
+        const auto& flights = catalog.all();
+        for (int k = 0; running; ++k) {
+            unsigned op = next() % 10;
+            Flight* fl = flights[next() % flights.size()].get();
+            int slot = (int)(next() % fl->seats.size());
+            int id = 1 + (int)(next() % (uint64_t)(bookingCounter.load() - 1));
+            lat.time([&] {
+                if (op < 4) {
+                    confirmBooking(make_unique<Booking>(nextBookingId(), makeBenchPassenger(k), fl, slot, make_unique<Payment>(100.0, CASH)));
+                } else if (op < 8) {
+                    cancelBooking(id);
+                } else {
+                    changeSeat(id, slot); // every flight shares the layout
+                }
+            });
+        }
+    };
+    // runs the workers until during() returns
+    auto underLoad = [&](const function<void()>& during) {
+        vector<LatencySamples> lat(threads);
+        vector<thread> workers;
+        running = true;
+        for (int t = 0; t < threads; ++t) workers.emplace_back(worker, t, ref(lat[t]));
+        during();
+        running = false;
+        for (auto& w : workers) w.join();
+        LatencySamples all;
+        for (auto& l : lat) all.us.insert(all.us.end(), l.us.begin(), l.us.end());
+        return all;
+    };
+
+    LatencySamples quiet = underLoad([&] { this_thread::sleep_for(chrono::duration<double, milli>(idleMs)); });
+    CheckpointStats st;
+    size_t lazyBefore = 0, lazyAfter = 0;
+    LatencySamples busy = underLoad([&] {
+        this_thread::sleep_for(chrono::milliseconds(20));
+        lazyBefore = snapshot.pendingCount();
+        checkpointer.run();
+        lazyAfter = snapshot.pendingCount();
+        st = checkpointer.last;
+    });
+    cout << "checkpoint under " << threads << " threads: cut " << st.cutUs << " us, capture " << st.captureMs
+         << " ms, write " << st.writeMs << " ms; " << st.bookings << " bookings, " << st.copiedOnWrite
+         << " copied on write" << (st.ok ? "" : " (FAILED)") << "\n";
+    cout << "not hydrated: " << lazyBefore << " before, " << lazyAfter << " after\n\n";
+    cout << left << setw(14) << "operations" << right << setw(9) << "calls" << setw(12) << "ops/s"
+         << setw(10) << "p50 us" << setw(10) << "p90 us" << setw(10) << "p99 us" << setw(10) << "p99.9 us"
+         << setw(11) << "max us" << "\n";
+    quiet.report("no checkpoint");
+    busy.report("checkpointing");
+
+    // live state vs snapshot + post-cut journal
+    journal.waitDurable();
+    journal.close();
+    ensureHydrated();
+    map<int, tuple<const Flight*, int, int>> live;
+    bookings.forEach([&](const Booking& b) { live[b.id] = make_tuple(b.flight, b.seat, (int)b.passenger.meal); });
+    vector<vector<uint64_t>> liveSeats;
+    for (const auto& f : catalog.all()) liveSeats.push_back(f->seats.available);
+    ReportStats liveTotals = reportTotals;
+
+    resetBenchState();
+    t0 = BenchClock::now();
+    bool ok = st.ok && snapshot.open(checkpointer.snapshotPath);
+    ensureHydrated();
+    long replayed = 0;
+    for (const auto& seg : journalSegments(path, snapshot.generation())) replayed += Journal::replay(seg.second, applyJournalRecord);
+    replayed += Journal::replay(path, applyJournalRecord);
+    double recoverMs = elapsedMs(t0);
+
+    ok = ok && bookings.size() == live.size() && liveTotals.matches(reportTotals) && verifyReportAggregates();
+    bookings.forEach([&](const Booking& b) {
+        auto it = live.find(b.id);
+        if (it == live.end() || it->second != make_tuple((const Flight*)b.flight, b.seat, (int)b.passenger.meal)) ok = false;
+    });
+    for (size_t f = 0; f < catalog.size(); ++f) ok = ok && catalog.all()[f]->seats.available == liveSeats[f];
+    cout << "\nrecovery: snapshot + " << replayed << " journal records in " << recoverMs << " ms, "
+         << bookings.size() << " bookings  " << (ok ? "OK" : "MISMATCH") << "\n";
+
+    for (const auto& seg : journalSegments(path)) remove(seg.second.c_str());
+    remove(path.c_str());
+    remove(checkpointer.snapshotPath.c_str());
+    remove(checkpointer.textPath.c_str());
+    return ok ? 0 : 1;
+}
+
+// 10K, 1M, 10M or a plain number
+int parseScale(const string& s) {
+    if (s.empty()) return 1000000;
+    double v = atof(s.c_str());
+    char unit = (char)toupper((unsigned char)s.back());
+    if (unit == 'K') v *= 1e3;
+    if (unit == 'M') v *= 1e6;
+    return max(1000, (int)v);
+}
+
+// Every booking-core operation at one scale: generated catalog and
+// bookings (80% full), then latency percentiles per call. The journal is
+// closed, so these are in-memory costs; see `journal` for durability.
+int benchSuite(int n) {
+    auto t0 = BenchClock::now();
+    double seedMs = seedBenchBookings(n, 0.8);
+    int nFlights = (int)catalog.size();
+    int ops = min(n / 10, 100000);
+    cout << fixed << setprecision(2);
+    cout << n << " bookings on " << nFlights << " flights generated in " << seedMs << " ms ("
+         << n / seedMs / 1000 << " M bookings/s)\n\n";
+    cout << left << setw(14) << "operation" << right << setw(9) << "calls" << setw(12) << "ops/s"
+         << setw(10) << "p50 us" << setw(10) << "p90 us" << setw(10) << "p99 us" << setw(10) << "p99.9 us"
+         << setw(11) << "max us" << "\n";
+
+    uint64_t rng = 0x2545F4914F6CDD1DULL;
+    auto next = [&rng]() { rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17; return rng; };
+    auto randomFlight = [&]() { return catalog.all()[next() % nFlights].get(); };
+    const SeatLayout& layout = catalog.front()->seats.layout();
+    vector<string> codes;
+    for (int i = 0; i < layout.size(); ++i) codes.push_back(catalog.front()->seats.code(i));
+
+    LatencySamples find;
+    int found = 0;
+    for (int k = 0; k < min(n, 1000000); ++k) {
+        Flight* fl = randomFlight();
+        const string& code = codes[next() % codes.size()];
+        find.time([&] { found += fl->findSeat(code) >= 0; });
+    }
+    find.report("findSeat");
+
+    // inputs are built up front so only the operation itself is timed
+    vector<BookingRequest> requests(ops);
+    for (int k = 0; k < ops; ++k) {
+        requests[k].flight = randomFlight();
+        requests[k].passenger = makeBenchPassenger(n + k);
+        requests[k].cls = static_cast<SeatClass>(next() % NUM_SEAT_CLASSES);
+        requests[k].method = static_cast<PaymentMethod>(k % 4);
+    }
+    LatencySamples book;
+    int booked = 0;
+    string error;
+    for (const BookingRequest& req : requests) book.time([&] { booked += bookSeat(req, error) != nullptr; });
+    book.report("book");
+
+    vector<int> ids;
+    bookings.forEach([&](const Booking& b) { ids.push_back(b.id); });
+    sort(ids.begin(), ids.end());
+    for (size_t i = ids.size(); i > 1; --i) swap(ids[i - 1], ids[next() % i]);
+
+    LatencySamples change;
+    int changed = 0;
+    for (int k = 0; k < ops; ++k) {
+        Booking* b = bookings.find(ids[k]);
+        int seat = -1;
+        b->flight->seats.forEachAvailable(b->seatClass(), -1, [&](int i) { if (seat < 0) seat = i; });
+        if (seat < 0) continue;
+        change.time([&] { changed += changeSeat(ids[k], seat); });
+    }
+    change.report("changeSeat");
+
+    LatencySamples cancel;
+    int cancelled = 0;
+    for (int k = 0; k < ops; ++k) {
+        int id = ids[ids.size() - 1 - k];
+        cancel.time([&] { cancelled += cancelBooking(id).ok; });
+    }
+    cancel.report("cancel");
+
+    LatencySamples search;
+    size_t hits = 0;
+    for (int k = 0; k < 1000; ++k) {
+        Passenger p = makeBenchPassenger((int)(next() % n));
+        string_view src = (k % 3 == 0) ? p.phone : (k % 3 == 1) ? p.name : p.email;
+        string q(src.substr(src.size() / 3, 5));
+        search.time([&] { hits += findBookings(q).size(); });
+    }
+    search.report("search");
+
+    LatencySamples reports;
+    size_t reportBytes = 0;
+    for (int k = 0; k < 1000; ++k) {
+        Flight* fl = randomFlight();
+        reports.time([&] {
+            ostringstream out;
+            writeReports(out, fl);
+            reportBytes += out.str().size();
+        });
+    }
+    reports.report("reports");
+
+    // save/load are one call each; throughput only
+    const string text = "bench_suite.tmp", snap = "bench_suite_snap.tmp";
+    size_t active = bookings.size();
+    cout << "\n";
+    auto t1 = BenchClock::now();
+    saveBookingsToFile(text);
+    double saveMs = elapsedMs(t1);
+    t1 = BenchClock::now();
+    writeSnapshot(snap);
+    double snapMs = elapsedMs(t1);
+    resetBenchState();
+    t1 = BenchClock::now();
+    loadBookingsFromFile(text);
+    double loadMs = elapsedMs(t1);
+    bool ok = bookings.size() == active;
+    resetBenchState();
+    t1 = BenchClock::now();
+    snapshot.open(snap);
+    ensureHydrated();
+    double snapLoadMs = elapsedMs(t1);
+    ok = ok && bookings.size() == active;
+    remove(text.c_str());
+    remove(snap.c_str());
+
+    cout << "save bookings.txt:   " << saveMs << " ms (" << active / saveMs / 1000 << " M bookings/s)\n";
+    cout << "load bookings.txt:   " << loadMs << " ms (" << active / loadMs / 1000 << " M bookings/s)\n";
+    cout << "write snapshot:      " << snapMs << " ms (" << active / snapMs / 1000 << " M bookings/s)\n";
+    cout << "snapshot + hydrate:  " << snapLoadMs << " ms (" << active / snapLoadMs / 1000 << " M bookings/s)\n";
+    cout << "round trip:          " << (ok ? "OK" : "MISMATCH") << " (" << active << " bookings)\n";
+    cout << "total:               " << elapsedMs(t0) / 1000 << " s\n";
+    cout << "(checksum " << found + booked + changed + cancelled + hits + reportBytes << ")\n";
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+    string name = argc > 1 ? argv[1] : "";
+    // cancellations go to a scratch archive, unlinked once open
+    const string archive = "bench_cancelled.tmp";
+    remove(archive.c_str());
+    if (cancelledArchive.open(archive)) remove(archive.c_str());
+    if (name == "seat-lookup") return benchSeatLookup(argc > 2 ? atoi(argv[2]) : 200000);
+    if (name == "search") return benchSearch(argc > 2 ? atoi(argv[2]) : 200000, argc > 3 ? atoi(argv[3]) : 200);
+    if (name == "reports") return benchReports(argc > 2 ? atoi(argv[2]) : 200000, argc > 3 ? atoi(argv[3]) : 100000);
+    if (name == "journal") return benchJournal(argc > 2 ? atoi(argv[2]) : 200000, argc > 3 ? atoi(argv[3]) : 8);
+    if (name == "snapshot") return benchSnapshot(argc > 2 ? atoi(argv[2]) : 500000);
+    if (name == "load") return benchLoad(argc > 2 ? atoi(argv[2]) : 500000, argc > 3 ? atoi(argv[3]) : 0);
+    if (name == "waitlist") return benchWaitlist(argc > 2 ? atoi(argv[2]) : 500000, argc > 3 ? atoi(argv[3]) : 100000);
+    if (name == "txn") return benchTxn(argc > 2 ? atoi(argv[2]) : 50000, argc > 3 ? atoi(argv[3]) : 4);
+    if (name == "routes") return benchRoutes(argc > 2 ? atoi(argv[2]) : 30000, argc > 3 ? atoi(argv[3]) : 2000);
+    if (name == "layouts") return benchLayouts(argc > 2 ? atoi(argv[2]) : 10000);
+    if (name == "group") return benchGroup(argc > 2 ? atoi(argv[2]) : 60, argc > 3 ? atoi(argv[3]) : 100000);
+    if (name == "fares") return benchFares(argc > 2 ? atoi(argv[2]) : 2000, argc > 3 ? atoi(argv[3]) : 20);
+    if (name == "clock") return benchClock(argc > 2 ? atoi(argv[2]) : 2000000, argc > 3 ? atoi(argv[3]) : 4);
+    if (name == "export") return benchExport(argc > 2 ? atoi(argv[2]) : 1000000);
+    if (name == "memory") return benchMemory(argc > 2 ? atoi(argv[2]) : 1000000);
+    if (name == "archive") return benchArchive(argc > 2 ? atoi(argv[2]) : 1000000);
+    if (name == "suite") return benchSuite(parseScale(argc > 2 ? argv[2] : ""));
+    if (name == "seatmap") return benchSeatMap(argc > 2 ? atoi(argv[2]) : 60, argc > 3 ? atoi(argv[3]) : 20000);
+    if (name == "http") return benchHttp(argc > 2 ? atoi(argv[2]) : 8, argc > 3 ? atoi(argv[3]) : 20000,
+                                         argc > 4 ? argv[4] : "", argc > 5 ? argv[5] : "");
+    if (name == "metrics") return benchMetrics(argc > 2 ? atoi(argv[2]) : 0, argc > 3 ? atoi(argv[3]) : 5000000);
+    if (name == "checkpoint") return benchCheckpoint(argc > 2 ? atoi(argv[2]) : 500000, argc > 3 ? atoi(argv[3]) : 4);
+    if (name == "stress") return benchStress(argc > 2 ? atoi(argv[2]) : 0, argc > 3 ? atoi(argv[3]) : 200000);
+    cout << "Usage: " << argv[0] << " <name> [args]\n"
+         << "  suite [10K|1M|10M]        every core operation: ops/s and latency percentiles\n"
+         << "  seat-lookup [bookings]    load time and seat index vs linear lookup\n"
+         << "  search [bookings] [queries]  trigram index vs full scan\n"
+         << "  reports [bookings] [ops]  incremental report aggregates vs recompute\n"
+         << "  journal [records] [threads]  journal append rate and recovery time\n"
+         << "  snapshot [bookings]       cold start from bookings.txt vs mmapped snapshot\n"
+         << "  load [bookings] [threads] bookings.txt tokenizing and parallel load\n"
+         << "  waitlist [depth] [cancels]  cancellation storm against a deep waitlist\n"
+         << "  txn [requests] [threads]  txn ID generation and duplicate checks, idempotent retries\n"
+         << "  routes [flights] [queries] connection search: best 5 itineraries, checked against a schedule scan\n"
+         << "  layouts [flights]         heap per flight: shared aircraft layout vs a copy per flight\n"
+         << "  group [rows] [parties]    party seating: row bitmasks vs per-seat walk, then group bookings\n"
+         << "  fares [flights] [rounds]  full-schedule repricing: batched flight quotes vs per-seat fares\n"
+         << "  clock [stamps] [threads]  booking timestamps: coarse clock vs formatted strings\n"
+         << "  export [bookings]         CSV / JSON Lines export throughput vs ostream formatting\n"
+         << "  memory [bookings]         allocations and heap bytes per booking\n"
+         << "  archive [bookings]        cancel/rebook churn: heap growth and archive streaming\n"
+         << "  stress [threads] [ops]    concurrent book/cancel/change with consistency checks\n"
+         << "  checkpoint [bookings] [threads]  background checkpoint under load: cut pause, latency, recovery check\n"
+         << "  metrics [threads] [samples]  cost of recording a latency sample, per-thread vs shared\n"
+         << "  seatmap [rows] [polls]    seat-map polling: row cache and version deltas vs full rebuilds\n"
+         << "  http [conns] [requests] [host:port] [path]  web API load test (built-in server if no host)\n";
+    return 1;
+}
@@ -0,0 +1,2074 @@
+// ams_core.cpp
+#include "ams_core.h"
+
+// ----------------- Allocation Counting -----------------
+#ifdef AMS_COUNT_ALLOCS
+atomic<uint64_t> allocCount{0};
+
+// GCC sees the replaced new/delete pair as malloc/free and warns about
+// the mismatch it created itself.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void* operator new(size_t n) {
+    allocCount.fetch_add(1, memory_order_relaxed);
+    if (void* p = malloc(n ? n : 1)) return p;
+    throw bad_alloc();
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+#pragma GCC diagnostic pop
+#endif
+
+size_t heapInUse() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    return mallinfo2().uordblks;
+#else
+    return 0;
+#endif
+}
+
+// ----------------- String Arena -----------------
+ostream& operator<<(ostream& os, const Str& s) { return os << s.view(); }
+
+StringArena& stringArena() {
+    static StringArena* arena = new StringArena;
+    return *arena;
+}
+
+Str Str::store(string_view s) {
+    // the chunk being filled; its reference is dropped when the thread
+    // moves on to the next one or exits
+    struct Cursor {
+        char* chunk = nullptr;
+        char* next = nullptr;
+        size_t left = 0;
+        ~Cursor() { if (chunk) stringArena().release(chunk); }
+    };
+    thread_local Cursor cur;
+    if (s.empty()) return Str();
+    if (s.size() > StringArena::CHUNK / 4) { // too big to share a chunk; the handle takes its reference
+        char* d = stringArena().grab(s.size()) + StringArena::HEAD;
+        memcpy(d, s.data(), s.size());
+        return Str(d, s.size(), true);
+    }
+    if (s.size() > cur.left) {
+        if (cur.chunk) stringArena().release(cur.chunk);
+        cur.chunk = stringArena().grab(StringArena::CHUNK - StringArena::HEAD);
+        cur.next = cur.chunk + StringArena::HEAD;
+        cur.left = StringArena::CHUNK - StringArena::HEAD;
+    }
+    memcpy(cur.next, s.data(), s.size());
+    StringArena::retain(cur.next);
+    Str out(cur.next, s.size(), true);
+    cur.next += s.size();
+    cur.left -= s.size();
+    return out;
+}
+
+Str Str::intern(string_view s) {
+    static mutex mu;
+    static unordered_map<string_view, Str>* table = new unordered_map<string_view, Str>;
+    lock_guard<mutex> lk(mu);
+    auto it = table->find(s);
+    if (it != table->end()) return it->second;
+    char* d = new char[s.size() + 1]; // kept for good, like the table
+    memcpy(d, s.data(), s.size());
+    Str kept(d, s.size(), false);
+    table->emplace(kept.view(), kept);
+    return kept;
+}
+
+// ----------------- Utilities -----------------
+int64_t clockNow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    return (int64_t)ts.tv_sec;
+}
+
+size_t formatTime(int64_t t, char* buf, size_t size) {
+    if (t <= 0 || size < TIME_TEXT) return 0;
+    // Every UTC offset is whole minutes, so one localtime_r per minute
+    // covers all the seconds in it
+    thread_local int64_t minute = INT64_MIN;
+    thread_local char prefix[TIME_TEXT];
+    int64_t m = t / 60, s = t % 60;
+    if (m != minute) {
+        time_t start = (time_t)(m * 60);
+        struct tm tmStart;
+        if (!localtime_r(&start, &tmStart)) return 0; // localtime() shares one buffer between threads
+        if (strftime(prefix, sizeof(prefix), "%Y-%m-%d %H:%M:00", &tmStart) != TIME_TEXT - 1) return 0;
+        minute = m;
+    }
+    memcpy(buf, prefix, TIME_TEXT - 3);
+    buf[TIME_TEXT - 3] = (char)('0' + s / 10);
+    buf[TIME_TEXT - 2] = (char)('0' + s % 10);
+    return TIME_TEXT - 1;
+}
+
+string formatTime(int64_t t) {
+    char buf[TIME_TEXT];
+    return string(buf, formatTime(t, buf, sizeof(buf)));
+}
+
+bool parseTime(string_view s, int64_t& t, bool upper) {
+    // "YYYY-MM-DD HH:MM:SS", or a prefix of it ending after a field
+    static const size_t ENDS[] = { 4, 7, 10, 13, 16, 19 };
+    int v[6] = { 0, 1, 1, 0, 0, 0 };
+    size_t fields = 0;
+    while (fields < 6 && s.size() >= ENDS[fields]) {
+        size_t from = fields ? ENDS[fields - 1] + 1 : 0;
+        if (fields && s[from - 1] != (fields == 3 ? ' ' : fields < 3 ? '-' : ':')) return false;
+        auto r = from_chars(s.data() + from, s.data() + ENDS[fields], v[fields]);
+        if (r.ec != errc() || r.ptr != s.data() + ENDS[fields]) return false;
+        fields++;
+    }
+    if (!fields || s.size() != ENDS[fields - 1]) return false;
+    if (upper) v[fields - 1]++; // the start of the next year, month, ... less a second
+
+    thread_local int cached[5] = { -1 };
+    thread_local int64_t cachedStart = 0;
+    if (!equal(v, v + 5, cached)) {
+        struct tm tmAt = {};
+        tmAt.tm_year = v[0] - 1900;
+        tmAt.tm_mon = v[1] - 1;
+        tmAt.tm_mday = v[2];
+        tmAt.tm_hour = v[3];
+        tmAt.tm_min = v[4];
+        tmAt.tm_isdst = -1;
+        time_t start = mktime(&tmAt);
+        if (start == (time_t)-1) return false;
+        copy(v, v + 5, cached);
+        cachedStart = (int64_t)start;
+    }
+    t = cachedStart + v[5] - (upper ? 1 : 0);
+    return true;
+}
+
+string getCurrentDateTime() {
+    return formatTime(clockNow());
+}
+
+namespace {
+const uint64_t TXN_BLOCK = 4096;
+atomic<uint64_t> txnCounter{0};
+
+// Hex digits of the process part: start second | node | pid
+const char* txnPrefix() {
+    static const string prefix = [] {
+        const char* env = getenv("AMS_NODE_ID");
+        uint64_t node = env ? (uint64_t)atoi(env) & 0xFF : 0;
+        uint64_t secs = (uint64_t)chrono::duration_cast<chrono::seconds>(chrono::system_clock::now().time_since_epoch()).count();
+        uint64_t v = (secs & 0xFFFFFFFFu) << 32 | node << 24 | ((uint64_t)getpid() & 0xFFFFFF);
+        char buf[16];
+        for (int i = 0; i < 16; ++i) buf[i] = "0123456789ABCDEF"[(v >> (60 - 4 * i)) & 15];
+        return string(buf, 16);
+    }();
+    return prefix.data();
+}
+}
+
+Str newTxnId() {
+    thread_local uint64_t next = 0, end = 0;
+    if (next == end) {
+        next = txnCounter.fetch_add(TXN_BLOCK, memory_order_relaxed);
+        end = next + TXN_BLOCK;
+    }
+    uint64_t seq = next++;
+    static const char HEX[] = "0123456789ABCDEF";
+    char buf[29] = { 'T', 'X', 'N' };
+    memcpy(buf + 3, txnPrefix(), 16);
+    for (int i = 0; i < 10; ++i) buf[19 + i] = HEX[(seq >> (36 - 4 * i)) & 15];
+    return Str::store(string_view(buf, sizeof(buf)));
+}
+
+bool isValidEmail(string_view email) {
+    auto at = email.find('@');
+    auto dot = email.find('.', at == string::npos ? 0 : at);
+    return (at != string::npos && dot != string::npos && at < dot);
+}
+
+bool isValidPhone(string_view phone) {
+    int digits = 0;
+    for (char c : phone) {
+        if (isdigit(c)) digits++;
+        else if (c == '+' || c == '-' || c == ' ') continue;
+        else return false;
+    }
+    return digits >= 10;
+}
+
+string jsonString(string_view v) {
+    string out = "\"";
+    for (char c : v) {
+        if (c == '"' || c == '\\') { out += '\\'; out += c; }
+        else if ((unsigned char)c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        }
+        else out += c;
+    }
+    return out + "\"";
+}
+
+string jsonMoney(double v) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.2f", v);
+    return buf;
+}
+
+string jsonNumber(double v) {
+    char buf[32];
+    auto r = to_chars(buf, buf + sizeof(buf), v);
+    return string(buf, r.ptr);
+}
+
+// ----------------- Metrics -----------------
+namespace {
+struct MetricBlock {
+    atomic<uint64_t> counts[NUM_METRIC_OPS][LatencyHistogram::BUCKETS];
+    atomic<uint64_t> failures[NUM_METRIC_OPS];
+    atomic<uint64_t> sumNs[NUM_METRIC_OPS];
+    atomic<uint64_t> maxNs[NUM_METRIC_OPS];
+    atomic<bool> inUse{true};
+
+    MetricBlock() {
+        for (auto& op : counts) for (auto& c : op) c.store(0, memory_order_relaxed);
+        for (int i = 0; i < NUM_METRIC_OPS; ++i) {
+            failures[i].store(0, memory_order_relaxed);
+            sumNs[i].store(0, memory_order_relaxed);
+            maxNs[i].store(0, memory_order_relaxed);
+        }
+    }
+};
+
+// Every block ever handed out; a thread's block is passed on to a later
+// thread once it exits, so its counts are kept. Leaked on purpose:
+// threads may still record while globals are destroyed.
+struct MetricRegistry {
+    mutex mu;
+    vector<unique_ptr<MetricBlock>> blocks;
+    chrono::steady_clock::time_point started = chrono::steady_clock::now();
+};
+
+MetricRegistry& metricRegistry() {
+    static MetricRegistry* registry = new MetricRegistry;
+    return *registry;
+}
+
+MetricBlock& localMetricBlock() {
+    struct Slot {
+        MetricBlock* block = nullptr;
+        ~Slot() { if (block) block->inUse.store(false); }
+    };
+    thread_local Slot slot;
+    if (!slot.block) {
+        MetricRegistry& r = metricRegistry();
+        lock_guard<mutex> lk(r.mu);
+        for (auto& b : r.blocks) {
+            bool idle = false;
+            if (b->inUse.compare_exchange_strong(idle, true)) { slot.block = b.get(); break; }
+        }
+        if (!slot.block) {
+            r.blocks.push_back(make_unique<MetricBlock>());
+            slot.block = r.blocks.back().get();
+        }
+    }
+    return *slot.block;
+}
+
+// Only the owning thread writes a block, so a plain load + store is enough
+void bump(atomic<uint64_t>& a, uint64_t by) {
+    a.store(a.load(memory_order_relaxed) + by, memory_order_relaxed);
+}
+}
+
+const char* metricOpName(MetricOp op) {
+    switch (op) {
+        case M_BOOK: return "book";
+        case M_CANCEL: return "cancel";
+        case M_SEAT_CHANGE: return "seat_change";
+        case M_WAITLIST_ADD: return "waitlist_add";
+        case M_SEARCH: return "search";
+        case M_GROUP_BOOK: return "group_book";
+        case M_CHECKPOINT_CUT: return "checkpoint_cut";
+        default: return "save";
+    }
+}
+
+uint64_t OpStats::percentileNs(double p) const {
+    if (count == 0) return 0;
+    uint64_t rank = (uint64_t)ceil(p / 100.0 * count);
+    rank = max<uint64_t>(rank, 1);
+    uint64_t seen = 0;
+    for (int i = 0; i < LatencyHistogram::BUCKETS; ++i) {
+        seen += buckets[i];
+        if (seen >= rank) return min(LatencyHistogram::highestOf(i), maxNs);
+    }
+    return maxNs;
+}
+
+void recordMetric(MetricOp op, uint64_t ns, bool ok) {
+    MetricBlock& b = localMetricBlock();
+    bump(b.counts[op][LatencyHistogram::bucketOf(ns)], 1);
+    bump(b.sumNs[op], ns);
+    if (!ok) bump(b.failures[op], 1);
+    if (ns > b.maxNs[op].load(memory_order_relaxed)) b.maxNs[op].store(ns, memory_order_relaxed);
+}
+
+MetricsSnapshot readMetrics() {
+    MetricsSnapshot m;
+    MetricRegistry& r = metricRegistry();
+    lock_guard<mutex> lk(r.mu);
+    m.uptimeSec = chrono::duration<double>(chrono::steady_clock::now() - r.started).count();
+    for (const auto& b : r.blocks) {
+        for (int op = 0; op < NUM_METRIC_OPS; ++op) {
+            OpStats& s = m.ops[op];
+            for (int i = 0; i < LatencyHistogram::BUCKETS; ++i) {
+                uint64_t c = b->counts[op][i].load(memory_order_relaxed);
+                s.buckets[i] += c;
+                s.count += c;
+            }
+            s.failures += b->failures[op].load(memory_order_relaxed);
+            s.sumNs += b->sumNs[op].load(memory_order_relaxed);
+            s.maxNs = max(s.maxNs, b->maxNs[op].load(memory_order_relaxed));
+        }
+    }
+    return m;
+}
+
+void writeMetricsTable(ostream& os, const MetricsSnapshot& m) {
+    os << left << setw(14) << "operation" << right << setw(10) << "count" << setw(8) << "failed"
+       << setw(10) << "mean us" << setw(10) << "p50 us" << setw(10) << "p90 us" << setw(10) << "p99 us"
+       << setw(11) << "p99.9 us" << setw(11) << "max us" << "\n";
+    ios::fmtflags flags = os.flags();
+    streamsize precision = os.precision();
+    os << fixed << setprecision(1);
+    for (int op = 0; op < NUM_METRIC_OPS; ++op) {
+        const OpStats& s = m.ops[op];
+        os << left << setw(14) << metricOpName((MetricOp)op) << right << setw(10) << s.count << setw(8) << s.failures
+           << setw(10) << s.meanNs() / 1000 << setw(10) << s.percentileNs(50) / 1000.0
+           << setw(10) << s.percentileNs(90) / 1000.0 << setw(10) << s.percentileNs(99) / 1000.0
+           << setw(11) << s.percentileNs(99.9) / 1000.0 << setw(11) << s.maxNs / 1000.0 << "\n";
+    }
+    os << "uptime " << m.uptimeSec << " s\n";
+    os.flags(flags);
+    os.precision(precision);
+}
+
+void writeMetricsText(ostream& os, const MetricsSnapshot& m) {
+    static const double QUANTILES[] = { 0.5, 0.9, 0.99, 0.999 };
+    os << setprecision(9) << defaultfloat;
+    os << "# HELP ams_op_latency_seconds Latency of booking-core operations.\n";
+    os << "# TYPE ams_op_latency_seconds summary\n";
+    for (int op = 0; op < NUM_METRIC_OPS; ++op) {
+        const OpStats& s = m.ops[op];
+        const char* name = metricOpName((MetricOp)op);
+        for (double q : QUANTILES) {
+            os << "ams_op_latency_seconds{op=\"" << name << "\",quantile=\"" << q << "\"} " << s.percentileNs(q * 100) / 1e9 << "\n";
+        }
+        os << "ams_op_latency_seconds_sum{op=\"" << name << "\"} " << s.sumNs / 1e9 << "\n";
+        os << "ams_op_latency_seconds_count{op=\"" << name << "\"} " << s.count << "\n";
+    }
+    os << "# HELP ams_op_failures_total Calls that did not succeed (no seat, unknown booking, ...).\n";
+    os << "# TYPE ams_op_failures_total counter\n";
+    for (int op = 0; op < NUM_METRIC_OPS; ++op) {
+        os << "ams_op_failures_total{op=\"" << metricOpName((MetricOp)op) << "\"} " << m.ops[op].failures << "\n";
+    }
+    os << "# TYPE ams_uptime_seconds gauge\n";
+    os << "ams_uptime_seconds " << m.uptimeSec << "\n";
+}
+
+void writeMetricsJson(ostream& os, const MetricsSnapshot& m) {
+    os << setprecision(9) << defaultfloat;
+    os << "{\"uptime_s\":" << m.uptimeSec << ",\"ops\":{";
+    for (int op = 0; op < NUM_METRIC_OPS; ++op) {
+        const OpStats& s = m.ops[op];
+        if (op) os << ",";
+        os << "\"" << metricOpName((MetricOp)op) << "\":{\"count\":" << s.count << ",\"failed\":" << s.failures
+           << ",\"sum_ns\":" << s.sumNs << ",\"max_ns\":" << s.maxNs
+           << ",\"p50_ns\":" << s.percentileNs(50) << ",\"p90_ns\":" << s.percentileNs(90)
+           << ",\"p99_ns\":" << s.percentileNs(99) << ",\"p999_ns\":" << s.percentileNs(99.9) << ",\"buckets\":[";
+        bool first = true;
+        for (int i = 0; i < LatencyHistogram::BUCKETS; ++i) {
+            if (!s.buckets[i]) continue;
+            os << (first ? "" : ",") << "[" << LatencyHistogram::lowestOf(i) << "," << s.buckets[i] << "]";
+            first = false;
+        }
+        os << "]}";
+    }
+    os << "}}\n";
+}
+
+bool exportMetrics(const string& path) {
+    MetricsSnapshot m = readMetrics();
+    const string tmp = path + ".tmp";
+    ofstream f(tmp);
+    if (!f) return false;
+    bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+    if (json) writeMetricsJson(f, m);
+    else writeMetricsText(f, m);
+    f.close();
+    return f && rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+// ----------------- Seats -----------------
+const char* seatClassString(SeatClass c) {
+    switch (c) {
+        case ECONOMY: return "Economy";
+        case BUSINESS: return "Business";
+        default: return "First Class";
+    }
+}
+
+const char* seatPrefString(SeatPref p) {
+    switch (p) {
+        case WINDOW: return "Window";
+        case AISLE: return "Aisle";
+        default: return "Middle";
+    }
+}
+
+shared_ptr<const SeatLayout> defaultSeatLayout() {
+    static shared_ptr<const SeatLayout> layout = [] {
+        auto l = make_shared<SeatLayout>("default");
+        // Economy rows 1-5: A-D
+        for (int r=1; r<=5; ++r) {
+            l->add(r, 'A', ECONOMY, WINDOW, 100.0);
+            l->add(r, 'B', ECONOMY, MIDDLE, 100.0);
+            l->add(r, 'C', ECONOMY, AISLE, 100.0);
+            l->add(r, 'D', ECONOMY, WINDOW, 100.0);
+        }
+        // Business 6-8: A-C
+        for (int r=6; r<=8; ++r) {
+            l->add(r, 'A', BUSINESS, WINDOW, 150.0);
+            l->add(r, 'B', BUSINESS, AISLE, 150.0);
+            l->add(r, 'C', BUSINESS, WINDOW, 150.0);
+        }
+        // First 9-10: A-B
+        for (int r=9; r<=10; ++r) {
+            l->add(r, 'A', FIRST_CLASS, WINDOW, 200.0);
+            l->add(r, 'B', FIRST_CLASS, AISLE, 200.0);
+        }
+        return shared_ptr<const SeatLayout>(move(l));
+    }();
+    return layout;
+}
+
+LayoutLibrary layouts;
+
+namespace {
+// "cabin|class|firstRow-lastRow|letters|prefs|baseFare" into l; false if malformed
+bool addCabin(SeatLayout& l, const vector<string>& parts) {
+    int c, first, last;
+    double base;
+    size_t dash = parts[2].find('-');
+    const string& letters = parts[3];
+    const string& prefs = parts[4];
+    if (!parseNumber(parts[1], c) || c < 0 || c >= NUM_SEAT_CLASSES || dash == string::npos ||
+        !parseNumber(string_view(parts[2]).substr(0, dash), first) || !parseNumber(string_view(parts[2]).substr(dash + 1), last) ||
+        first < 1 || last < first || last > 999 || letters.empty() || prefs.size() != letters.size() ||
+        !parseNumber(parts[5], base) || base < 0) return false;
+    for (size_t k = 0; k < letters.size(); ++k) {
+        if (letters[k] < 'A' || letters[k] > 'Z' || (k && letters[k] <= letters[k - 1])) return false;
+        if (prefs[k] != 'W' && prefs[k] != 'A' && prefs[k] != 'M') return false;
+    }
+    for (int r = first; r <= last; ++r) {
+        for (size_t k = 0; k < letters.size(); ++k) {
+            if (l.find(r, letters[k]) >= 0) return false;
+            SeatPref p = prefs[k] == 'W' ? WINDOW : prefs[k] == 'A' ? AISLE : MIDDLE;
+            l.add(r, letters[k], static_cast<SeatClass>(c), p, base);
+        }
+    }
+    return true;
+}
+}
+
+int LayoutLibrary::load(const string& path) {
+    ifstream f(path);
+    if (!f) return 0;
+    int read = 0, lineNo = 0;
+    shared_ptr<SeatLayout> cur;
+    bool bad = false;
+    auto finish = [&] {
+        if (cur && !bad && cur->size() > 0) {
+            byName[cur->name] = move(cur);
+            read++;
+        } else if (cur) {
+            cout << "Layout " << cur->name << " incomplete, skipped\n";
+        }
+        cur.reset();
+        bad = false;
+    };
+    string line;
+    while (getline(f, line)) {
+        lineNo++;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty() || line[0] == '#') continue;
+        vector<string> parts;
+        string token;
+        stringstream ss(line);
+        while (getline(ss, token, '|')) parts.push_back(token);
+        if (parts.size() == 2 && parts[0] == "layout" && !parts[1].empty()) {
+            finish();
+            cur = make_shared<SeatLayout>(parts[1]);
+        } else if (parts.size() == 6 && parts[0] == "cabin" && cur && !bad && addCabin(*cur, parts)) {
+            continue;
+        } else {
+            cout << "Layout line " << lineNo << " malformed, skipped\n";
+            bad = bad || cur;
+        }
+    }
+    finish();
+    return read;
+}
+
+shared_ptr<const SeatLayout> LayoutLibrary::find(const string& name) const {
+    auto it = byName.find(name);
+    if (it != byName.end()) return it->second;
+    return name == "default" ? defaultSeatLayout() : nullptr;
+}
+
+// ----------------- Fares -----------------
+FareEngine fareEngine;
+
+namespace {
+// Blocks of four with no aliasing: GCC vectorizes the inner loop into
+// packed multiplies at -O2, where its cheap cost model leaves a plain
+// loop of unknown length scalar.
+void scaleFares(const double* __restrict in, double m, double* __restrict out, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        for (size_t k = 0; k < 4; ++k) out[i + k] = in[i + k] * m;
+    }
+    for (; i < n; ++i) out[i] = in[i] * m;
+}
+}
+
+int FareEngine::loadRules(const string& path) {
+    ifstream f(path);
+    if (!f) return 0;
+    FareRules r;
+    int read = 0, lineNo = 0;
+    string line;
+    while (getline(f, line)) {
+        lineNo++;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty() || line[0] == '#') continue;
+        vector<string> parts;
+        string token;
+        stringstream ss(line);
+        while (getline(ss, token, '|')) parts.push_back(token);
+        bool ok = parts.size() == 3;
+        if (ok && parts[0] == "luggage") {
+            ok = parseNumber(parts[1], r.luggage.freeKg) && parseNumber(parts[2], r.luggage.perKg) &&
+                 r.luggage.freeKg >= 0 && r.luggage.perKg >= 0;
+        } else if (ok && parts[0] == "load") {
+            LoadBand band;
+            ok = parseNumber(parts[1], band.load) && parseNumber(parts[2], band.multiplier) &&
+                 band.load >= 0 && band.load <= 1 && band.multiplier > 0;
+            if (ok) r.bands.push_back(band);
+        } else {
+            ok = false;
+        }
+        if (ok) read++;
+        else cout << "Fare rule line " << lineNo << " malformed, skipped\n";
+    }
+    setRules(move(r));
+    return read;
+}
+
+void FareEngine::setRules(FareRules r) {
+    stable_sort(r.bands.begin(), r.bands.end(), [](const LoadBand& a, const LoadBand& b) { return a.load < b.load; });
+    rules = move(r);
+}
+
+double FareEngine::multiplierAt(double load) const {
+    double m = 1.0;
+    for (const LoadBand& b : rules.bands) {
+        if (load < b.load) break;
+        m = b.multiplier;
+    }
+    return m;
+}
+
+void FareEngine::quote(const SeatStore& seats, FareQuote& q) const {
+    const SeatLayout& layout = seats.layout();
+    size_t n = (size_t)layout.size();
+    // one read of the seat bits, so the load and the free seats agree
+    thread_local vector<uint64_t> free;
+    free.resize((size_t)layout.wordCount());
+    int nFree = 0;
+    for (size_t w = 0; w < free.size(); ++w) {
+        free[w] = seats.word(w);
+        nFree += __builtin_popcountll(free[w]);
+    }
+    q.load = n ? (double)(n - nFree) / n : 0.0;
+    q.multiplier = multiplierAt(q.load);
+    q.fare.resize(n);
+    scaleFares(layout.price.data(), q.multiplier, q.fare.data(), n);
+    for (int c = 0; c < NUM_SEAT_CLASSES; ++c) {
+        const vector<uint64_t>& cm = layout.classMask[c];
+        int count = 0;
+        double lowest = 0.0;
+        for (size_t w = 0; w < free.size(); ++w) {
+            uint64_t bits = free[w] & cm[w];
+            count += __builtin_popcountll(bits);
+            while (bits) {
+                double f = q.fare[w * 64 + __builtin_ctzll(bits)];
+                if (lowest == 0.0 || f < lowest) lowest = f;
+                bits &= bits - 1;
+            }
+        }
+        q.available[c] = count;
+        q.lowest[c] = lowest;
+    }
+}
+
+uint64_t seatMapEpoch() {
+    static const uint64_t epoch = (uint64_t)chrono::duration_cast<chrono::microseconds>(
+        chrono::system_clock::now().time_since_epoch()).count();
+    return epoch;
+}
+
+uint64_t SeatStore::changesSince(uint64_t since, vector<int>& slots, bool& full) const {
+    lock_guard<mutex> lk(mapMu);
+    uint64_t now = seatMapEpoch() + changes;
+    full = since < seatMapEpoch() || since > now;
+    if (since == now) return now;
+    uint32_t after = full ? 0 : (uint32_t)(since - seatMapEpoch());
+    for (int i = 0; i < (int)seatChangedAt.size(); ++i) {
+        if (full || seatChangedAt[i] > after) slots.push_back(i);
+    }
+    return now;
+}
+
+void SeatStore::render(string& out) const {
+    const SeatLayout& l = *shape;
+    out += "  ";
+    for (char ch = 'A'; ch <= l.lastLetter; ++ch) {
+        out += ch == 'A' ? " " : "    ";
+        out += ch;
+    }
+    out += "\n";
+    lock_guard<mutex> lk(mapMu);
+    if (rowText.empty()) {
+        rowText.resize(l.rowNumbers.size());
+        rowRenderedAt.assign(l.rowNumbers.size(), 0);
+    }
+    for (size_t p = 0; p < l.rowNumbers.size(); ++p) {
+        string& text = rowText[p];
+        if (text.empty() || rowRenderedAt[p] < rowChangedAt[p]) {
+            int r = l.rowNumbers[p];
+            char num[8];
+            snprintf(num, sizeof(num), "%2d ", r);
+            text = num;
+            for (char ch = 'A'; ch <= l.lastLetter; ++ch) {
+                int i = l.find(r, ch);
+                if (i < 0) { text += "     "; continue; }
+                text += '[';
+                text += isBooked(i) ? 'X' : ch;
+                text += "] ";
+            }
+            text += "\n";
+            rowRenderedAt[p] = rowChangedAt[p];
+        }
+        out += text;
+    }
+}
+
+namespace {
+// `len` (< 64) bits of a bitset read through word(w), starting at bit `from`
+template <class Word>
+uint32_t bitsAt(Word word, int from, int len) {
+    uint64_t v = word((size_t)from >> 6) >> (from & 63);
+    if ((from & 63) + len > 64) v |= word(((size_t)from >> 6) + 1) << (64 - (from & 63));
+    return (uint32_t)(v & ((uint64_t(1) << len) - 1));
+}
+}
+
+bool SeatStore::tryClaimAll(vector<int> slots) {
+    sort(slots.begin(), slots.end());
+    size_t done = 0; // slots[0, done) are taken
+    bool ok = true;
+    while (ok && done < slots.size()) {
+        size_t w = (size_t)slots[done] >> 6, end = done;
+        uint64_t mask = 0;
+        for (; end < slots.size() && ((size_t)slots[end] >> 6) == w; ++end) mask |= uint64_t(1) << (slots[end] & 63);
+        uint64_t cur = word(w);
+        do {
+            if ((cur & mask) != mask) { ok = false; break; }
+        } while (!__atomic_compare_exchange_n(&available[w], &cur, cur & ~mask, true, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+        if (ok) done = end;
+    }
+    if (!ok) {
+        for (size_t k = 0; k < done; ++k) __atomic_fetch_or(&available[slots[k] >> 6], uint64_t(1) << (slots[k] & 63), __ATOMIC_ACQ_REL);
+    }
+    // given-back seats too: a poller may have seen them taken
+    for (size_t k = 0; k < done; ++k) noteChange(slots[k]);
+    return ok;
+}
+
+bool SeatStore::findGroup(SeatClass c, int p, int n, vector<int>& slots, bool& together) const {
+    slots.clear();
+    together = false;
+    if (n <= 0 || countAvailable(c) < n) return false;
+    const SeatLayout& l = *shape;
+    if (!l.rowSpans) {
+        // rows are not contiguous slots: first free seats, not placed together
+        forEachAvailable(c, -1, [&](int i) { if ((int)slots.size() < n) slots.push_back(i); });
+        together = false;
+        return (int)slots.size() == n;
+    }
+    auto freeWord = [&](size_t w) { return word(w) & l.classMask[c][w]; };
+    auto prefWord = [&](size_t w) { return l.prefMask[p < 0 ? 0 : p][w]; };
+    int rows = (int)l.rowFirst.size();
+    // bit k of a row mask is the row's k-th seat from the left
+    thread_local vector<uint32_t> rowFree;
+    rowFree.resize(rows);
+    int bestRow = -1, bestAt = 0, anyRow = -1, anyAt = 0;
+    for (int r = 0; r < rows && bestRow < 0; ++r) {
+        uint32_t m = rowFree[r] = bitsAt(freeWord, l.rowFirst[r], l.rowCount[r]);
+        if (n > l.rowCount[r]) continue;
+        uint32_t runs = m; // bit s set: seats s .. s+n-1 are all free
+        for (int k = 1; k < n && runs; ++k) runs &= m >> k;
+        if (runs && n > 1) {
+            // and no aisle between them
+            uint32_t breaks = l.aisleBreaks(r);
+            for (int k = 0; k + 1 < n && runs; ++k) runs &= ~(breaks >> k);
+        }
+        if (!runs) continue;
+        if (anyRow < 0) { anyRow = r; anyAt = __builtin_ctz(runs); }
+        if (p < 0) { bestRow = r; bestAt = anyAt; break; }
+        uint32_t wanted = bitsAt(prefWord, l.rowFirst[r], l.rowCount[r]) & m;
+        uint32_t block = (uint32_t(1) << n) - 1;
+        for (; runs; runs &= runs - 1) {
+            int at = __builtin_ctz(runs);
+            if ((wanted >> at) & block) { bestRow = r; bestAt = at; break; }
+        }
+    }
+    if (bestRow < 0) { bestRow = anyRow; bestAt = anyAt; }
+    if (bestRow >= 0) {
+        for (int k = 0; k < n; ++k) slots.push_back(l.rowFirst[bestRow] + bestAt + k);
+        together = true;
+        return true;
+    }
+
+    // no row has room: fill outwards from the row with the most free seats
+    int anchor = 0;
+    for (int r = 0; r < rows; ++r) {
+        if (__builtin_popcount(rowFree[r]) > __builtin_popcount(rowFree[anchor])) anchor = r;
+    }
+    for (int d = 0; (int)slots.size() < n && (anchor - d >= 0 || anchor + d < rows); ++d) {
+        for (int side = 0; side < (d ? 2 : 1); ++side) {
+            int r = side ? anchor - d : anchor + d;
+            if (r < 0 || r >= rows) continue;
+            for (uint32_t m = rowFree[r]; m && (int)slots.size() < n; m &= m - 1) slots.push_back(l.rowFirst[r] + __builtin_ctz(m));
+        }
+    }
+    // seats taken since countAvailable() can leave the party short
+    return (int)slots.size() == n;
+}
+
+// ----------------- Journal -----------------
+uint32_t crc32(const char* data, size_t n) {
+    // built by the first caller; the other threads wait for it (static
+    // initialization is thread-safe)
+    struct Table { uint32_t v[256]; };
+    static const Table table = [] {
+        Table t;
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t.v[i] = c;
+        }
+        return t;
+    }();
+    uint32_t c = 0xFFFFFFFFu;
+    for (size_t i = 0; i < n; ++i) c = table.v[(c ^ (unsigned char)data[i]) & 0xFF] ^ (c >> 8);
+    return c ^ 0xFFFFFFFFu;
+}
+
+// ----------------- Cancelled Archive -----------------
+string encodeArchiveBlock(const vector<const Booking*>& rows) {
+    string out;
+    auto column = [&](auto get) {
+        for (const Booking* b : rows) {
+            auto v = get(*b);
+            out.append((const char*)&v, sizeof(v));
+        }
+    };
+    column([](const Booking& b) { return (int32_t)b.id; });
+    column([](const Booking& b) { return (int32_t)b.passenger.luggageKg; });
+    column([](const Booking& b) { return b.fare(); });
+    column([](const Booking& b) { return b.totalAmount(); });
+    column([](const Booking& b) { return (uint8_t)b.passenger.meal; });
+    column([](const Booking& b) { return (uint8_t)(b.passenger.wheelchair ? 1 : 0); });
+    column([](const Booking& b) { return (uint8_t)(b.payment ? b.payment->method : CASH); });
+    column([](const Booking& b) { return (uint8_t)(b.hasSeat() ? b.seatClass() : ECONOMY); });
+    auto text = [&](auto get) {
+        string bytes;
+        for (const Booking* b : rows) {
+            bytes += get(*b);
+            uint32_t end = (uint32_t)bytes.size();
+            out.append((const char*)&end, 4);
+        }
+        out += bytes;
+    };
+    text([](const Booking& b) { return b.flight ? b.flight->flightNo : string(); });
+    text([](const Booking& b) { return b.hasSeat() ? b.seatNo() : string(); });
+    text([](const Booking& b) { return b.passenger.name.view(); });
+    text([](const Booking& b) { return b.passenger.phone.view(); });
+    text([](const Booking& b) { return b.passenger.email.view(); });
+    text([](const Booking& b) { return b.passenger.gender.view(); });
+    text([](const Booking& b) { return formatTime(b.bookedAt); });
+    text([](const Booking& b) { return b.payment ? b.payment->txnId.view() : string_view(); });
+    return out;
+}
+
+bool decodeArchiveBlock(const char* p, size_t len, uint32_t rows, const function<void(const ArchivedBooking&)>& fn) {
+    const size_t TEXT_COLS = 8;
+    const char* end = p + len;
+    if (len < (size_t)rows * (4 + 4 + 8 + 8 + 4)) return false;
+    const char* ids = p;
+    const char* luggage = ids + 4 * (size_t)rows;
+    const char* fares = luggage + 4 * (size_t)rows;
+    const char* totals = fares + 8 * (size_t)rows;
+    const unsigned char* bytes = (const unsigned char*)(totals + 8 * (size_t)rows);
+    const char* q = (const char*)bytes + 4 * (size_t)rows;
+    const char* ends[TEXT_COLS];
+    const char* texts[TEXT_COLS];
+    uint32_t sizes[TEXT_COLS];
+    for (size_t c = 0; c < TEXT_COLS; ++c) {
+        if ((size_t)(end - q) < 4 * (size_t)rows) return false;
+        ends[c] = q;
+        q += 4 * (size_t)rows;
+        sizes[c] = 0;
+        if (rows) memcpy(&sizes[c], ends[c] + 4 * (size_t)(rows - 1), 4);
+        if ((size_t)(end - q) < sizes[c]) return false;
+        texts[c] = q;
+        q += sizes[c];
+    }
+    string_view ArchivedBooking::* fields[TEXT_COLS] = {
+        &ArchivedBooking::flightNo, &ArchivedBooking::seatNo, &ArchivedBooking::name, &ArchivedBooking::phone,
+        &ArchivedBooking::email, &ArchivedBooking::gender, &ArchivedBooking::bookingTime, &ArchivedBooking::txnId };
+    for (uint32_t r = 0; r < rows; ++r) {
+        ArchivedBooking a;
+        int32_t v;
+        memcpy(&v, ids + 4 * (size_t)r, 4); a.id = v;
+        memcpy(&v, luggage + 4 * (size_t)r, 4); a.luggageKg = v;
+        memcpy(&a.fare, fares + 8 * (size_t)r, 8);
+        memcpy(&a.total, totals + 8 * (size_t)r, 8);
+        a.meal = bytes[r];
+        a.wheelchair = bytes[rows + r];
+        a.payMethod = bytes[2 * (size_t)rows + r];
+        a.seatClass = bytes[3 * (size_t)rows + r];
+        for (size_t c = 0; c < TEXT_COLS; ++c) {
+            uint32_t from = 0, to;
+            if (r) memcpy(&from, ends[c] + 4 * (size_t)(r - 1), 4);
+            memcpy(&to, ends[c] + 4 * (size_t)r, 4);
+            if (from > to || to > sizes[c]) return false;
+            a.*fields[c] = string_view(texts[c] + from, to - from);
+        }
+        fn(a);
+    }
+    return true;
+}
+
+// ----------------- Itineraries -----------------
+RoutePlanner routePlanner;
+
+namespace {
+// Days from 1970-01-01 to y-m-d, proleptic Gregorian
+int daysFromCivil(int y, int m, int d) {
+    y -= m <= 2;
+    int era = (y >= 0 ? y : y - 399) / 400;
+    int yoe = y - era * 400;
+    int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+// Minutes since 1970-01-01 -> "YYYY-MM-DD HH:MM"
+string formatScheduleTime(int minutes) {
+    int z = minutes / 1440 + 719468;
+    int era = (z >= 0 ? z : z - 146096) / 146097;
+    int doe = z - era * 146097;
+    int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int mp = (5 * doy + 2) / 153;
+    int d = doy - (153 * mp + 2) / 5 + 1, m = mp + (mp < 10 ? 3 : -9), y = yoe + era * 400 + (m <= 2);
+    char buf[48];
+    snprintf(buf, sizeof(buf), "%04d-%02d-%02d %02d:%02d", y, m, d, minutes % 1440 / 60, minutes % 60);
+    return buf;
+}
+
+// "YYYY-MM-DD" -> days since 1970-01-01
+bool parseScheduleDate(string_view s, int& days) {
+    int y, m, d;
+    if (s.size() != 10 || s[4] != '-' || s[7] != '-' || !parseNumber(s.substr(0, 4), y) ||
+        !parseNumber(s.substr(5, 2), m) || !parseNumber(s.substr(8, 2), d) || m < 1 || m > 12 || d < 1 || d > 31) return false;
+    days = daysFromCivil(y, m, d);
+    return true;
+}
+
+// "10:00 AM", "1:30 PM" or "14:30" -> minutes after midnight
+bool parseClockTime(string_view s, int& minutes) {
+    size_t colon = s.find(':');
+    int h, m;
+    if (colon == string_view::npos || colon + 3 > s.size() || !parseNumber(s.substr(0, colon), h) ||
+        !parseNumber(s.substr(colon + 1, 2), m) || m > 59) return false;
+    string_view rest = s.substr(colon + 3);
+    while (!rest.empty() && rest[0] == ' ') rest.remove_prefix(1);
+    if (rest.empty()) {
+        if (h > 23) return false;
+    } else if (rest == "AM" || rest == "PM") {
+        if (h < 1 || h > 12) return false;
+        h = h % 12 + (rest == "PM" ? 12 : 0);
+    } else {
+        return false;
+    }
+    minutes = h * 60 + m;
+    return true;
+}
+}
+
+int RoutePlanner::loadConnectTimes(const string& path) {
+    ifstream f(path);
+    if (!f) return 0;
+    int read = 0, lineNo = 0;
+    string line;
+    while (getline(f, line)) {
+        lineNo++;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty() || line[0] == '#') continue;
+        size_t bar = line.find('|');
+        int minutes;
+        if (bar == string::npos || bar == 0 || !parseNumber(string_view(line).substr(bar + 1), minutes) || minutes < 0) {
+            cout << "Connection time line " << lineNo << " malformed, skipped\n";
+            continue;
+        }
+        connectOverrides[line.substr(0, bar)] = minutes;
+        read++;
+    }
+    return read;
+}
+
+int RoutePlanner::build(const FlightCatalog& cat) {
+    legs.clear();
+    airportIds.clear();
+    auto id = [&](const string& code) { return airportIds.emplace(code, (int)airportIds.size()).first->second; };
+    int skipped = 0;
+    for (const auto& f : cat.all()) {
+        int day, dep, arr;
+        if (!parseScheduleDate(f->date, day) || !parseClockTime(f->depTime, dep) || !parseClockTime(f->arrTime, arr)) {
+            skipped++;
+            continue;
+        }
+        dep += day * 1440;
+        arr += day * 1440;
+        if (arr < dep) arr += 1440;
+        legs.push_back(Leg{ id(f->src), id(f->dest), dep, arr, f.get() });
+    }
+    sort(legs.begin(), legs.end(), [](const Leg& a, const Leg& b) { return a.from != b.from ? a.from < b.from : a.dep < b.dep; });
+    firstLeg.assign(airportIds.size() + 1, 0);
+    for (const Leg& l : legs) firstLeg[l.from + 1]++;
+    for (size_t a = 0; a < airportIds.size(); ++a) firstLeg[a + 1] += firstLeg[a];
+    connectMinutes.assign(airportIds.size(), defaultConnect);
+    for (const auto& [code, a] : airportIds) {
+        auto it = connectOverrides.find(code);
+        if (it != connectOverrides.end()) connectMinutes[a] = it->second;
+    }
+    return skipped;
+}
+
+string itineraryJson(const Itinerary& it) {
+    string j = "{\"departs\":" + jsonString(formatScheduleTime(it.departs)) + ",\"arrives\":" +
+               jsonString(formatScheduleTime(it.arrives)) + ",\"minutes\":" + to_string(it.arrives - it.departs) +
+               ",\"stops\":" + to_string(it.legs.size() - 1) + ",\"fare\":" + jsonMoney(it.fare) + ",\"legs\":[";
+    for (size_t k = 0; k < it.legs.size(); ++k) {
+        const Flight& f = *it.legs[k];
+        if (k) j += ",";
+        j += "{\"flightNo\":" + jsonString(f.flightNo) + ",\"from\":" + jsonString(f.src) + ",\"to\":" + jsonString(f.dest) +
+             ",\"date\":" + jsonString(f.date) + ",\"depTime\":" + jsonString(f.depTime) + ",\"arrTime\":" + jsonString(f.arrTime) + "}";
+    }
+    return j + "]}";
+}
+
+// Best-first over partial itineraries ending in a flight: extending one
+// never makes it arrive earlier or cost less, so complete itineraries come
+// off the queue in order. A flight is extended at most q.count times (the
+// best q.count ways of reaching it), and no itinerary visits an airport twice.
+bool RoutePlanner::search(const RouteQuery& q, vector<Itinerary>& out) const {
+    out.clear();
+    auto from = airportIds.find(q.from), to = airportIds.find(q.to);
+    int day;
+    if (from == airportIds.end() || to == airportIds.end() || !parseScheduleDate(q.date, day)) return false;
+    int origin = from->second, dest = to->second;
+    if (q.count <= 0 || origin == dest) return true;
+
+    struct Label {
+        int leg, parent, depth, arr;
+        double fare;
+    };
+    vector<Label> labels;
+    using Entry = tuple<double, double, int>; // key, tie-break, label
+    priority_queue<Entry, vector<Entry>, greater<Entry>> open;
+    unordered_map<int, double> lowest;        // leg -> cheapest free seat of the class, < 0 if none
+    unordered_map<int, int> expanded;
+    auto fareOf = [&](int k) {
+        auto it = lowest.find(k);
+        if (it != lowest.end()) return it->second;
+        const SeatStore& seats = legs[k].flight->seats;
+        double cheapest = -1;
+        seats.forEachAvailable(q.cls, -1, [&](int i) { if (cheapest < 0 || seats.price(i) < cheapest) cheapest = seats.price(i); });
+        if (cheapest >= 0) cheapest *= fareEngine.multiplier(seats);
+        return lowest[k] = cheapest;
+    };
+    auto push = [&](int k, int parent) {
+        double f = fareOf(k);
+        if (f < 0) return;
+        Label l{ k, parent, parent < 0 ? 1 : labels[parent].depth + 1, legs[k].arr, f + (parent < 0 ? 0 : labels[parent].fare) };
+        open.emplace(q.byFare ? l.fare : l.arr, q.byFare ? l.arr : l.fare, (int)labels.size());
+        labels.push_back(l);
+    };
+    auto departing = [&](int airport, int earliest) {
+        auto b = legs.begin() + firstLeg[airport], e = legs.begin() + firstLeg[airport + 1];
+        return lower_bound(b, e, earliest, [](const Leg& l, int t) { return l.dep < t; }) - legs.begin();
+    };
+
+    int dayStart = day * 1440;
+    for (int k = (int)departing(origin, dayStart); k < firstLeg[origin + 1] && legs[k].dep < dayStart + 1440; ++k) push(k, -1);
+    while (!open.empty() && (int)out.size() < q.count) {
+        int li = get<2>(open.top());
+        open.pop();
+        const Label l = labels[li];
+        const Leg& leg = legs[l.leg];
+        if (leg.to == dest) {
+            Itinerary it;
+            for (int p = li; p >= 0; p = labels[p].parent) it.legs.push_back(legs[labels[p].leg].flight);
+            reverse(it.legs.begin(), it.legs.end());
+            int first = li;
+            while (labels[first].parent >= 0) first = labels[first].parent;
+            it.departs = legs[labels[first].leg].dep;
+            it.arrives = l.arr;
+            it.fare = l.fare;
+            out.push_back(move(it));
+            continue;
+        }
+        if (l.depth >= q.maxLegs || ++expanded[l.leg] > q.count) continue;
+        int earliest = l.arr + connectMinutes[leg.to], latest = l.arr + q.maxLayover;
+        for (int k = (int)departing(leg.to, earliest); k < firstLeg[leg.to + 1] && legs[k].dep <= latest; ++k) {
+            bool revisits = legs[k].to == origin;
+            for (int p = li; p >= 0 && !revisits; p = labels[p].parent) revisits = legs[labels[p].leg].to == legs[k].to;
+            if (!revisits) push(k, li);
+        }
+    }
+    return true;
+}
+
+// ----------------- Globals -----------------
+FlightCatalog catalog;
+Flight* currentFlight = nullptr;
+BookingTable bookings;
+CancelledArchive cancelledArchive;
+SearchIndex searchIndex;
+ReportStats reportTotals;
+mutex reportTotalsMu;
+Journal journal;
+atomic<int> bookingCounter{1};
+IdempotencyCache idempotencyKeys;
+
+int nextBookingId() { return bookingCounter.fetch_add(1); }
+
+void reserveBookingId(int id) {
+    int cur = bookingCounter.load();
+    while (cur <= id && !bookingCounter.compare_exchange_weak(cur, id + 1)) {}
+}
+
+// ----------------- Snapshot -----------------
+SnapshotView snapshot;
+
+void ensureHydrated() {
+    if (snapshot.pending()) snapshot.hydrateAll();
+}
+
+Booking* findBooking(int id) {
+    if (Booking* b = bookings.find(id)) return b;
+    return snapshot.find(id);
+}
+
+// ----------------- Booking Store -----------------
+void applyToReports(const Booking& b, int sign) {
+    if (!b.hasSeat()) return;
+    double amount = b.totalAmount();
+    {
+        lock_guard<mutex> lk(b.flight->statsMu);
+        b.flight->stats.apply(b.seatClass(), amount, b.passenger.meal, sign);
+    }
+    lock_guard<mutex> lk(reportTotalsMu);
+    reportTotals.apply(b.seatClass(), amount, b.passenger.meal, sign);
+}
+
+Booking* addBooking(unique_ptr<Booking> b) {
+    Booking* raw = b.get();
+    raw->savedEpoch = checkpointer.currentEpoch(); // journaled after any cut so far
+    lock_guard<mutex> lk(bookings.lockFor(raw->id));
+    if (Booking* prev = bookings.findLocked(raw->id)) checkpointer.preserveLocked(*prev);
+    unique_ptr<Booking> old = bookings.putLocked(move(b));
+    if (old) {
+        searchIndex.update(raw->id, old->passenger, raw->passenger);
+        applyToReports(*old, -1);
+    } else {
+        searchIndex.add(raw->id, raw->passenger);
+    }
+    applyToReports(*raw, +1);
+    return raw;
+}
+
+unique_ptr<Booking> removeBooking(int id) {
+    unique_ptr<Booking> b;
+    {
+        lock_guard<mutex> lk(bookings.lockFor(id));
+        if (Booking* cur = bookings.findLocked(id)) checkpointer.preserveLocked(*cur);
+        b = bookings.takeLocked(id);
+    }
+    if (!b) return nullptr;
+    searchIndex.remove(id, b->passenger);
+    applyToReports(*b, -1);
+    return b;
+}
+
+string encodeBookRecord(const Booking& b) {
+    RecordWriter w;
+    w.u8(J_BOOK);
+    w.i32(b.id);
+    w.str(b.flight ? b.flight->flightNo : "");
+    w.str(b.seatNo());
+    w.str(b.passenger.name);
+    w.str(b.passenger.phone);
+    w.str(b.passenger.email);
+    w.str(b.passenger.gender);
+    w.u8((uint8_t)b.passenger.meal);
+    w.u8(b.passenger.wheelchair ? 1 : 0);
+    w.i32(b.passenger.luggageKg);
+    char when[TIME_TEXT];
+    w.str(string_view(when, formatTime(b.bookedAt, when, sizeof(when))));
+    w.u8(b.payment ? (uint8_t)b.payment->method : (uint8_t)CASH);
+    w.f64(b.payment ? b.payment->amount : 0.0);
+    w.str(b.payment ? b.payment->txnId.view() : string_view());
+    w.f64(b.luggageFee());
+    return w.buf;
+}
+
+Booking* confirmBooking(unique_ptr<Booking> b) {
+    MutationScope scope;
+    if (!b->flight->seats.tryClaim(b->seat)) return nullptr;
+    journal.append(encodeBookRecord(*b));
+    return addBooking(move(b));
+}
+
+Cancellation cancelBooking(int id) {
+    findBooking(id); // hydrate if still only in the snapshot
+    MutationScope scope;
+    unique_ptr<Booking> b = removeBooking(id);
+    Cancellation out;
+    if (!b) return out;
+    b->cancelled = true;
+    RecordWriter w;
+    w.u8(J_CANCEL);
+    w.i32(id);
+    journal.append(w.buf);
+    if (b->hasSeat()) {
+        b->flight->seats.release(b->seat);
+        out.seat = b->seat;
+    }
+    out.flight = b->flight;
+    out.refund = refundFor(*b);
+    out.ok = cancelledArchive.add(move(b));
+    return out;
+}
+
+bool changeSeat(int id, int newSeat, int* oldSeatOut, Flight** flightOut) {
+    if (snapshot.pending()) snapshot.find(id); // hydrate if still only in the snapshot
+    MutationScope scope;
+    lock_guard<mutex> lk(bookings.lockFor(id));
+    Booking* b = bookings.findLocked(id);
+    if (!b || !b->hasSeat()) return false;
+    SeatStore& seats = b->flight->seats;
+    if (newSeat < 0 || newSeat >= seats.size() || seats.cls(newSeat) != b->seatClass() || !seats.tryClaim(newSeat)) return false;
+    checkpointer.preserveLocked(*b);
+    int oldSeat = b->seat;
+    applyToReports(*b, -1);
+    b->seat = newSeat;
+    applyToReports(*b, +1);
+    RecordWriter w;
+    w.u8(J_SEAT);
+    w.i32(b->id);
+    w.str(b->seatNo());
+    journal.append(w.buf);
+    seats.release(oldSeat);
+    if (oldSeatOut) *oldSeatOut = oldSeat;
+    if (flightOut) *flightOut = b->flight;
+    return true;
+}
+
+bool changeMeal(int id, MealPreference meal) {
+    if (snapshot.pending()) snapshot.find(id); // hydrate if still only in the snapshot
+    MutationScope scope;
+    lock_guard<mutex> lk(bookings.lockFor(id));
+    Booking* b = bookings.findLocked(id);
+    if (!b) return false;
+    checkpointer.preserveLocked(*b);
+    applyToReports(*b, -1);
+    b->passenger.meal = meal;
+    applyToReports(*b, +1);
+    RecordWriter w;
+    w.u8(J_MEAL);
+    w.i32(b->id);
+    w.u8((uint8_t)meal);
+    journal.append(w.buf);
+    return true;
+}
+
+void applyJournalRecord(const char* data, size_t n) {
+    RecordReader r(data, n);
+    uint8_t op = r.u8();
+    int id = r.i32();
+    if (op == J_BOOK) {
+        string flightNo = r.str(), seatNo = r.str();
+        string name = r.str(), phone = r.str(), email = r.str(), gender = r.str();
+        MealPreference meal = static_cast<MealPreference>(r.u8() & 3);
+        bool wheelchair = r.u8() != 0;
+        int luggage = r.i32();
+        int64_t bookedAt = storedTime(r.str());
+        PaymentMethod method = static_cast<PaymentMethod>(r.u8() & 3);
+        double amount = r.f64();
+        string txnId = r.str();
+        double fee = r.p < r.end ? r.f64() : -1.0; // older records stop at the txn
+        if (!r.ok) return;
+        Flight* fl = catalog.find(flightNo);
+        int seat = fl ? fl->findSeat(seatNo) : -1;
+        if (seat < 0 || findBooking(id) || !fl->seats.tryClaim(seat)) return;
+        auto pay = make_unique<Payment>(amount, method, bookedAt, Str::store(txnId));
+        pay->luggageFee = fee;
+        auto b = make_unique<Booking>(id, Passenger{name, phone, email, gender, meal, wheelchair, luggage}, fl, seat, move(pay));
+        addBooking(move(b));
+        reserveBookingId(id);
+    } else if (op == J_CANCEL) {
+        if (r.ok) cancelBooking(id);
+    } else if (op == J_SEAT) {
+        string seatNo = r.str();
+        Booking* b = findBooking(id);
+        if (r.ok && b && b->flight) changeSeat(id, b->flight->findSeat(seatNo));
+    } else if (op == J_MEAL) {
+        uint8_t meal = r.u8();
+        if (r.ok) changeMeal(id, static_cast<MealPreference>(meal & 3));
+    }
+}
+
+bool verifyReportAggregates() {
+    ensureHydrated();
+    unordered_map<const Flight*, ReportStats> perFlight;
+    ReportStats totals;
+    bookings.forEach([&](const Booking& b) {
+        if (!b.hasSeat()) return;
+        double amount = b.totalAmount();
+        perFlight[b.flight].apply(b.seatClass(), amount, b.passenger.meal, +1);
+        totals.apply(b.seatClass(), amount, b.passenger.meal, +1);
+    });
+    bool ok = true;
+    for (const auto& f : catalog.all()) {
+        if (!f->stats.matches(perFlight[f.get()])) {
+            cout << "Report aggregates out of sync for flight " << f->flightNo << "\n";
+            ok = false;
+        }
+    }
+    if (!reportTotals.matches(totals)) {
+        cout << "Catalog-wide report aggregates out of sync\n";
+        ok = false;
+    }
+    return ok;
+}
+
+bool bookingMatches(const Booking& b, const string& q) {
+    return b.passenger.name.find(q) != string::npos ||
+           b.passenger.phone.find(q) != string::npos ||
+           b.passenger.email.find(q) != string::npos;
+}
+
+vector<Booking*> findBookings(const string& q) {
+    MetricTimer timer(M_SEARCH);
+    ensureHydrated();
+    vector<Booking*> result;
+    if (q.size() < SearchIndex::MIN_QUERY) {
+        for (Booking* b : bookings.sorted()) {
+            if (to_string(b->id) == q || bookingMatches(*b, q)) result.push_back(b);
+        }
+        return result;
+    }
+    Booking* exact = nullptr;
+    if (all_of(q.begin(), q.end(), [](char c) { return isdigit((unsigned char)c); }) && q.size() < 10) {
+        Booking* b = bookings.find(stoi(q));
+        if (b && to_string(b->id) == q) exact = b;
+    }
+    for (int id : searchIndex.candidates(q)) {
+        Booking* b = bookings.find(id);
+        if (b && bookingMatches(*b, q)) result.push_back(b);
+    }
+    if (exact) {
+        auto pos = lower_bound(result.begin(), result.end(), exact->id,
+                               [](const Booking* b, int id) { return b->id < id; });
+        if (pos == result.end() || *pos != exact) result.insert(pos, exact);
+    }
+    return result;
+}
+
+// ----------------- Operations -----------------
+double ticketPrice(const Flight& flight, int seat, int luggageKg) {
+    return fareEngine.seatFare(flight.seats, seat) + fareEngine.luggageFee(luggageKg);
+}
+
+double refundFor(const Booking& b) { return b.totalAmount() * 0.9; }
+
+string checkPassenger(const Passenger& p) {
+    if (p.name.empty()) return "name is empty";
+    if (!isValidPhone(p.phone)) return "invalid phone";
+    if (!isValidEmail(p.email)) return "invalid email";
+    return "";
+}
+
+namespace {
+Booking* placeBooking(const BookingRequest& req, string& error, BookResult& result) {
+    MetricTimer timer(M_BOOK, false);
+    const Passenger& p = req.passenger;
+    result = INVALID;
+    if (!req.flight) { error = "unknown flight"; return nullptr; }
+    error = checkPassenger(p);
+    if (!error.empty()) return nullptr;
+    Flight& flight = *req.flight;
+
+    int wanted = -1;
+    if (!req.seatNo.empty()) {
+        wanted = flight.findSeat(req.seatNo);
+        if (wanted < 0) { error = "no seat " + req.seatNo + " on " + flight.flightNo; return nullptr; }
+        if (flight.seats.cls(wanted) != req.cls) { error = "seat " + req.seatNo + " is not " + seatClassString(req.cls); return nullptr; }
+    }
+    result = UNAVAILABLE;
+    while (true) {
+        int seat = wanted;
+        if (seat < 0) flight.seats.forEachAvailable(req.cls, req.pref, [&](int i) { if (seat < 0) seat = i; });
+        if (seat < 0) { error = string("no ") + seatClassString(req.cls) + " seat available"; return nullptr; }
+        auto pay = make_unique<Payment>(ticketPrice(flight, seat, p.luggageKg), req.method);
+        if (Booking* b = confirmBooking(make_unique<Booking>(nextBookingId(), p, &flight, seat, move(pay)))) {
+            timer.ok = true;
+            result = BOOKED;
+            return b;
+        }
+        if (wanted >= 0) { error = "seat " + req.seatNo + " is taken"; return nullptr; }
+    }
+}
+}
+
+Booking* bookSeat(const BookingRequest& req, string& error, BookResult* result) {
+    BookResult ignored;
+    BookResult& res = result ? *result : ignored;
+    if (req.idempotencyKey.empty()) return placeBooking(req, error, res);
+    int id = 0;
+    switch (idempotencyKeys.claim(req.idempotencyKey, id)) {
+        case IdempotencyCache::DONE:
+            if (Booking* b = findBooking(id)) {
+                res = REPLAYED;
+                return b;
+            }
+            res = KEY_CONFLICT;
+            error = "booking #" + to_string(id) + " made with this idempotency key has been cancelled";
+            return nullptr;
+        case IdempotencyCache::RUNNING:
+            res = KEY_CONFLICT;
+            error = "a request with this idempotency key is still running";
+            return nullptr;
+        case IdempotencyCache::NEW:
+            break;
+    }
+    Booking* b = placeBooking(req, error, res);
+    if (b) idempotencyKeys.finish(req.idempotencyKey, b->id);
+    else idempotencyKeys.abandon(req.idempotencyKey);
+    return b;
+}
+
+vector<Booking*> bookGroup(const GroupRequest& req, string& error, bool* together) {
+    MetricTimer timer(M_GROUP_BOOK, false);
+    if (!req.flight) { error = "unknown flight"; return {}; }
+    int n = (int)req.passengers.size();
+    if (n == 0) { error = "no passengers"; return {}; }
+    for (int k = 0; k < n; ++k) {
+        error = checkPassenger(req.passengers[k]);
+        if (!error.empty()) { error = "passenger " + to_string(k + 1) + ": " + error; return {}; }
+    }
+    Flight& flight = *req.flight;
+    vector<int> slots;
+    vector<double> prices(n);
+    bool side = false;
+    MutationScope scope;
+    while (true) {
+        if (!flight.seats.findGroup(req.cls, req.pref, n, slots, side)) {
+            error = "only " + to_string(flight.seats.countAvailable(req.cls)) + " " + seatClassString(req.cls) +
+                    " seats available for " + to_string(n) + " passengers";
+            return {};
+        }
+        // priced at the load before the party, as a single booking is
+        for (int k = 0; k < n; ++k) prices[k] = ticketPrice(flight, slots[k], req.passengers[k].luggageKg);
+        if (flight.seats.tryClaimAll(slots)) break;
+        // another session took one of them; look again
+    }
+    vector<unique_ptr<Booking>> made;
+    vector<string> records;
+    for (int k = 0; k < n; ++k) {
+        auto pay = make_unique<Payment>(prices[k], req.method);
+        made.push_back(make_unique<Booking>(nextBookingId(), req.passengers[k], &flight, slots[k], move(pay)));
+        records.push_back(encodeBookRecord(*made.back()));
+    }
+    journal.appendAll(records);
+    vector<Booking*> out;
+    for (auto& b : made) out.push_back(addBooking(move(b)));
+    if (together) *together = side;
+    timer.ok = true;
+    return out;
+}
+
+Booking* fillFromWaitlist(Flight& flight, int seat) {
+    WaitlistEntry e;
+    if (!flight.waitlist.takeNext(flight.seats.cls(seat), flight.seats.pref(seat), e)) return nullptr;
+    BookingRequest req;
+    req.flight = &flight;
+    req.passenger = move(e.passenger);
+    req.cls = e.cls;
+    req.seatNo = flight.seats.code(seat);
+    req.method = e.method;
+    string error;
+    Booking* b = bookSeat(req, error);
+    if (!b) {
+        e.passenger = move(req.passenger);
+        flight.waitlist.restore(move(e));
+    }
+    return b;
+}
+
+Cancellation cancelAndRefill(int id, Booking*& reassigned) {
+    MetricTimer timer(M_CANCEL);
+    reassigned = nullptr;
+    Cancellation c = cancelBooking(id);
+    timer.ok = c.ok;
+    if (c.ok && c.seat >= 0) reassigned = fillFromWaitlist(*c.flight, c.seat);
+    return c;
+}
+
+bool changeSeatAndRefill(int id, int newSeat, Booking*& reassigned) {
+    MetricTimer timer(M_SEAT_CHANGE, false);
+    reassigned = nullptr;
+    int oldSeat;
+    Flight* flight;
+    if (!changeSeat(id, newSeat, &oldSeat, &flight)) return false;
+    reassigned = fillFromWaitlist(*flight, oldSeat);
+    timer.ok = true;
+    return true;
+}
+
+void writeReportStats(ostream& os, const ReportStats& st, int totalSeats) {
+    os << "-- Revenue by Class --\n";
+    os << "Economy: " << st.count[ECONOMY] << " bookings, $" << st.revenue[ECONOMY] << "\n";
+    os << "Business: " << st.count[BUSINESS] << " bookings, $" << st.revenue[BUSINESS] << "\n";
+    os << "First Class: " << st.count[FIRST_CLASS] << " bookings, $" << st.revenue[FIRST_CLASS] << "\n";
+    os << "Total Revenue: $" << st.totalRevenue() << "\n\n";
+    os << "-- Occupancy --\n";
+    os << "Booked: " << st.booked() << "/" << totalSeats << " (" << fixed << setprecision(2)
+       << (totalSeats ? st.booked()*100.0/totalSeats : 0.0) << "%)\n\n";
+    os << "-- Meal Preferences --\n";
+    os << "Vegetarian: " << st.meals[VEGETARIAN] << ", Non-Veg: " << st.meals[NON_VEG]
+       << ", Vegan: " << st.meals[VEGAN] << ", No Meal: " << st.meals[NO_MEAL] << "\n\n";
+}
+
+void writeReports(ostream& os, Flight* flight) {
+    ReportStats all, one;
+    {
+        lock_guard<mutex> lk(reportTotalsMu);
+        all = reportTotals;
+    }
+    os << "=== All flights (" << catalog.size() << ") ===\n";
+    writeReportStats(os, all, catalog.totalSeats());
+    if (flight && catalog.size() > 1) {
+        {
+            lock_guard<mutex> lk(flight->statsMu);
+            one = flight->stats;
+        }
+        os << "=== Flight " << flight->flightNo << " ===\n";
+        writeReportStats(os, one, flight->seats.size());
+    }
+    os << "-- Cancelled Bookings --\n";
+    os << "Total Cancelled: " << cancelledArchive.size() << "\n";
+}
+
+// ----------------- Save / Load -----------------
+namespace {
+// Flushes a file just written to disk before it is renamed into place
+bool syncFile(const string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    bool ok = fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+}
+
+// Everything in the table now, ordered by ID
+void captureAll(StateImage& img) {
+    ensureHydrated();
+    img.clear();
+    bookings.forEach([&](Booking& b) { img.add(b); });
+    img.sortById();
+    img.nextBookingId = bookingCounter.load();
+}
+}
+
+void StateImage::add(const Booking& b) {
+    auto put = [this](string_view v) {
+        SnapStr r{ (uint32_t)heap.size(), (uint32_t)v.size() };
+        heap += v;
+        return r;
+    };
+    SnapRecord r{};
+    r.id = b.id;
+    r.luggageKg = b.passenger.luggageKg;
+    r.amount = b.payment ? b.payment->amount : 0.0;
+    if (b.hasSeat()) {
+        r.seatRow = b.flight->seats.layout().row[b.seat];
+        r.seatLetter = b.flight->seats.layout().letter[b.seat];
+    }
+    r.meal = (uint8_t)b.passenger.meal;
+    r.wheelchair = b.passenger.wheelchair ? 1 : 0;
+    r.payMethod = b.payment ? (uint8_t)b.payment->method : (uint8_t)CASH;
+    r.flightNo = put(b.flight ? b.flight->flightNo : "");
+    r.name = put(b.passenger.name);
+    r.phone = put(b.passenger.phone);
+    r.email = put(b.passenger.email);
+    r.gender = put(b.passenger.gender);
+    char when[TIME_TEXT];
+    r.bookingTime = put(string_view(when, formatTime(b.bookedAt, when, sizeof(when))));
+    r.txnId = put(b.payment ? b.payment->txnId.view() : string_view());
+    records.push_back(r);
+    rows.push_back({ b.flight, b.hasSeat() ? b.seat : -1, b.totalAmount(), b.payment != nullptr });
+}
+
+void StateImage::addRecord(const SnapRecord& r, const SnapshotView& from, const Flight* flight, int seat) {
+    SnapRecord c = r;
+    for (SnapStr* f : { &c.flightNo, &c.name, &c.phone, &c.email, &c.gender, &c.bookingTime, &c.txnId }) {
+        string_view v = from.text(*f);
+        *f = SnapStr{ (uint32_t)heap.size(), (uint32_t)v.size() };
+        heap += v;
+    }
+    records.push_back(c);
+    // hydration always gives the booking a payment
+    rows.push_back({ flight, seat, flight && seat >= 0 ? r.amount : 0.0, true });
+}
+
+void StateImage::sortById() {
+    vector<uint32_t> order(records.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = (uint32_t)i;
+    sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) { return records[a].id < records[b].id; });
+    vector<SnapRecord> r;
+    vector<Row> w;
+    r.reserve(order.size());
+    w.reserve(order.size());
+    for (uint32_t i : order) { r.push_back(records[i]); w.push_back(rows[i]); }
+    records.swap(r);
+    rows.swap(w);
+}
+
+void StateImage::clear() {
+    vector<SnapRecord>().swap(records);
+    vector<Row>().swap(rows);
+    string().swap(heap);
+    nextBookingId = 1;
+    generation = 0;
+}
+
+bool writeBookingsText(const StateImage& img, const string& path) {
+    const string tmp = path + ".tmp";
+    ofstream f(tmp);
+    if (!f) {
+        cout << "Error saving bookings to file\n";
+        return false;
+    }
+    f << img.records.size() << "\n";
+    for (size_t i = 0; i < img.records.size(); ++i) {
+        const SnapRecord& r = img.records[i];
+        const StateImage::Row& row = img.rows[i];
+        string_view flightNo = img.str(r.flightNo);
+        f << r.id << "|"
+          << img.str(r.name) << "|"
+          << img.str(r.phone) << "|"
+          << img.str(r.email) << "|"
+          << img.str(r.gender) << "|"
+          << static_cast<int>(r.meal) << "|"
+          << (r.wheelchair ? "1" : "0") << "|"
+          << r.luggageKg << "|"
+          << (row.flight && row.seat >= 0 ? row.flight->seats.code(row.seat) : string("NONE")) << "|"
+          << img.str(r.bookingTime) << "|"
+          << (row.paid ? static_cast<int>(r.payMethod) : -1) << "|"
+          << (row.paid ? r.amount : 0.0) << "|"
+          << (flightNo.empty() ? string_view("NONE") : flightNo) << "|"
+          << img.str(r.txnId)
+          << "\n";
+    }
+    f.close();
+    if (!f || !syncFile(tmp) || rename(tmp.c_str(), path.c_str()) != 0) {
+        cout << "Error saving bookings to file\n";
+        return false;
+    }
+    return true;
+}
+
+bool writeSnapshot(const StateImage& img, const string& path) {
+    string heap = img.heap;
+    auto put = [&heap](string_view v) {
+        SnapStr r{ (uint32_t)heap.size(), (uint32_t)v.size() };
+        heap += v;
+        return r;
+    };
+
+    // seat bits and aggregates as of the image: all seats free, then
+    // every captured booking takes its own
+    unordered_map<const Flight*, size_t> slotOf;
+    vector<SnapFlight> flights;
+    vector<ReportStats> stats;
+    vector<uint64_t> words;
+    for (const auto& f : catalog.all()) {
+        SnapFlight sf{};
+        sf.flightNo = put(f->flightNo);
+        sf.wordCount = (uint32_t)f->seats.available.size();
+        sf.firstWord = (uint32_t)words.size();
+        words.resize(words.size() + sf.wordCount, 0);
+        for (int i = 0; i < f->seats.size(); ++i) words[sf.firstWord + (i >> 6)] |= 1ULL << (i & 63);
+        slotOf[f.get()] = flights.size();
+        flights.push_back(sf);
+        stats.emplace_back();
+    }
+    for (size_t i = 0; i < img.rows.size(); ++i) {
+        const StateImage::Row& row = img.rows[i];
+        if (!row.flight || row.seat < 0) continue;
+        auto it = slotOf.find(row.flight);
+        if (it == slotOf.end()) continue;
+        words[flights[it->second].firstWord + (row.seat >> 6)] &= ~(1ULL << (row.seat & 63));
+        stats[it->second].apply(row.flight->seats.cls(row.seat), row.total, static_cast<MealPreference>(img.records[i].meal), +1);
+    }
+    for (size_t k = 0; k < flights.size(); ++k) {
+        for (int c = 0; c < NUM_SEAT_CLASSES; ++c) { flights[k].revenue[c] = stats[k].revenue[c]; flights[k].count[c] = stats[k].count[c]; }
+        for (int m = 0; m < 4; ++m) flights[k].meals[m] = stats[k].meals[m];
+    }
+
+    SnapHeader h{};
+    memcpy(h.magic, SNAPSHOT_MAGIC, 8);
+    h.version = SNAPSHOT_VERSION;
+    h.recordSize = sizeof(SnapRecord);
+    h.flightCount = flights.size();
+    h.flightsOff = sizeof(SnapHeader);
+    h.wordsOff = h.flightsOff + flights.size() * sizeof(SnapFlight);
+    h.bookingCount = img.records.size();
+    h.recordsOff = h.wordsOff + words.size() * sizeof(uint64_t);
+    h.heapOff = h.recordsOff + img.records.size() * sizeof(SnapRecord);
+    h.heapSize = heap.size();
+    h.nextBookingId = img.nextBookingId;
+    h.journalGeneration = img.generation;
+
+    const string tmp = path + ".tmp";
+    ofstream f(tmp, ios::binary);
+    f.write((const char*)&h, sizeof(h));
+    f.write((const char*)flights.data(), flights.size() * sizeof(SnapFlight));
+    f.write((const char*)words.data(), words.size() * sizeof(uint64_t));
+    f.write((const char*)img.records.data(), img.records.size() * sizeof(SnapRecord));
+    f.write(heap.data(), heap.size());
+    f.close();
+    if (!f || !syncFile(tmp) || rename(tmp.c_str(), path.c_str()) != 0) {
+        cout << "Error writing snapshot " << path << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool saveBookingsToFile(const string& path) {
+    StateImage img;
+    captureAll(img);
+    if (!writeBookingsText(img, path)) return false;
+    cout << "Bookings saved to " << path << "\n";
+    return true;
+}
+
+bool writeSnapshot(const string& path) {
+    StateImage img;
+    captureAll(img);
+    return writeSnapshot(img, path);
+}
+
+uint32_t loadLatestBookings() {
+    struct stat snapSt, textSt;
+    bool haveSnap = stat(SNAPSHOT_FILE.c_str(), &snapSt) == 0;
+    bool haveText = stat("bookings.txt", &textSt) == 0;
+    if (haveSnap && (!haveText || snapSt.st_mtime >= textSt.st_mtime) && snapshot.open(SNAPSHOT_FILE)) {
+        cout << "Snapshot opened (" << snapshot.pendingCount() << " bookings, loaded on demand)\n";
+        return snapshot.generation();
+    }
+    loadBookingsFromFile();
+    return 0;
+}
+
+// ----------------- Checkpoints -----------------
+MutationGate mutationGate;
+Checkpointer checkpointer;
+
+vector<pair<uint32_t, string>> journalSegments(const string& journalPath, uint32_t after) {
+    size_t slash = journalPath.rfind('/');
+    string dir = slash == string::npos ? "." : journalPath.substr(0, slash);
+    string prefix = (slash == string::npos ? journalPath : journalPath.substr(slash + 1)) + ".";
+    vector<pair<uint32_t, string>> out;
+    DIR* d = opendir(dir.c_str());
+    if (!d) return out;
+    while (dirent* e = readdir(d)) {
+        string_view name = e->d_name;
+        if (name.size() <= prefix.size() || name.substr(0, prefix.size()) != prefix) continue;
+        uint32_t n;
+        if (!parseNumber(name.substr(prefix.size()), n) || n <= after) continue;
+        out.push_back({ n, slash == string::npos ? string(name) : dir + "/" + string(name) });
+    }
+    closedir(d);
+    sort(out.begin(), out.end());
+    return out;
+}
+
+void Checkpointer::copyLocked(Booking& b) {
+    uint32_t e = epoch.load();
+    if (b.savedEpoch >= e) return;
+    b.savedEpoch = e;
+    lock_guard<mutex> lk(imageMu);
+    image.add(b);
+    copied++;
+}
+
+bool Checkpointer::run() {
+    lock_guard<mutex> runLock(runMu);
+    MetricTimer timer(M_SAVE, false);
+    CheckpointStats st;
+    {
+        lock_guard<mutex> lk(imageMu);
+        image.clear();
+        copied = 0;
+    }
+
+    // the cut: no operation is half done, the journal starts a new file
+    const bool rotating = journal.isOpen();
+    const uint32_t gen = generation + 1;
+    uint64_t lastRecord = 0;
+    bool cut = false;
+    uint32_t e = 0;
+    vector<bool> lazy;
+    bool pinned = false;
+    auto t0 = chrono::steady_clock::now();
+    {
+        MetricTimer cutTimer(M_CHECKPOINT_CUT);
+        mutationGate.cut([&] {
+            if (rotating && !journal.rotate(journal.path() + "." + to_string(gen), lastRecord)) return;
+            cut = true;
+            e = ++epoch;
+            pinned = snapshot.pin(e, lazy);
+            image.nextBookingId = bookingCounter.load();
+            image.generation = rotating ? gen : generation;
+            capturing = true;
+            cancelledArchive.markCut();
+        });
+        cutTimer.ok = cut;
+    }
+    auto t1 = chrono::steady_clock::now();
+    st.cutUs = chrono::duration<double, micro>(t1 - t0).count();
+    if (!cut) {
+        cout << "Checkpoint: cannot rotate " << journal.path() << "\n";
+        last = st;
+        return false;
+    }
+    if (rotating) generation = gen;
+    savedSeq = lastRecord;
+
+    // capture whatever the operations since the cut have not copied already
+    bookings.forEach([&](Booking& b) {
+        if (b.savedEpoch >= e) return;
+        b.savedEpoch = e;
+        lock_guard<mutex> lk(imageMu);
+        image.add(b);
+    });
+    if (pinned) {
+        // records never hydrated, straight from the mapped file
+        unordered_map<string_view, const Flight*> flights;
+        for (size_t i = 0; i < lazy.size(); ++i) {
+            if (!lazy[i]) continue;
+            const SnapRecord& r = snapshot.record(i);
+            string_view no = snapshot.text(r.flightNo);
+            auto it = flights.find(no);
+            if (it == flights.end()) it = flights.emplace(no, catalog.find(string(no))).first;
+            const Flight* fl = it->second;
+            int seat = fl ? fl->seats.layout().find(r.seatRow, r.seatLetter) : -1;
+            lock_guard<mutex> lk(imageMu);
+            image.addRecord(r, snapshot, fl, seat);
+        }
+        snapshot.unpin();
+    }
+    capturing = false;
+    {
+        lock_guard<mutex> lk(imageMu);
+        image.sortById();
+        st.bookings = image.records.size();
+        st.copiedOnWrite = copied;
+    }
+    auto t2 = chrono::steady_clock::now();
+    st.captureMs = chrono::duration<double, milli>(t2 - t1).count();
+
+    // cancellations before the cut go to the archive before the snapshot
+    // that leaves them out is installed
+    journal.waitDurable(lastRecord);
+    cancelledArchive.flushToCut();
+    st.ok = writeBookingsText(image, textPath) && writeSnapshot(image, snapshotPath);
+    if (st.ok) {
+        cancelledArchive.commitCut();
+        if (rotating) {
+            for (const auto& seg : journalSegments(journal.path())) {
+                if (seg.first > image.generation) break;
+                if (remove(seg.second.c_str()) != 0) perror("journal segment");
+            }
+        }
+    } else {
+        cancelledArchive.abandonCut();
+    }
+    st.writeMs = chrono::duration<double, milli>(chrono::steady_clock::now() - t2).count();
+    {
+        lock_guard<mutex> lk(imageMu);
+        image.clear();
+    }
+    last = st;
+    timer.ok = st.ok;
+    return st.ok;
+}
+
+void Checkpointer::start(int seconds) {
+    if (seconds <= 0 || worker.joinable()) return;
+    {
+        lock_guard<mutex> lk(workerMu);
+        stopping = false;
+    }
+    worker = thread([this, seconds] {
+        unique_lock<mutex> lk(workerMu);
+        while (!wake.wait_for(lk, chrono::seconds(seconds), [this] { return stopping; })) {
+            lk.unlock();
+            if (journal.lastSeq() != savedSeq) run();
+            lk.lock();
+        }
+    });
+}
+
+void Checkpointer::stop() {
+    {
+        lock_guard<mutex> lk(workerMu);
+        stopping = true;
+    }
+    wake.notify_all();
+    if (worker.joinable()) worker.join();
+}
+
+void checkpoint() {
+    if (checkpointer.run()) cout << "Bookings saved to " << checkpointer.textPath << "\n";
+}
+
+void parseBookingChunk(const char* p, const char* end, ParsedChunk& out) {
+    out.rows.reserve((end - p) / 96 + 1);
+    string_view f[15];
+    while (p < end) {
+        const char* nl = (const char*)memchr(p, '\n', end - p);
+        const char* eol = nl ? nl : end;
+        const char* lineEnd = (eol > p && eol[-1] == '\r') ? eol - 1 : eol;
+        out.lines++;
+        if (lineEnd > p) {
+            int n = 0;
+            const char* q = p;
+            while (n < 15) {
+                const char* bar = (const char*)memchr(q, '|', lineEnd - q);
+                const char* fe = bar ? bar : lineEnd;
+                f[n++] = string_view(q, fe - q);
+                if (!bar) break;
+                q = bar + 1;
+            }
+            ParsedBooking r{};
+            r.line = out.lines;
+            const char* err = nullptr;
+            if (n < 12 || n > 14) err = "expected 12 to 14 fields";
+            else if (!parseNumber(f[0], r.id) || r.id <= 0) err = "bad booking id";
+            else if (!parseNumber(f[5], r.meal) || r.meal < 0 || r.meal > 3) err = "bad meal code";
+            else if (f[6] != "0" && f[6] != "1") err = "bad wheelchair flag";
+            else if (!parseNumber(f[7], r.luggage) || r.luggage < 0) err = "bad luggage weight";
+            else if (!parseNumber(f[10], r.payMethod) || r.payMethod < -1 || r.payMethod > 3) err = "bad payment method";
+            else if (!parseNumber(f[11], r.amount)) err = "bad payment amount";
+            if (err) {
+                out.errors.push_back({out.lines, err});
+            } else {
+                r.name = f[1]; r.phone = f[2]; r.email = f[3]; r.gender = f[4];
+                r.wheelchair = f[6] == "1";
+                r.seatNo = f[8];
+                r.bookingTime = f[9];
+                r.flightNo = n > 12 ? f[12] : string_view();
+                r.txnId = n > 13 ? f[13] : string_view();
+                out.rows.push_back(r);
+            }
+        }
+        p = eol + 1;
+    }
+}
+
+void loadBookingsFromFile(const string& path, int threads) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        // no file yet, not an error
+        return;
+    }
+    struct stat st;
+    size_t len = fstat(fd, &st) == 0 ? (size_t)st.st_size : 0;
+    void* m = len ? mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    ::close(fd);
+    if (m == MAP_FAILED) return;
+    const char* data = (const char*)m;
+    const char* end = data + len;
+
+    // leading count line (a hint only); absent if the first line is already a booking
+    const char* body = data;
+    long declared = -1;
+    uint32_t lineBase = 0;
+    const char* nl = (const char*)memchr(data, '\n', len);
+    string_view first(data, (nl ? nl : end) - data);
+    if (!first.empty() && first.back() == '\r') first.remove_suffix(1);
+    if (parseNumber(first, declared)) {
+        body = nl ? nl + 1 : end;
+        lineBase = 1;
+    }
+
+    // split at newline boundaries; small files stay on one thread
+    const size_t MIN_CHUNK = 1 << 18;
+    if (threads <= 0) threads = (int)max(1u, thread::hardware_concurrency());
+    size_t bodyLen = end - body;
+    int nChunks = (int)max<size_t>(1, min<size_t>(threads, bodyLen / MIN_CHUNK));
+    vector<const char*> cuts{ body };
+    for (int c = 1; c < nChunks; ++c) {
+        const char* at = body + bodyLen * c / nChunks;
+        if (at < cuts.back()) at = cuts.back();
+        const char* brk = (const char*)memchr(at, '\n', end - at);
+        cuts.push_back(brk ? brk + 1 : end);
+    }
+    cuts.push_back(end);
+
+    vector<ParsedChunk> chunks(nChunks);
+    vector<thread> workers;
+    for (int c = 1; c < nChunks; ++c) workers.emplace_back(parseBookingChunk, cuts[c], cuts[c + 1], ref(chunks[c]));
+    parseBookingChunk(cuts[0], cuts[1], chunks[0]);
+    for (auto& w : workers) w.join();
+
+    // merge in file order
+    size_t bookingLines = 0, problems = 0;
+    const size_t MAX_REPORTED = 10;
+    auto report = [&](uint32_t line, const string& why) {
+        if (problems++ < MAX_REPORTED) cout << path << ":" << line << ": " << why << "\n";
+    };
+    Flight* lastFlight = nullptr;
+    string_view lastFlightNo;
+    for (auto& chunk : chunks) {
+        bookingLines += chunk.rows.size() + chunk.errors.size();
+        size_t e = 0;
+        for (const ParsedBooking& r : chunk.rows) {
+            // interleave parse errors so messages come out in line order
+            for (; e < chunk.errors.size() && chunk.errors[e].line < r.line; ++e) report(lineBase + chunk.errors[e].line, string(chunk.errors[e].reason) + ", skipped");
+            uint32_t line = lineBase + r.line;
+            Flight* fl;
+            if (r.flightNo.empty()) fl = catalog.front();
+            else if (lastFlight && r.flightNo == lastFlightNo) fl = lastFlight;
+            else {
+                fl = catalog.find(string(r.flightNo));
+                lastFlight = fl;
+                lastFlightNo = r.flightNo;
+            }
+            if (!fl) { report(line, "unknown flight " + string(r.flightNo) + ", skipped"); continue; }
+            int seatIdx = fl->findSeat(r.seatNo);
+            if (seatIdx < 0) { report(line, "no seat " + string(r.seatNo) + " on " + fl->flightNo + ", skipped"); continue; }
+
+            // a repeated ID replaces the earlier line, as it always has
+            if (Booking* old = findBooking(r.id)) {
+                report(line, "booking #" + to_string(r.id) + " repeated, replaces the earlier line");
+                old->flight->seats.release(old->seat);
+                removeBooking(r.id);
+            }
+            if (!fl->seats.tryClaim(seatIdx)) { report(line, "seat " + string(r.seatNo) + " on " + fl->flightNo + " already taken, skipped"); continue; }
+
+            Passenger p{r.name, r.phone, r.email, r.gender,
+                        static_cast<MealPreference>(r.meal), r.wheelchair, r.luggage};
+            auto pay = make_unique<Payment>(r.amount, static_cast<PaymentMethod>(max(0, r.payMethod)), storedTime(r.bookingTime),
+                                            Str::store(r.txnId));
+            auto booking = make_unique<Booking>(r.id, move(p), fl, seatIdx, move(pay));
+            addBooking(move(booking));
+            reserveBookingId(r.id);
+        }
+        for (; e < chunk.errors.size(); ++e) report(lineBase + chunk.errors[e].line, string(chunk.errors[e].reason) + ", skipped");
+        lineBase += chunk.lines;
+    }
+    munmap(m, len);
+
+    if (problems > MAX_REPORTED) cout << path << ": " << (problems - MAX_REPORTED) << " more problem lines not shown\n";
+    if (declared >= 0 && (size_t)declared != bookingLines) {
+        cout << path << ": header says " << declared << " bookings, file has " << bookingLines << " booking lines\n";
+    }
+    cout << "Previous bookings loaded (" << bookings.size() << ")\n";
+}
+
+// ----------------- Startup -----------------
+void initCatalog() {
+    if (int rules = fareEngine.loadRules(FARES_FILE)) cout << "Loaded " << rules << " fare rules from " << FARES_FILE << "\n";
+    if (int n = layouts.load(LAYOUTS_FILE)) cout << "Loaded " << n << " aircraft layouts from " << LAYOUTS_FILE << "\n";
+    if (catalog.loadSchedule("flights.txt") > 0) {
+        cout << "Loaded " << catalog.size() << " flights from flights.txt\n";
+    } else {
+        auto def = make_unique<Flight>("AI101", "New York", "Los Angeles",
+                                       getCurrentDateTime().substr(0, 10), "10:00 AM", "1:30 PM");
+        def->initDefaultSeats();
+        catalog.add(move(def));
+    }
+    if (int n = routePlanner.loadConnectTimes(CONNECTIONS_FILE)) cout << "Loaded " << n << " connection times from " << CONNECTIONS_FILE << "\n";
+    if (int skipped = routePlanner.build(catalog)) cout << skipped << " flights have unreadable times, left out of connection search\n";
+    currentFlight = catalog.front();
+}
+
+void openStore() {
+    initCatalog();
+    uint32_t gen = loadLatestBookings();
+    if (!cancelledArchive.open(ARCHIVE_FILE)) cout << "Warning: cannot open " << ARCHIVE_FILE << ", cancellations are kept in memory\n";
+    // segments a checkpoint cut off but did not get into a snapshot, oldest first
+    long replayed = 0;
+    for (const auto& seg : journalSegments(JOURNAL_FILE, gen)) {
+        replayed += Journal::replay(seg.second, applyJournalRecord);
+        gen = seg.first;
+    }
+    replayed += Journal::replay(JOURNAL_FILE, applyJournalRecord);
+    checkpointer.setGeneration(gen);
+    cancelledArchive.endReplay();
+    if (replayed > 0) cout << "Replayed " << replayed << " journal records\n";
+    if (!journal.open(JOURNAL_FILE)) cout << "Warning: cannot open " << JOURNAL_FILE << ", changes will not be durable until saved\n";
+}
+
+int convertBookings(const string& mode, const string& in, const string& out) {
+    initCatalog();
+    if (mode == "--to-snapshot") {
+        loadBookingsFromFile(in);
+        return writeSnapshot(out) ? 0 : 1;
+    }
+    if (!snapshot.open(in)) return 1;
+    return saveBookingsToFile(out) ? 0 : 1;
+}
@@ -0,0 +1,2623 @@
+// ams_core.h
+// The booking core: flights, seats, bookings, persistence and the
+// operations on them, with no menu or prompts. Linked into the AMS
+// executable and the benchmark suite (see Makefile).
+#ifndef AMS_CORE_H
+#define AMS_CORE_H
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <map>
+#include <queue>
+#include <deque>
+#include <iomanip>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <memory>
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cmath>
+#include <cstring>
+#include <cerrno>
+#include <limits>
+#include <unordered_map>
+#include <unordered_set>
+#include <chrono>
+#include <cstdio>
+#include <string_view>
+#include <charconv>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <new>
+#include <functional>
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <malloc.h>
+
+using namespace std;
+
+// ----------------- Allocation Counting -----------------
+// Built with -DAMS_COUNT_ALLOCS, every global new is counted so the
+// memory benchmark can report allocations per booking.
+#ifdef AMS_COUNT_ALLOCS
+extern atomic<uint64_t> allocCount;
+#endif
+
+// Bytes currently allocated from the malloc heap, or 0 where unknown
+size_t heapInUse();
+
+// ----------------- String Arena -----------------
+// Booking text (names, contacts, transaction IDs) never changes once
+// written, so it is copied into append-only 64KB chunks rather than one
+// heap string each. Every thread fills its own chunk without locking. A
+// chunk counts the Str handles pointing into it, plus one while a thread
+// is still filling it, and is freed when the count drops to zero: the
+// text of cancelled bookings goes once the archive has freed them and
+// every other booking sharing their chunk is gone too.
+class StringArena {
+    struct alignas(64) Head {
+        atomic<uint32_t> refs;
+        size_t size;
+    };
+    atomic<size_t> total{0};
+
+    static Head* head(const char* p) { return reinterpret_cast<Head*>((uintptr_t)p & ~(uintptr_t)(CHUNK - 1)); }
+public:
+    static const size_t CHUNK = 1 << 16;
+    static const size_t HEAD = sizeof(Head);
+
+    // A chunk with room for n bytes of text after its head, holding one
+    // reference for the caller. Chunks are CHUNK-aligned, so the head of
+    // any text is found by masking its address.
+    char* grab(size_t n) {
+        size_t size = (HEAD + n + CHUNK - 1) & ~(CHUNK - 1);
+        void* mem = aligned_alloc(CHUNK, size);
+        if (!mem) throw bad_alloc();
+        new (mem) Head{ {1}, size };
+        total += size;
+        return static_cast<char*>(mem);
+    }
+    static void retain(const char* p) { head(p)->refs.fetch_add(1, memory_order_relaxed); }
+    void release(const char* p) {
+        Head* h = head(p);
+        if (h->refs.fetch_sub(1, memory_order_acq_rel) != 1) return;
+        total -= h->size;
+        h->~Head();
+        free(h);
+    }
+    size_t bytes() const { return total; }
+};
+
+// Leaked on purpose: Str handles are still released by global destructors.
+StringArena& stringArena();
+
+// The 16-byte handle to arena text. Copies share the text and keep its
+// chunk alive; interned text is never freed, so it is not counted.
+class Str {
+    const char* p = "";
+    uint32_t n = 0;
+    bool counted = false;
+    Str(const char* d, size_t len, bool c) : p(d), n((uint32_t)len), counted(c) {}
+public:
+    Str() = default;
+    Str(const Str& o) : p(o.p), n(o.n), counted(o.counted) { if (counted) StringArena::retain(p); }
+    Str(Str&& o) noexcept : p(o.p), n(o.n), counted(o.counted) { o.p = ""; o.n = 0; o.counted = false; }
+    Str& operator=(Str o) noexcept {
+        swap(p, o.p);
+        swap(n, o.n);
+        swap(counted, o.counted);
+        return *this;
+    }
+    ~Str() { if (counted) stringArena().release(p); }
+
+    static Str store(string_view s);  // private copy
+    static Str intern(string_view s); // one shared copy per distinct value
+
+    string_view view() const { return string_view(p, n); }
+    operator string_view() const { return view(); }
+    string str() const { return string(p, n); }
+    size_t size() const { return n; }
+    bool empty() const { return n == 0; }
+    size_t find(string_view q) const { return view().find(q); }
+};
+
+ostream& operator<<(ostream& os, const Str& s);
+
+// ----------------- Object Pool -----------------
+// Fixed-size blocks carved from 64KB slabs and recycled through a free
+// list, so per-booking objects cost no malloc call and no malloc header.
+template <size_t Size, size_t Align>
+class FixedPool {
+    union Block {
+        Block* next;
+        alignas(Align) unsigned char raw[Size];
+    };
+    static const size_t PER_SLAB = (1 << 16) / sizeof(Block) ? (1 << 16) / sizeof(Block) : 1;
+
+    mutex mu;
+    Block* freeList = nullptr;
+    vector<unique_ptr<Block[]>> slabs;
+public:
+    // Leaked on purpose, like the string arena: global tables free into
+    // it while the program is shutting down.
+    static FixedPool& instance() {
+        static FixedPool* pool = new FixedPool;
+        return *pool;
+    }
+
+    void* alloc() {
+        lock_guard<mutex> lk(mu);
+        if (!freeList) {
+            slabs.emplace_back(new Block[PER_SLAB]);
+            Block* slab = slabs.back().get();
+            for (size_t i = 0; i < PER_SLAB; ++i) {
+                slab[i].next = freeList;
+                freeList = &slab[i];
+            }
+        }
+        Block* b = freeList;
+        freeList = b->next;
+        return b;
+    }
+
+    void release(void* p) {
+        lock_guard<mutex> lk(mu);
+        Block* b = static_cast<Block*>(p);
+        b->next = freeList;
+        freeList = b;
+    }
+};
+
+// Standard allocator over FixedPool for node-based containers; arrays
+// (bucket tables) still go to the global heap.
+template <class T>
+struct PoolAllocator {
+    using value_type = T;
+    PoolAllocator() = default;
+    template <class U> PoolAllocator(const PoolAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        if (n == 1) return static_cast<T*>(FixedPool<sizeof(T), alignof(T)>::instance().alloc());
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+    void deallocate(T* p, size_t n) {
+        if (n == 1) FixedPool<sizeof(T), alignof(T)>::instance().release(p);
+        else ::operator delete(p);
+    }
+    template <class U> bool operator==(const PoolAllocator<U>&) const { return true; }
+    template <class U> bool operator!=(const PoolAllocator<U>&) const { return false; }
+};
+
+// ----------------- Utilities -----------------
+// Times are seconds since the Unix epoch and only turned into local
+// "YYYY-MM-DD HH:MM:SS" text for display and the files; 0 = unknown.
+const size_t TIME_TEXT = 20; // formatted length plus the terminator
+
+// The kernel's coarse clock: no system call, ticks every few milliseconds
+int64_t clockNow();
+
+// Writes the local time without a terminator and returns its length, or 0
+// for an unknown time or a buffer shorter than TIME_TEXT.
+size_t formatTime(int64_t t, char* buf, size_t size);
+string formatTime(int64_t t);
+
+// Reads "YYYY-MM-DD HH:MM:SS" or a prefix of it that ends after a field
+// ("2025", "2025-01-31 10"). The prefix is the first second it covers, or
+// with upper the last one, so both ends of a range can be prefixes.
+bool parseTime(string_view s, int64_t& t, bool upper = false);
+
+// A time read back from a file; 0 when it is missing or unreadable
+inline int64_t storedTime(string_view s) {
+    int64_t t = 0;
+    return parseTime(s, t) ? t : 0;
+}
+
+string getCurrentDateTime();
+
+// Transaction IDs: "TXN" + 16 hex digits naming the process, start
+// second (32 bits) | node (8 bits) | pid (24 bits), + 10 hex digits of
+// sequence (40 bits). The node comes from AMS_NODE_ID (0-255, default 0),
+// so machines differ by node, processes running at once (--serve next to
+// --batch) by pid, and restarts by second or pid. Each thread takes
+// sequence numbers in blocks from a shared counter; the sequence has its
+// own field and never spills into the process part.
+Str newTxnId();
+
+bool isValidEmail(string_view email);
+
+bool isValidPhone(string_view phone);
+
+// Quoted and escaped JSON string
+string jsonString(string_view v);
+
+// Amount with two decimals, as a JSON number
+string jsonMoney(double v);
+
+// Shortest form that reads back the same (ratios, multipliers)
+string jsonNumber(double v);
+
+// ----------------- Metrics -----------------
+// Latency histograms and counters for the core operations. Each thread
+// records into its own block with plain relaxed stores (no locks, no
+// shared cache lines); readers sum the blocks. Histograms are log-linear
+// like HdrHistogram: 16 sub-buckets per power of two, so every latency
+// from 1ns to ~18 minutes is reported within 1/16 of its true value.
+enum MetricOp { M_BOOK, M_CANCEL, M_SEAT_CHANGE, M_WAITLIST_ADD, M_SEARCH, M_SAVE, M_GROUP_BOOK, M_CHECKPOINT_CUT, NUM_METRIC_OPS };
+
+const char* metricOpName(MetricOp op);
+
+class LatencyHistogram {
+public:
+    static const int SUB_BITS = 4;
+    static const int SUB = 1 << SUB_BITS;
+    static const int MAX_EXP = 40; // longer latencies land in the last bucket
+    static const int BUCKETS = (MAX_EXP - SUB_BITS + 1) * SUB;
+
+    static int bucketOf(uint64_t ns) {
+        if (ns < (uint64_t)SUB) return (int)ns;
+        int e = 63 - __builtin_clzll(ns);
+        if (e >= MAX_EXP) return BUCKETS - 1;
+        int shift = e - SUB_BITS;
+        return (shift + 1) * SUB + (int)((ns >> shift) - SUB);
+    }
+    static uint64_t lowestOf(int bucket) {
+        if (bucket < SUB) return (uint64_t)bucket;
+        int shift = bucket / SUB - 1;
+        return (uint64_t)(SUB + bucket % SUB) << shift;
+    }
+    static uint64_t highestOf(int bucket) { return lowestOf(bucket + 1) - 1; }
+};
+
+// One operation summed over every thread
+struct OpStats {
+    uint64_t count = 0;
+    uint64_t failures = 0;
+    uint64_t sumNs = 0;
+    uint64_t maxNs = 0;
+    vector<uint64_t> buckets = vector<uint64_t>(LatencyHistogram::BUCKETS);
+
+    double meanNs() const { return count ? (double)sumNs / count : 0.0; }
+    // Upper bound of the bucket holding the p-th percentile (0-100)
+    uint64_t percentileNs(double p) const;
+};
+
+struct MetricsSnapshot {
+    OpStats ops[NUM_METRIC_OPS];
+    double uptimeSec = 0.0;
+};
+
+void recordMetric(MetricOp op, uint64_t ns, bool ok);
+
+// Sums every thread's counters. Safe while other threads record.
+MetricsSnapshot readMetrics();
+
+// Times its scope and records it on destruction; clear `ok` to count the
+// call as failed.
+class MetricTimer {
+    MetricOp op;
+    chrono::steady_clock::time_point start;
+public:
+    bool ok;
+    explicit MetricTimer(MetricOp o, bool okByDefault = true)
+        : op(o), start(chrono::steady_clock::now()), ok(okByDefault) {}
+    ~MetricTimer() {
+        recordMetric(op, (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count(), ok);
+    }
+    MetricTimer(const MetricTimer&) = delete;
+    MetricTimer& operator=(const MetricTimer&) = delete;
+};
+
+// Admin view: one row per operation, latencies in microseconds
+void writeMetricsTable(ostream& os, const MetricsSnapshot& m);
+
+// Prometheus text exposition format
+void writeMetricsText(ostream& os, const MetricsSnapshot& m);
+
+// Same figures as JSON, plus the non-empty histogram buckets
+void writeMetricsJson(ostream& os, const MetricsSnapshot& m);
+
+// Writes JSON for *.json paths, the text format otherwise. The file is
+// replaced atomically so a scraper never reads half of it.
+bool exportMetrics(const string& path);
+
+// ----------------- Enums -----------------
+enum MealPreference { VEGETARIAN = 0, NON_VEG = 1, VEGAN = 2, NO_MEAL = 3 };
+enum PaymentMethod { CREDIT_CARD = 0, DEBIT_CARD = 1, UPI = 2, CASH = 3 };
+
+// ----------------- Passenger -----------------
+struct Passenger {
+    Str name;
+    Str phone;
+    Str email;
+    Str gender; // interned: a handful of distinct values
+    MealPreference meal = NO_MEAL;
+    bool wheelchair = false;
+    int luggageKg = 0;
+
+    Passenger() = default;
+    Passenger(string_view n, string_view p, string_view e, string_view g, MealPreference m, bool w, int l)
+        : name(Str::store(n)), phone(Str::store(p)), email(Str::store(e)), gender(Str::intern(g)),
+          meal(m), wheelchair(w), luggageKg(l) {}
+
+    string mealString() const { return mealString(meal); }
+    static string mealString(MealPreference meal) {
+        switch (meal) {
+            case VEGETARIAN: return "Vegetarian";
+            case NON_VEG: return "Non-Veg";
+            case VEGAN: return "Vegan";
+            default: return "No Meal";
+        }
+    }
+
+    void displayFull() const {
+        cout << "Name: " << name << ", Phone: " << phone;
+        if (!email.empty()) cout << ", Email: " << email;
+        if (!gender.empty()) cout << ", Gender: " << gender;
+        cout << "\nMeal: " << mealString();
+        cout << ", Wheelchair: " << (wheelchair ? "YES" : "NO");
+        cout << ", Luggage: " << luggageKg << "kg\n";
+    }
+
+    void displayLimited() const {
+        cout << "Name: " << name << ", Phone: " << phone << "\n";
+    }
+};
+
+// ----------------- Seats -----------------
+enum SeatClass : uint8_t { ECONOMY = 0, BUSINESS = 1, FIRST_CLASS = 2 };
+enum SeatPref : uint8_t { WINDOW = 0, AISLE = 1, MIDDLE = 2 };
+const int NUM_SEAT_CLASSES = 3;
+const int NUM_SEAT_PREFS = 3;
+
+const char* seatClassString(SeatClass c);
+
+const char* seatPrefString(SeatPref p);
+
+// Fare multiplier applied to a seat's base price for each class
+const double CLASS_FARE_MULTIPLIER[NUM_SEAT_CLASSES] = { 1.0, 2.0, 3.0 };
+
+// Immutable cabin layout in structure-of-arrays form. A seat is a slot
+// index; class/preference filters are bitsets parallel to the slots. Built
+// once and shared (read-only) by every flight flying the same aircraft.
+class SeatLayout {
+    static size_t words(size_t n) { return (n + 63) / 64; }
+    static void setBit(vector<uint64_t>& bits, int i) { bits[i >> 6] |= (uint64_t(1) << (i & 63)); }
+public:
+    static const int LETTERS = 26;
+
+    string name;
+    vector<uint16_t> row;
+    vector<char> letter;
+    vector<SeatClass> cls;
+    vector<SeatPref> pref;
+    vector<double> price;                       // fare incl. class multiplier
+    vector<uint64_t> classMask[NUM_SEAT_CLASSES];
+    vector<uint64_t> prefMask[NUM_SEAT_PREFS];
+    vector<int16_t> slotIndex;                  // row * LETTERS + (letter - 'A') -> slot, -1 if none
+    vector<uint16_t> rowNumbers;                // distinct rows, ascending
+    vector<uint16_t> rowPos;                    // slot -> index into rowNumbers
+    // Per row position: first slot and seat count. When every row's seats
+    // were added together, letters ascending (rowSpans), a row is the
+    // slots rowFirst .. rowFirst + rowCount - 1, side by side in that order.
+    vector<int> rowFirst;
+    vector<uint8_t> rowCount;
+    bool rowSpans = true;
+    char lastLetter = 'A';
+
+    explicit SeatLayout(string n = "") : name(move(n)) {}
+
+    int size() const { return (int)row.size(); }
+    int wordCount() const { return (int)words(row.size()); }
+
+    int add(int r, char l, SeatClass c, SeatPref p, double basePrice) {
+        int i = size();
+        row.push_back((uint16_t)r);
+        letter.push_back(l);
+        cls.push_back(c);
+        pref.push_back(p);
+        price.push_back(basePrice * CLASS_FARE_MULTIPLIER[c]);
+        size_t w = words(i + 1);
+        for (auto& m : classMask) m.resize(w, 0);
+        for (auto& m : prefMask) m.resize(w, 0);
+        setBit(classMask[c], i);
+        setBit(prefMask[p], i);
+
+        size_t key = (size_t)r * LETTERS + (l - 'A');
+        if (slotIndex.size() <= key) slotIndex.resize((size_t)(r + 1) * LETTERS, -1);
+        slotIndex[key] = (int16_t)i;
+
+        auto at = lower_bound(rowNumbers.begin(), rowNumbers.end(), (uint16_t)r);
+        uint16_t pos = (uint16_t)(at - rowNumbers.begin());
+        if (at == rowNumbers.end() || *at != r) {
+            rowNumbers.insert(at, (uint16_t)r);
+            for (uint16_t& p : rowPos) if (p >= pos) p++;
+            rowFirst.insert(rowFirst.begin() + pos, i);
+            rowCount.insert(rowCount.begin() + pos, 1);
+        } else {
+            // same row: only a continuation of the previous slot keeps the span
+            if (row[i - 1] != r || letter[i - 1] >= l) rowSpans = false;
+            rowCount[pos]++;
+        }
+        rowPos.push_back(pos);
+        lastLetter = max(lastLetter, l);
+        return i;
+    }
+
+    int find(int r, char l) const {
+        if (r < 0 || l < 'A' || l > 'Z') return -1;
+        size_t key = (size_t)r * LETTERS + (l - 'A');
+        return key < slotIndex.size() ? slotIndex[key] : -1;
+    }
+
+    // Decodes "12C" arithmetically; O(1) in the size of the cabin.
+    int find(string_view code) const {
+        size_t n = code.size();
+        if (n < 2 || n > 5) return -1;
+        char l = code[n-1];
+        if (l < 'A' || l > 'Z') return -1;
+        size_t r = 0;
+        for (size_t k = 0; k + 1 < n; ++k) {
+            if (code[k] < '0' || code[k] > '9') return -1;
+            r = r * 10 + (code[k] - '0');
+        }
+        size_t key = r * LETTERS + (l - 'A');
+        return key < slotIndex.size() ? slotIndex[key] : -1;
+    }
+
+    string code(int i) const { return to_string(row[i]) + letter[i]; }
+
+    // Aisles in row position r of a rowSpans layout: bit k set when one
+    // runs between the row's k-th and (k+1)-th seats. Read from the
+    // preferences: an aisle seat faces a neighbouring aisle seat, else the
+    // open end of the row, else the neighbour that is not a middle seat
+    // (the later one if neither is).
+    uint32_t aisleBreaks(int r) const {
+        int first = rowFirst[r], count = rowCount[r];
+        uint32_t out = 0;
+        for (int k = 0; k < count; ++k) {
+            if (pref[first + k] != AISLE) continue;
+            if (k == 0 || k + 1 == count) {
+                if (k + 1 < count && pref[first + k + 1] == AISLE) out |= 1u << k;
+                continue;
+            }
+            SeatPref left = pref[first + k - 1], right = pref[first + k + 1];
+            if (left == AISLE) continue; // already split on the neighbour's turn
+            if (right == AISLE || right != MIDDLE) out |= 1u << k;
+            else if (left != MIDDLE) out |= 1u << (k - 1);
+        }
+        return out;
+    }
+};
+
+// Start of this process's seat-map versions (microseconds since the Unix
+// epoch at first use), so a version kept by a client across a restart is
+// never taken for a current one.
+uint64_t seatMapEpoch();
+
+// Per-flight seat state on top of a shared layout: just the availability bits.
+// Bits are read and written atomically, so any number of threads can claim
+// and release seats concurrently; a seat is sold by whoever clears its bit.
+//
+// Every claim or release is also numbered as a seat-map change, after the
+// bit has flipped. The map's version is seatMapEpoch() plus the number of
+// changes; pollers ask for the seats changed since the version they last
+// saw, and the text map is re-rendered only for rows changed since.
+class SeatStore {
+    shared_ptr<const SeatLayout> shape;
+    mutable mutex mapMu;                        // guards everything below
+    uint32_t changes = 0;
+    vector<uint32_t> seatChangedAt;             // per slot: last change to it
+    vector<uint32_t> rowChangedAt;              // per row position
+    mutable vector<uint32_t> rowRenderedAt;     // these two are sized on first render:
+    mutable vector<string> rowText;             // most flights are never drawn as text
+
+    void noteChange(int i) {
+        lock_guard<mutex> lk(mapMu);
+        seatChangedAt[i] = rowChangedAt[shape->rowPos[i]] = ++changes;
+    }
+public:
+    vector<uint64_t> available;                 // bit set = seat free
+
+    void reset(shared_ptr<const SeatLayout> l) {
+        shape = move(l);
+        {
+            lock_guard<mutex> lk(mapMu);
+            changes = 0;
+            seatChangedAt.assign(shape->size(), 0);
+            rowChangedAt.assign(shape->rowNumbers.size(), 0);
+            vector<uint32_t>().swap(rowRenderedAt);
+            vector<string>().swap(rowText);
+        }
+        available.assign(shape->wordCount(), 0);
+        for (int i = 0; i < shape->size(); ++i) setBooked(i, false);
+    }
+
+    const SeatLayout& layout() const { return *shape; }
+    const shared_ptr<const SeatLayout>& layoutPtr() const { return shape; }
+    int size() const { return shape ? shape->size() : 0; }
+    SeatClass cls(int i) const { return shape->cls[i]; }
+    SeatPref pref(int i) const { return shape->pref[i]; }
+    double price(int i) const { return shape->price[i]; }
+    string code(int i) const { return shape->code(i); }
+    int find(string_view code) const { return shape->find(code); }
+
+    uint64_t word(size_t w) const { return __atomic_load_n(&available[w], __ATOMIC_ACQUIRE); }
+    bool isBooked(int i) const { return !((word(i >> 6) >> (i & 63)) & 1); }
+
+    // Takes seat i if it is free. Of any number of concurrent callers for
+    // the same seat exactly one gets true.
+    bool tryClaim(int i) {
+        uint64_t bit = uint64_t(1) << (i & 63);
+        if (!(__atomic_fetch_and(&available[i >> 6], ~bit, __ATOMIC_ACQ_REL) & bit)) return false;
+        noteChange(i);
+        return true;
+    }
+    void release(int i) {
+        uint64_t bit = uint64_t(1) << (i & 63);
+        if (!(__atomic_fetch_or(&available[i >> 6], bit, __ATOMIC_ACQ_REL) & bit)) noteChange(i);
+    }
+    void setBooked(int i, bool booked) {
+        if (booked) tryClaim(i);
+        else release(i);
+    }
+
+    // Takes every slot or none. Slots sharing a 64-bit word (a row's seats
+    // usually do) are taken by one compare-and-swap; if a later word
+    // fails, the words already taken are given back.
+    bool tryClaimAll(vector<int> slots);
+
+    // Picks n free seats of class c for a party: n side by side in one
+    // row if any row has them (preferring a block that includes a seat of
+    // preference p, when p >= 0), else the free seats nearest the row with
+    // the most. Seats side by side have no aisle between them (see
+    // SeatLayout::aisleBreaks). Sets `together` accordingly. False if fewer
+    // than n are free. Nothing is claimed; see tryClaimAll.
+    bool findGroup(SeatClass c, int p, int n, vector<int>& slots, bool& together) const;
+
+    // Calls fn(slot) for every free seat of class c, optionally restricted
+    // to one preference (pref < 0 means any).
+    template <class Fn>
+    void forEachAvailable(SeatClass c, int p, Fn fn) const {
+        const vector<uint64_t>& cm = shape->classMask[c];
+        for (size_t w = 0; w < available.size(); ++w) {
+            uint64_t bits = word(w) & cm[w];
+            if (p >= 0) bits &= shape->prefMask[p][w];
+            while (bits) {
+                int b = __builtin_ctzll(bits);
+                fn((int)(w * 64 + b));
+                bits &= bits - 1;
+            }
+        }
+    }
+
+    int countAvailable(SeatClass c) const {
+        int n = 0;
+        const vector<uint64_t>& cm = shape->classMask[c];
+        for (size_t w = 0; w < available.size(); ++w) n += __builtin_popcountll(word(w) & cm[w]);
+        return n;
+    }
+
+    int countAvailable() const {
+        int n = 0;
+        for (size_t w = 0; w < available.size(); ++w) n += __builtin_popcountll(word(w));
+        return n;
+    }
+
+    uint64_t version() const {
+        lock_guard<mutex> lk(mapMu);
+        return seatMapEpoch() + changes;
+    }
+
+    // Appends the slots changed after version `since` and returns the
+    // current version. Every slot is listed, and `full` set, when `since`
+    // is not a version of this map. Read the seats' state after the call:
+    // a change is numbered only once its bit has flipped.
+    uint64_t changesSince(uint64_t since, vector<int>& slots, bool& full) const;
+
+    // Appends the seat map as text ("[X]" booked, "[A]" free), one line
+    // per row under a letter header. Only rows changed since they were
+    // last rendered are rebuilt.
+    void render(string& out) const;
+
+    void display(int i) const { display(i, price(i)); }
+    void display(int i, double fare) const {
+        cout << left << setw(6) << code(i) << setw(12) << seatClassString(cls(i)) << setw(10) << seatPrefString(pref(i))
+             << "$" << fixed << setprecision(2) << setw(8) << fare
+             << (isBooked(i) ? "BOOKED" : "AVAILABLE") << "\n";
+    }
+};
+
+// The 33-seat cabin every flight used to build for itself
+shared_ptr<const SeatLayout> defaultSeatLayout();
+
+// ----------------- Aircraft Layouts -----------------
+// Named cabin layouts, read once from layouts.txt and shared by every
+// flight that flies them; a flight holds only its seat bits and a pointer.
+// File format, one cabin per line after the layout it belongs to:
+//   layout|name
+//   cabin|class|firstRow-lastRow|letters|prefs|baseFare
+// `class` is 0/1/2 as in bookings.txt and `prefs` has one of W/A/M per
+// letter, e.g. `cabin|0|10-40|ABCDEFGHJK|WMAAMMAAMW|100`.
+class LayoutLibrary {
+    unordered_map<string, shared_ptr<const SeatLayout>> byName;
+public:
+    // Returns the number of layouts read. A layout with a malformed cabin
+    // line is reported and left out, so no flight is sold a partial cabin.
+    int load(const string& path);
+
+    // nullptr if unknown; "default" is defaultSeatLayout() unless the file
+    // defines its own.
+    shared_ptr<const SeatLayout> find(const string& name) const;
+
+    size_t size() const { return byName.size(); }
+};
+
+extern LayoutLibrary layouts;
+const string LAYOUTS_FILE = "layouts.txt";
+
+// ----------------- Fares -----------------
+// Every fare shown or charged comes from the fare engine: the layout's
+// list price per seat (base x class multiplier), times a multiplier picked
+// by how full the flight is, plus the luggage fee. Rules are set once at
+// startup and only read afterwards.
+
+// Luggage up to freeKg is included; each kg over it costs perKg
+struct LuggageRule {
+    int freeKg = 20;
+    double perKg = 10.0;
+
+    double fee(int kg) const { return kg > freeKg ? (kg - freeKg) * perKg : 0.0; }
+};
+
+// Fares are multiplied by `multiplier` once at least `load` (0..1) of the
+// flight's seats are sold
+struct LoadBand {
+    double load;
+    double multiplier;
+};
+
+struct FareRules {
+    LuggageRule luggage;
+    vector<LoadBand> bands; // ascending load; none = list prices
+};
+
+// One flight priced at its current load
+struct FareQuote {
+    double load = 0.0;
+    double multiplier = 1.0;
+    vector<double> fare;                    // per slot, sold seats included
+    int available[NUM_SEAT_CLASSES] = {};
+    double lowest[NUM_SEAT_CLASSES] = {};   // cheapest free seat, 0 if none
+};
+
+class FareEngine {
+    FareRules rules;
+public:
+    // Rule file, one rule per line ('#' starts a comment):
+    //   luggage|freeKg|perKg
+    //   load|fraction sold|multiplier
+    // Returns the number of rules read; a missing file keeps the defaults.
+    int loadRules(const string& path);
+    void setRules(FareRules r);
+    const FareRules& current() const { return rules; }
+
+    double luggageFee(int kg) const { return rules.luggage.fee(kg); }
+    double multiplierAt(double load) const;
+    double multiplier(const SeatStore& seats) const {
+        int n = seats.size();
+        return n ? multiplierAt((double)(n - seats.countAvailable()) / n) : 1.0;
+    }
+    double seatFare(const SeatStore& seats, int i) const { return seats.price(i) * multiplier(seats); }
+
+    // Prices every seat of the flight in one pass over the layout's price
+    // column; the FareQuote's buffers are reused across calls.
+    void quote(const SeatStore& seats, FareQuote& q) const;
+};
+
+extern FareEngine fareEngine;
+const string FARES_FILE = "fares.txt";
+
+// ----------------- Report Aggregates -----------------
+// Running revenue/count/meal totals kept current by the booking store, so
+// reports never rescan bookings. One per flight plus one catalog-wide.
+struct ReportStats {
+    double revenue[NUM_SEAT_CLASSES] = {};
+    int count[NUM_SEAT_CLASSES] = {};
+    int meals[4] = {};
+
+    void apply(SeatClass c, double amount, MealPreference m, int sign) {
+        revenue[c] += sign * amount;
+        count[c] += sign;
+        meals[m] += sign;
+    }
+
+    int booked() const { return count[ECONOMY] + count[BUSINESS] + count[FIRST_CLASS]; }
+    double totalRevenue() const { return revenue[ECONOMY] + revenue[BUSINESS] + revenue[FIRST_CLASS]; }
+
+    // Revenue is compared with a tolerance since it is a running sum of doubles
+    bool matches(const ReportStats& o) const {
+        for (int c = 0; c < NUM_SEAT_CLASSES; ++c) {
+            if (count[c] != o.count[c]) return false;
+            if (fabs(revenue[c] - o.revenue[c]) > 1e-6 * max(1.0, fabs(o.revenue[c]))) return false;
+        }
+        for (int m = 0; m < 4; ++m) if (meals[m] != o.meals[m]) return false;
+        return true;
+    }
+};
+
+// ----------------- Waitlist -----------------
+// Passengers waiting for a seat on one flight, queued per class and seat
+// preference ("any" being a queue of its own). Within a queue the order is
+// priority tier (wheelchair assistance first), then arrival. A freed seat
+// goes to the better head of two queues, its own preference and "any", so
+// handing it out is O(log n) however deep the list is.
+struct WaitlistEntry {
+    Passenger passenger;
+    SeatClass cls = ECONOMY;
+    int pref = -1;              // SeatPref, or -1 for any
+    PaymentMethod method = CASH; // charged when a seat is assigned
+    uint64_t arrival = 0;       // set by add()
+};
+
+class Waitlist {
+    using Key = pair<int, uint64_t>; // tier, arrival
+    using Queue = map<Key, WaitlistEntry>;
+    static const int ANY = NUM_SEAT_PREFS;
+    Queue queues[NUM_SEAT_CLASSES][NUM_SEAT_PREFS + 1];
+    size_t waiting[NUM_SEAT_CLASSES][2] = {}; // per class and tier
+    uint64_t arrivals = 0;
+    mutable mutex mu;
+
+    static int tierOf(const Passenger& p) { return p.wheelchair ? 0 : 1; }
+    static Key keyOf(const WaitlistEntry& e) { return { tierOf(e.passenger), e.arrival }; }
+    void insert(WaitlistEntry e) {
+        Key k = keyOf(e);
+        waiting[e.cls][k.first]++;
+        queues[e.cls][e.pref < 0 ? ANY : e.pref].emplace(k, move(e));
+    }
+public:
+    // Queues e; returns its place among everyone waiting for the class.
+    size_t add(WaitlistEntry e) {
+        MetricTimer timer(M_WAITLIST_ADD);
+        lock_guard<mutex> lk(mu);
+        e.arrival = ++arrivals;
+        size_t place = waiting[e.cls][0] + (tierOf(e.passenger) ? waiting[e.cls][1] : 0) + 1;
+        insert(move(e));
+        return place;
+    }
+
+    // Moves the passenger first in line for a seat of class c and
+    // preference p into out. False if nobody wants such a seat.
+    bool takeNext(SeatClass c, SeatPref p, WaitlistEntry& out) {
+        lock_guard<mutex> lk(mu);
+        Queue* from = nullptr;
+        for (Queue* q : { &queues[c][p], &queues[c][ANY] }) {
+            if (!q->empty() && (!from || q->begin()->first < from->begin()->first)) from = q;
+        }
+        if (!from) return false;
+        waiting[c][from->begin()->first.first]--;
+        out = move(from->begin()->second);
+        from->erase(from->begin());
+        return true;
+    }
+
+    // Puts an entry from takeNext() back in its old place
+    void restore(WaitlistEntry e) {
+        lock_guard<mutex> lk(mu);
+        insert(move(e));
+    }
+
+    size_t size(SeatClass c) const {
+        lock_guard<mutex> lk(mu);
+        return waiting[c][0] + waiting[c][1];
+    }
+    size_t size() const { return size(ECONOMY) + size(BUSINESS) + size(FIRST_CLASS); }
+    bool empty() const { return size() == 0; }
+
+    void clear() {
+        lock_guard<mutex> lk(mu);
+        for (auto& byClass : queues) for (Queue& q : byClass) q.clear();
+        memset(waiting, 0, sizeof(waiting));
+    }
+
+    // Lists each class in the order seats would be handed out, merging
+    // the preference queues in place.
+    void display() const {
+        if (empty()) { cout << "Waitlist is empty\n"; return; }
+        lock_guard<mutex> lk(mu);
+        cout << "\n=== WAITLIST ===\n";
+        for (int c = 0; c < NUM_SEAT_CLASSES; ++c) {
+            Queue::const_iterator at[NUM_SEAT_PREFS + 1];
+            for (int q = 0; q <= ANY; ++q) at[q] = queues[c][q].begin();
+            for (int pos = 1; ; ++pos) {
+                int best = -1;
+                for (int q = 0; q <= ANY; ++q) {
+                    if (at[q] != queues[c][q].end() && (best < 0 || at[q]->first < at[best]->first)) best = q;
+                }
+                if (best < 0) break;
+                if (pos == 1) cout << seatClassString((SeatClass)c) << ":\n";
+                const WaitlistEntry& e = at[best]->second;
+                cout << "  " << pos << ". " << e.passenger.name << " ("
+                     << (e.pref < 0 ? "any seat" : seatPrefString((SeatPref)e.pref))
+                     << (e.passenger.wheelchair ? ", wheelchair" : "") << ")\n";
+                ++at[best];
+            }
+        }
+    }
+};
+
+// ----------------- Flight -----------------
+class Flight {
+public:
+    string flightNo;
+    string src, dest;
+    string date; // YYYY-MM-DD
+    string depTime, arrTime;
+    SeatStore seats;
+    ReportStats stats;
+    mutex statsMu; // guards stats
+    Waitlist waitlist;
+
+    Flight() = default;
+    Flight(string f, string s, string d, string dt, string dep, string arr)
+        : flightNo(move(f)), src(move(s)), dest(move(d)), date(move(dt)), depTime(move(dep)), arrTime(move(arr)) {}
+
+    void initDefaultSeats() { seats.reset(layouts.find("default")); }
+
+    // Returns the seat slot for a code like "7A", or -1.
+    int findSeat(string_view seatNo) const { return seats.find(seatNo); }
+
+    void displayInfo() const {
+        cout << flightNo << " : " << src << " -> " << dest << " | " << date
+             << " | Dep: " << depTime << " Arr: " << arrTime << "\n";
+    }
+
+    void displaySeatMap() const {
+        string text;
+        seats.render(text);
+        cout << "\n========== SEAT MAP ==========\n" << text << "\n[X] = Booked, [Letter] = Available\n";
+    }
+};
+
+// ----------------- Flight Catalog -----------------
+// Owns every scheduled flight. Flight numbers are unique within the catalog;
+// flights are heap-allocated once so Flight* handed out stays valid.
+class FlightCatalog {
+    vector<unique_ptr<Flight>> flights;
+    unordered_map<string, Flight*> byNumber;
+    unordered_map<string, vector<Flight*>> byRoute; // key: src|dest|date
+    int seatCount = 0;
+
+    static string routeKey(const string& src, const string& dest, const string& date) {
+        return src + "|" + dest + "|" + date;
+    }
+public:
+    // Returns nullptr if the flight number is already taken.
+    Flight* add(unique_ptr<Flight> f) {
+        if (byNumber.count(f->flightNo)) return nullptr;
+        Flight* raw = f.get();
+        byNumber[raw->flightNo] = raw;
+        byRoute[routeKey(raw->src, raw->dest, raw->date)].push_back(raw);
+        seatCount += raw->seats.size();
+        flights.push_back(move(f));
+        return raw;
+    }
+
+    Flight* find(const string& flightNo) const {
+        auto it = byNumber.find(flightNo);
+        return it == byNumber.end() ? nullptr : it->second;
+    }
+
+    const vector<Flight*>& findRoute(const string& src, const string& dest, const string& date) const {
+        static const vector<Flight*> none;
+        auto it = byRoute.find(routeKey(src, dest, date));
+        return it == byRoute.end() ? none : it->second;
+    }
+
+    size_t size() const { return flights.size(); }
+    int totalSeats() const { return seatCount; }
+    bool empty() const { return flights.empty(); }
+    Flight* front() const { return flights.empty() ? nullptr : flights.front().get(); }
+    const vector<unique_ptr<Flight>>& all() const { return flights; }
+
+    // Schedule format per line: flightNo|src|dest|date|depTime|arrTime[|layout]
+    // naming a layout from layouts.txt; without one a flight gets the
+    // default layout. Returns number of flights added.
+    int loadSchedule(const string& path) {
+        ifstream f(path);
+        if (!f) return 0;
+        int added = 0, lineNo = 0;
+        string line;
+        while (getline(f, line)) {
+            lineNo++;
+            if (line.empty() || line[0] == '#') continue;
+            vector<string> parts;
+            string token;
+            stringstream ss(line);
+            while (getline(ss, token, '|')) parts.push_back(token);
+            if (parts.size() < 6) {
+                cout << "Schedule line " << lineNo << " malformed, skipped\n";
+                continue;
+            }
+            auto layout = layouts.find(parts.size() > 6 && !parts[6].empty() ? parts[6] : "default");
+            if (!layout) {
+                cout << "Schedule line " << lineNo << ": unknown layout " << parts[6] << ", skipped\n";
+                continue;
+            }
+            auto fl = make_unique<Flight>(parts[0], parts[1], parts[2], parts[3], parts[4], parts[5]);
+            fl->seats.reset(move(layout));
+            if (add(move(fl))) added++;
+            else cout << "Schedule line " << lineNo << ": duplicate flight " << parts[0] << ", skipped\n";
+        }
+        return added;
+    }
+};
+
+// ----------------- Itineraries -----------------
+// Connections over the whole schedule. Each flight is an edge of a
+// time-expanded graph, from its departure at src to its arrival at dest,
+// with times in minutes since 1970-01-01 in the schedule's (local) clock;
+// an arrival earlier in the day than the departure is on the next day.
+// A flight can follow one into its departure airport if it leaves at
+// least that airport's minimum connection time after the arrival and
+// within the query's longest layover.
+
+struct Itinerary {
+    vector<Flight*> legs;
+    int departs = 0, arrives = 0;   // minutes, first departure / last arrival
+    double fare = 0;                // cheapest free seat of the class, summed over legs
+};
+
+struct RouteQuery {
+    string from, to;
+    string date;                    // YYYY-MM-DD the first leg departs
+    SeatClass cls = ECONOMY;        // every leg needs a free seat of this class
+    int count = 5;                  // itineraries wanted
+    int maxLegs = 3;
+    int maxLayover = 12 * 60;       // minutes
+    bool byFare = false;            // cheapest first, else earliest arrival
+};
+
+class RoutePlanner {
+    struct Leg {
+        int from, to;               // airport ids
+        int dep, arr;
+        Flight* flight;
+    };
+    vector<Leg> legs;               // by departure airport, then departure time
+    vector<int> firstLeg;           // airport id -> first index into legs; one extra at the end
+    vector<int> connectMinutes;     // airport id -> minimum connection time
+    unordered_map<string, int> airportIds;
+    unordered_map<string, int> connectOverrides;
+public:
+    int defaultConnect = 45;        // minutes, where connections.txt names no time
+
+    // Indexes the catalog's flights; call again after it changes. Flights
+    // whose date or times do not parse are left out and counted.
+    int build(const FlightCatalog& cat);
+
+    // connections.txt: `airport|minutes` per line. Read before build().
+    int loadConnectTimes(const string& path);
+
+    // Up to q.count itineraries, best first; false if an airport is unknown
+    // or the date does not parse. Seat availability is read live, so
+    // results reflect the seats free at the time of the search.
+    bool search(const RouteQuery& q, vector<Itinerary>& out) const;
+
+    size_t flightCount() const { return legs.size(); }
+    size_t airportCount() const { return airportIds.size(); }
+};
+
+extern RoutePlanner routePlanner;
+const string CONNECTIONS_FILE = "connections.txt";
+
+// {"departs","arrives","minutes","stops","fare","legs":[...]}, times as
+// "YYYY-MM-DD HH:MM" in the schedule's clock
+string itineraryJson(const Itinerary& it);
+
+// ----------------- Payment -----------------
+struct Payment {
+    double amount = 0.0;
+    PaymentMethod method = CASH;
+    Str txnId;
+    int64_t paidAt = 0; // epoch seconds
+    double luggageFee = -1.0; // part of amount; set by the booking when below 0
+
+    Payment() = default;
+    Payment(double a, PaymentMethod m) : Payment(a, m, clockNow()) {}
+    Payment(double a, PaymentMethod m, int64_t when) : Payment(a, m, when, newTxnId()) {}
+    // A stored payment; an empty txn (older files) gets a new ID
+    Payment(double a, PaymentMethod m, int64_t when, Str txn)
+        : amount(a), method(m), txnId(txn.empty() ? newTxnId() : txn), paidAt(when) {}
+
+    static void* operator new(size_t) { return FixedPool<sizeof(Payment), alignof(Payment)>::instance().alloc(); }
+    static void operator delete(void* p) { FixedPool<sizeof(Payment), alignof(Payment)>::instance().release(p); }
+
+    string methodStr() const { return methodStr(method); }
+    static string methodStr(PaymentMethod method) {
+        switch (method) {
+            case CREDIT_CARD: return "Credit Card";
+            case DEBIT_CARD: return "Debit Card";
+            case UPI: return "UPI";
+            case CASH: return "Cash";
+            default: return "Unknown";
+        }
+    }
+
+    void printReceipt() const {
+        cout << "\n========== PAYMENT RECEIPT ==========\n";
+        cout << "Transaction ID: " << txnId << "\n";
+        cout << "Amount: $" << fixed << setprecision(2) << amount << "\n";
+        cout << "Method: " << methodStr() << "\n";
+        cout << "Time: " << formatTime(paidAt) << "\n";
+        cout << "=====================================\n";
+    }
+};
+
+// ----------------- Booking -----------------
+struct Booking {
+    int id;
+    Passenger passenger;
+    Flight* flight = nullptr; // owning flight in the catalog
+    int seat = -1; // slot in flight->seats
+    unique_ptr<Payment> payment;
+    int64_t bookedAt = 0; // epoch seconds
+    bool cancelled = false;
+    uint32_t savedEpoch = 0; // last checkpoint that copied it or began before it existed
+
+    Booking() = default;
+    // The booking is stamped with its payment's time.
+    Booking(int i, Passenger p, Flight* f, int s, unique_ptr<Payment> pay)
+        : id(i), passenger(move(p)), flight(f), seat(s), payment(move(pay)),
+          bookedAt(payment ? payment->paidAt : clockNow()), cancelled(false) {
+        if (payment && payment->luggageFee < 0) payment->luggageFee = fareEngine.luggageFee(passenger.luggageKg);
+    }
+
+    static void* operator new(size_t) { return FixedPool<sizeof(Booking), alignof(Booking)>::instance().alloc(); }
+    static void operator delete(void* p) { FixedPool<sizeof(Booking), alignof(Booking)>::instance().release(p); }
+
+    bool hasSeat() const { return flight && seat >= 0; }
+    string seatNo() const { return hasSeat() ? flight->seats.code(seat) : string("NONE"); }
+    SeatClass seatClass() const { return flight->seats.cls(seat); }
+    // What was charged, split into seat fare and the luggage fee fixed when
+    // it was booked; the seat's list price and the luggage rule when there
+    // is no payment
+    double luggageFee() const { return payment ? payment->luggageFee : fareEngine.luggageFee(passenger.luggageKg); }
+    double fare() const {
+        if (!hasSeat()) return 0.0;
+        return payment ? max(0.0, payment->amount - luggageFee()) : flight->seats.price(seat);
+    }
+
+    double totalAmount() const {
+        if (!hasSeat()) return 0.0;
+        return payment ? payment->amount : fare() + luggageFee();
+    }
+
+    void displayLimited() const {
+        cout << "\n--- Booking #" << id << " ---\n";
+        passenger.displayLimited();
+        if (flight) cout << "Flight: " << flight->flightNo << " (" << flight->date << ")\n";
+        if (hasSeat()) cout << "Seat: " << seatNo() << " (" << seatClassString(seatClass()) << ")\n";
+        cout << (cancelled ? "Status: CANCELLED\n" : "Status: CONFIRMED\n");
+    }
+
+    void displayFull() const {
+        cout << "\n========== BOOKING DETAILS ==========\n";
+        cout << "Booking ID: #" << id << "\n";
+        cout << "Status: " << (cancelled ? "CANCELLED" : "CONFIRMED") << "\n";
+        cout << "Booking Time: " << formatTime(bookedAt) << "\n\n";
+        if (flight) {
+            cout << "--- Flight Info ---\n";
+            flight->displayInfo();
+            cout << "\n";
+        }
+        cout << "--- Passenger Info ---\n";
+        passenger.displayFull();
+        cout << "\n--- Seat Info ---\n";
+        if (hasSeat()) flight->seats.display(seat);
+        cout << "\n--- Payment Info ---\n";
+        if (payment) {
+            cout << "Base Fare: $" << fixed << setprecision(2) << fare() << "\n";
+            if (luggageFee() > 0) cout << "Extra Luggage: $" << luggageFee() << "\n";
+            cout << "Total: $" << totalAmount() << "\n";
+            cout << "Payment Method: " << payment->methodStr() << "\n";
+            cout << "Transaction ID: " << payment->txnId << "\n";
+        }
+        cout << "=====================================\n";
+    }
+
+    void printBoardingPass() const {
+        cout << "\n------------------------------------------\n";
+        cout << "--         BOARDING PASS                  --\n";
+        cout << "-----------------------------------------------\n";
+        cout << " Booking ID: " << left << setw(27) << id << "\n";
+        cout << " Passenger: " << left << setw(28) << passenger.name << "\n";
+        cout << " Flight: " << left << setw(31) << (flight ? flight->flightNo + " " + flight->date : string("N/A")) << "\n";
+        cout << " Seat: " << left << setw(33) << (hasSeat() ? seatNo() : string("N/A")) << "\n";
+        cout << " Class: " << left << setw(32) << (hasSeat() ? seatClassString(seatClass()) : "N/A") << "\n";
+        cout << " Meal: " << left << setw(33) << passenger.mealString() << "║\n";
+        cout << "------------------------------------------------------\n";
+    }
+};
+
+// ----------------- Search Index -----------------
+// Inverted trigram index over passenger name, phone and email. Postings are
+// sorted booking IDs, so a substring query intersects the postings of its
+// trigrams and only verifies the surviving candidates. Removal is lazy:
+// stale IDs stay in the postings (callers verify candidates anyway) until
+// they make up half of all entries, then the lists are compacted. Safe to
+// use from several threads; one mutex guards everything.
+class SearchIndex {
+    mutable mutex mu;
+    unordered_map<uint32_t, vector<int>> postings;
+    unordered_set<int> removed; // IDs whose postings are stale
+    size_t entries = 0; // total postings, live and stale
+    size_t stale = 0;
+
+    static uint32_t gram(const char* p) {
+        return (uint32_t)(unsigned char)p[0] << 16 | (uint32_t)(unsigned char)p[1] << 8 | (unsigned char)p[2];
+    }
+    static void collect(string_view text, vector<uint32_t>& out) {
+        for (size_t i = 0; i + 3 <= text.size(); ++i) out.push_back(gram(text.data() + i));
+    }
+    // Fills g with the passenger's distinct trigrams; callers pass a
+    // per-thread buffer so indexing a booking allocates nothing.
+    static void gramsOf(const Passenger& p, vector<uint32_t>& g) {
+        g.clear();
+        collect(p.name, g);
+        collect(p.phone, g);
+        collect(p.email, g);
+        sort(g.begin(), g.end());
+        g.erase(unique(g.begin(), g.end()), g.end());
+    }
+    // Drops every posting of a removed ID. Caller holds mu.
+    void compact() {
+        entries = 0;
+        for (auto it = postings.begin(); it != postings.end(); ) {
+            vector<int>& list = it->second;
+            list.erase(remove_if(list.begin(), list.end(), [&](int id) { return removed.count(id) > 0; }), list.end());
+            entries += list.size();
+            if (list.empty()) it = postings.erase(it);
+            else ++it;
+        }
+        removed.clear();
+        stale = 0;
+    }
+    // Caller holds mu for both
+    void insertLocked(uint32_t g, int id) {
+        vector<int>& list = postings[g];
+        // IDs are mostly handed out in increasing order
+        if (list.empty() || list.back() < id) { list.push_back(id); entries++; }
+        else {
+            auto it = lower_bound(list.begin(), list.end(), id);
+            if (it == list.end() || *it != id) { list.insert(it, id); entries++; }
+        }
+    }
+    void eraseLocked(uint32_t g, int id) {
+        auto pit = postings.find(g);
+        if (pit == postings.end()) return;
+        vector<int>& list = pit->second;
+        auto it = lower_bound(list.begin(), list.end(), id);
+        if (it == list.end() || *it != id) return;
+        list.erase(it);
+        entries--;
+        if (list.empty()) postings.erase(pit);
+    }
+public:
+    static const size_t MIN_QUERY = 3; // shorter queries cannot use the index
+
+    void add(int id, const Passenger& p) {
+        thread_local vector<uint32_t> grams;
+        gramsOf(p, grams);
+        lock_guard<mutex> lk(mu);
+        // a removed ID coming back: its stale postings must not revive
+        if (removed.count(id)) compact();
+        for (uint32_t g : grams) insertLocked(g, id);
+    }
+
+    // Re-indexes a booking in place when its passenger changes from `was`
+    // to `now` (a booking replaced under the same ID): only the trigrams
+    // that differ are touched and nothing is left stale.
+    void update(int id, const Passenger& was, const Passenger& now) {
+        thread_local vector<uint32_t> before, after;
+        gramsOf(was, before);
+        gramsOf(now, after);
+        if (before == after) return;
+        lock_guard<mutex> lk(mu);
+        size_t i = 0, j = 0;
+        while (i < before.size() || j < after.size()) {
+            if (j == after.size() || (i < before.size() && before[i] < after[j])) eraseLocked(before[i++], id);
+            else if (i == before.size() || after[j] < before[i]) insertLocked(after[j++], id);
+            else { i++; j++; }
+        }
+    }
+
+    // Marks the booking's postings stale; they are dropped once stale
+    // postings make up half the index.
+    void remove(int id, const Passenger& p) {
+        thread_local vector<uint32_t> grams;
+        gramsOf(p, grams);
+        size_t n = grams.size();
+        lock_guard<mutex> lk(mu);
+        stale += n;
+        removed.insert(id);
+        if (stale > 1024 && stale * 2 > entries) compact();
+    }
+
+    // Booking IDs whose fields contain every trigram of q, ascending. May
+    // include removed IDs; candidates still need a lookup and substring
+    // check. q must be >= MIN_QUERY long.
+    vector<int> candidates(string_view q) const {
+        vector<uint32_t> grams;
+        collect(q, grams);
+        sort(grams.begin(), grams.end());
+        grams.erase(unique(grams.begin(), grams.end()), grams.end());
+
+        lock_guard<mutex> lk(mu);
+        vector<const vector<int>*> lists;
+        for (uint32_t g : grams) {
+            auto it = postings.find(g);
+            if (it == postings.end()) return {};
+            lists.push_back(&it->second);
+        }
+        // intersect starting from the shortest list
+        sort(lists.begin(), lists.end(), [](const vector<int>* a, const vector<int>* b) { return a->size() < b->size(); });
+        vector<int> result = *lists[0];
+        vector<int> tmp;
+        for (size_t k = 1; k < lists.size() && !result.empty(); ++k) {
+            tmp.clear();
+            set_intersection(result.begin(), result.end(), lists[k]->begin(), lists[k]->end(), back_inserter(tmp));
+            result.swap(tmp);
+        }
+        return result;
+    }
+
+    void clear() {
+        lock_guard<mutex> lk(mu);
+        postings.clear();
+        removed.clear();
+        entries = stale = 0;
+    }
+};
+
+// ----------------- Journal -----------------
+// Append-only binary log of booking changes since the last snapshot
+// (bookings.txt). Each record is [u32 length][u32 crc32][payload]; a torn or
+// corrupt tail is dropped on replay. append() only buffers; a flusher thread
+// writes and fdatasyncs whatever accumulated while the previous sync ran, so
+// concurrent writers share fsyncs (group commit).
+enum JournalOp : uint8_t { J_BOOK = 1, J_CANCEL = 2, J_SEAT = 3, J_MEAL = 4 };
+
+uint32_t crc32(const char* data, size_t n);
+
+// Little-endian field encoding shared by the journal's writer and reader
+struct RecordWriter {
+    string buf;
+    void u8(uint8_t v) { buf.push_back((char)v); }
+    void u16(uint16_t v) { buf.append((const char*)&v, 2); }
+    void i32(int32_t v) { buf.append((const char*)&v, 4); }
+    void f64(double v) { buf.append((const char*)&v, 8); }
+    void str(string_view v) { u16((uint16_t)min<size_t>(v.size(), 0xFFFF)); buf.append(v.data(), min<size_t>(v.size(), 0xFFFF)); }
+};
+
+struct RecordReader {
+    const char* p;
+    const char* end;
+    bool ok = true;
+    RecordReader(const char* b, size_t n) : p(b), end(b + n) {}
+    bool need(size_t n) { if ((size_t)(end - p) < n) ok = false; return ok; }
+    uint8_t u8() { if (!need(1)) return 0; return (uint8_t)*p++; }
+    uint16_t u16() { uint16_t v = 0; if (need(2)) { memcpy(&v, p, 2); p += 2; } return v; }
+    int32_t i32() { int32_t v = 0; if (need(4)) { memcpy(&v, p, 4); p += 4; } return v; }
+    double f64() { double v = 0; if (need(8)) { memcpy(&v, p, 8); p += 8; } return v; }
+    string str() { uint16_t n = u16(); if (!need(n)) return ""; string v(p, n); p += n; return v; }
+};
+
+// fd is only read or written under mu: rotate() swaps it while bookings
+// are being appended.
+class Journal {
+    int fd = -1;
+    string filePath;
+    mutable mutex mu;
+    condition_variable work, durable;
+    string pending;            // framed records not yet written
+    uint64_t appended = 0;     // records handed to append()
+    uint64_t synced = 0;       // records known to be on disk
+    bool stopping = false;
+    thread flusher;
+    int retiredFd = -1;        // the file before rotate(), until retiredPending is written to it
+    string retiredPending;
+
+    static void writeAll(int to, const string& data) {
+        const char* p = data.data();
+        size_t left = data.size();
+        while (left > 0) {
+            ssize_t w = ::write(to, p, left);
+            if (w < 0) { if (errno == EINTR) continue; perror("journal write"); break; }
+            p += w; left -= (size_t)w;
+        }
+    }
+
+    void flushLoop() {
+        unique_lock<mutex> lk(mu);
+        while (true) {
+            work.wait(lk, [this] { return stopping || !pending.empty() || retiredFd >= 0; });
+            if (pending.empty() && retiredFd < 0 && stopping) return;
+            string old, batch;
+            old.swap(retiredPending);
+            batch.swap(pending);
+            int oldFd = retiredFd, out = fd;
+            retiredFd = -1;
+            uint64_t upTo = appended;
+            lk.unlock();
+            // the old file's records come first; they were appended first
+            if (oldFd >= 0) {
+                writeAll(oldFd, old);
+                fdatasync(oldFd);
+                ::close(oldFd);
+            }
+            if (!batch.empty()) {
+                writeAll(out, batch);
+                fdatasync(out);
+            }
+            lk.lock();
+            synced = upTo;
+            syncs++;
+            durable.notify_all();
+        }
+    }
+public:
+    uint64_t syncs = 0;        // fdatasync calls so far
+
+    ~Journal() { close(); }
+
+    bool isOpen() const {
+        lock_guard<mutex> lk(mu);
+        return fd >= 0;
+    }
+    const string& path() const { return filePath; }
+
+    bool open(const string& path) {
+        close();
+        int f = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (f < 0) return false;
+        {
+            lock_guard<mutex> lk(mu);
+            fd = f;
+            filePath = path;
+            stopping = false;
+        }
+        flusher = thread(&Journal::flushLoop, this);
+        return true;
+    }
+
+    void close() {
+        {
+            lock_guard<mutex> lk(mu);
+            if (fd < 0) return;
+            stopping = true;
+        }
+        work.notify_one();
+        flusher.join();
+        lock_guard<mutex> lk(mu);
+        ::close(fd);
+        fd = -1;
+    }
+
+    // Frames and buffers one record; returns its sequence number. No-op
+    // (returns 0) while the journal is closed, e.g. during replay.
+    uint64_t append(const string& payload) {
+        char head[8];
+        uint32_t len = (uint32_t)payload.size(), crc = crc32(payload.data(), payload.size());
+        memcpy(head, &len, 4);
+        memcpy(head + 4, &crc, 4);
+        lock_guard<mutex> lk(mu);
+        if (fd < 0) return 0;
+        pending.append(head, 8);
+        pending.append(payload);
+        work.notify_one();
+        return ++appended;
+    }
+
+    // Appends records that belong together (a party's bookings) under one
+    // lock, so they reach the file in the same write and fsync. Returns
+    // the last one's sequence number.
+    uint64_t appendAll(const vector<string>& payloads) {
+        if (payloads.empty()) return 0;
+        lock_guard<mutex> lk(mu);
+        if (fd < 0) return 0;
+        for (const string& payload : payloads) {
+            char head[8];
+            uint32_t len = (uint32_t)payload.size(), crc = crc32(payload.data(), payload.size());
+            memcpy(head, &len, 4);
+            memcpy(head + 4, &crc, 4);
+            pending.append(head, 8);
+            pending.append(payload);
+        }
+        appended += payloads.size();
+        work.notify_one();
+        return appended;
+    }
+
+    // Blocks until record `seq` (default: everything appended so far) is durable.
+    void waitDurable(uint64_t seq = UINT64_MAX) {
+        unique_lock<mutex> lk(mu);
+        if (fd < 0) return;
+        if (seq == UINT64_MAX) seq = appended;
+        durable.wait(lk, [&] { return synced >= seq; });
+    }
+
+    // Sequence number of the last record appended
+    uint64_t lastSeq() {
+        lock_guard<mutex> lk(mu);
+        return appended;
+    }
+
+    // Starts a new file without waiting for the disk: the current file,
+    // holding every record appended so far, is renamed to `segment` and
+    // later records go to a fresh file at path(). `last` receives the last
+    // record left in the segment (waitDurable(last) covers them all).
+    // False, with nothing changed, if the new file cannot be set up.
+    bool rotate(const string& segment, uint64_t& last) {
+        if (!isOpen()) return false;
+        const string next = filePath + ".next";
+        int nfd = ::open(next.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+        if (nfd < 0) return false;
+        unique_lock<mutex> lk(mu);
+        // a file retired by the previous rotation is written out first
+        durable.wait(lk, [this] { return retiredFd < 0; });
+        if (fd < 0) {
+            ::close(nfd);
+            ::unlink(next.c_str());
+            return false;
+        }
+        if (::rename(filePath.c_str(), segment.c_str()) != 0) {
+            ::close(nfd);
+            ::unlink(next.c_str());
+            return false;
+        }
+        if (::rename(next.c_str(), filePath.c_str()) != 0) {
+            if (::rename(segment.c_str(), filePath.c_str()) != 0) perror("journal rotate");
+            ::close(nfd);
+            ::unlink(next.c_str());
+            return false;
+        }
+        retiredFd = fd;
+        retiredPending.swap(pending);
+        fd = nfd;
+        last = appended;
+        work.notify_one();
+        return true;
+    }
+
+    // Calls fn(payload, size) for each intact record. Stops at the first
+    // torn/corrupt record and cuts the file back to the last good one.
+    // Returns the number of records replayed.
+    static long replay(const string& path, const function<void(const char*, size_t)>& fn) {
+        ifstream in(path, ios::binary);
+        if (!in) return 0;
+        string data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+        in.close();
+        size_t off = 0;
+        long n = 0;
+        while (off + 8 <= data.size()) {
+            uint32_t len, crc;
+            memcpy(&len, data.data() + off, 4);
+            memcpy(&crc, data.data() + off + 4, 4);
+            if (off + 8 + len > data.size() || crc32(data.data() + off + 8, len) != crc) break;
+            fn(data.data() + off + 8, len);
+            off += 8 + len;
+            n++;
+        }
+        if (off < data.size()) {
+            cout << "Journal: discarded " << (data.size() - off) << " bytes of incomplete tail\n";
+            if (::truncate(path.c_str(), (off_t)off) != 0) perror("journal truncate");
+        }
+        return n;
+    }
+};
+
+// ----------------- Booking Table -----------------
+// Active bookings, split by ID over independently locked shards so that
+// concurrent bookings and cancellations rarely wait on each other. A
+// Booking is not freed while it is active, and a cancelled one stays in
+// the archive's in-memory tier for at least CancelledArchive::BATCH more
+// cancellations, checkpoints or not, so a Booking* can still be read for
+// display after the shard lock is dropped. Code that changes a booking
+// goes by ID: it holds lockFor(id) and looks the booking up again, since
+// a freed Booking's memory is reused for the next one.
+class BookingTable {
+    struct Shard {
+        mutable mutex mu;
+        unordered_map<int, unique_ptr<Booking>, hash<int>, equal_to<int>,
+                      PoolAllocator<pair<const int, unique_ptr<Booking>>>> items;
+    };
+public:
+    static const int SHARDS = 64;
+private:
+    Shard shards[SHARDS];
+    atomic<size_t> count{0};
+
+    static int slot(int id) { return (int)((unsigned)id % SHARDS); }
+public:
+    mutex& lockFor(int id) const { return shards[slot(id)].mu; }
+
+    // The *Locked calls expect the caller to hold lockFor(id).
+    Booking* findLocked(int id) const {
+        const auto& items = shards[slot(id)].items;
+        auto it = items.find(id);
+        return it == items.end() ? nullptr : it->second.get();
+    }
+
+    // Stores b, handing back the booking it replaces (if any).
+    unique_ptr<Booking> putLocked(unique_ptr<Booking> b) {
+        unique_ptr<Booking>& cell = shards[slot(b->id)].items[b->id];
+        if (!cell) count++;
+        cell.swap(b);
+        return b;
+    }
+
+    unique_ptr<Booking> takeLocked(int id) {
+        auto& items = shards[slot(id)].items;
+        auto it = items.find(id);
+        if (it == items.end()) return nullptr;
+        unique_ptr<Booking> b = move(it->second);
+        items.erase(it);
+        count--;
+        return b;
+    }
+
+    Booking* find(int id) const {
+        lock_guard<mutex> lk(lockFor(id));
+        return findLocked(id);
+    }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    void clear() {
+        for (auto& s : shards) {
+            lock_guard<mutex> lk(s.mu);
+            s.items.clear();
+        }
+        count = 0;
+    }
+
+    // Calls fn(Booking&) for every booking of shard s (0 .. SHARDS-1), under
+    // its lock, unordered.
+    template <class Fn>
+    void forEachInShard(int s, Fn fn) const {
+        lock_guard<mutex> lk(shards[s].mu);
+        for (const auto& kv : shards[s].items) fn(*kv.second);
+    }
+
+    // Calls fn(Booking&) for every booking, one shard at a time, unordered.
+    template <class Fn>
+    void forEach(Fn fn) const {
+        for (int s = 0; s < SHARDS; ++s) forEachInShard(s, fn);
+    }
+
+    // Every booking, ordered by ID.
+    vector<Booking*> sorted() const {
+        vector<Booking*> out;
+        out.reserve(size());
+        forEach([&](Booking& b) { out.push_back(&b); });
+        sort(out.begin(), out.end(), [](const Booking* a, const Booking* b) { return a->id < b->id; });
+        return out;
+    }
+};
+
+// ----------------- Cancelled Archive -----------------
+// Cancelled bookings, in two tiers. The newest stay in memory as Booking
+// objects; once BATCH unwritten ones have piled up they are appended to
+// the archive file as one column-oriented block, and only the written
+// bookings beyond the newest BATCH are freed, so a Booking* stays readable
+// for BATCH more cancellations even when a checkpoint writes everything
+// out. Readers stream the file a block at a time, so memory stays bounded
+// however many cancellations accumulate.
+//
+// File: header {magic, checkpointEnd}, then blocks of {rows, payload
+// size, crc32} + payload. A payload stores each column contiguously: IDs,
+// luggage, fares, totals, meal, wheelchair, payment method and seat class,
+// then each text column as end offsets followed by the bytes. Blocks past
+// checkpointEnd may repeat cancellations that are still in the journal;
+// their IDs are skipped while the journal is replayed.
+
+// One archived row; the text points into the block being read.
+struct ArchivedBooking {
+    int id = 0;
+    int luggageKg = 0;
+    double fare = 0.0;
+    double total = 0.0;
+    uint8_t meal = 0, wheelchair = 0, payMethod = 0, seatClass = 0;
+    string_view flightNo, seatNo, name, phone, email, gender, bookingTime, txnId;
+};
+
+string encodeArchiveBlock(const vector<const Booking*>& rows);
+
+// Calls fn for each row of an encoded block. False if it is malformed.
+bool decodeArchiveBlock(const char* p, size_t len, uint32_t rows, const function<void(const ArchivedBooking&)>& fn);
+
+class CancelledArchive {
+    static constexpr char MAGIC[8] = {'A', 'M', 'S', 'A', 'R', 'C', '1', '\0'};
+    static const uint64_t HEADER = 16;
+    static const uint64_t BLOCK_HEAD = 12;
+
+    mutable mutex mu;
+    int fd = -1;
+    uint64_t fileEnd = 0;          // end of the last complete block
+    uint64_t checkpointEnd = 0;    // blocks before this are covered by a snapshot
+    size_t archived = 0;           // rows in the file
+    deque<unique_ptr<Booking>> hot; // oldest first
+    size_t hotWritten = 0;         // leading hot bookings already in the file
+    unordered_set<int> replaySkip; // IDs archived past checkpointEnd
+    bool cutPending = false;       // markCut() called, commitCut() not yet
+    size_t cutRows = 0;            // rows cancelled before the cut
+    uint64_t cutEnd = 0;           // file offset where they end, once written
+
+    bool writeAt(const char* p, size_t n, uint64_t off) {
+        while (n > 0) {
+            ssize_t w = pwrite(fd, p, n, (off_t)off);
+            if (w < 0) { if (errno == EINTR) continue; perror("archive write"); return false; }
+            p += w; n -= (size_t)w; off += (uint64_t)w;
+        }
+        return true;
+    }
+
+    bool readAt(char* p, size_t n, uint64_t off) const {
+        while (n > 0) {
+            ssize_t r = pread(fd, p, n, (off_t)off);
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) return false;
+            p += r; n -= (size_t)r; off += (uint64_t)r;
+        }
+        return true;
+    }
+
+    void writeHeader() {
+        char h[HEADER];
+        memcpy(h, MAGIC, 8);
+        memcpy(h + 8, &checkpointEnd, 8);
+        writeAt(h, HEADER, 0);
+    }
+
+    size_t unwrittenLocked() const { return hot.size() - hotWritten; }
+
+    // Appends the oldest n unwritten bookings as one block, then frees the
+    // written ones older than the newest BATCH. A block never spans a
+    // checkpoint's cut, so the mark can sit at it.
+    void spillLocked(size_t n) {
+        if (fd < 0 || n == 0) return;
+        if (cutPending && archived < cutRows) n = min(n, cutRows - archived);
+        vector<const Booking*> rows;
+        for (size_t i = 0; i < n; ++i) rows.push_back(hot[hotWritten + i].get());
+        string payload = encodeArchiveBlock(rows);
+        char head[BLOCK_HEAD];
+        uint32_t count = (uint32_t)n, len = (uint32_t)payload.size(), crc = crc32(payload.data(), payload.size());
+        memcpy(head, &count, 4);
+        memcpy(head + 4, &len, 4);
+        memcpy(head + 8, &crc, 4);
+        if (!writeAt(head, BLOCK_HEAD, fileEnd) || !writeAt(payload.data(), payload.size(), fileEnd + BLOCK_HEAD)) return;
+        fileEnd += BLOCK_HEAD + payload.size();
+        archived += n;
+        hotWritten += n;
+        size_t drop = min(hotWritten, hot.size() > BATCH ? hot.size() - BATCH : 0);
+        hot.erase(hot.begin(), hot.begin() + drop);
+        hotWritten -= drop;
+        if (cutPending && archived == cutRows) cutEnd = fileEnd;
+    }
+
+    // Calls fn(rows, payload, size) per intact block in [from, to); returns
+    // where the intact blocks end. Payloads are only read (and checked)
+    // when `read` is set.
+    uint64_t scan(uint64_t from, uint64_t to, bool read, const function<void(uint32_t, const char*, size_t)>& fn) const {
+        string buf;
+        uint64_t off = from;
+        while (off + BLOCK_HEAD <= to) {
+            char head[BLOCK_HEAD];
+            if (!readAt(head, BLOCK_HEAD, off)) break;
+            uint32_t rows, len, crc;
+            memcpy(&rows, head, 4);
+            memcpy(&len, head + 4, 4);
+            memcpy(&crc, head + 8, 4);
+            if (off + BLOCK_HEAD + len > to) break;
+            if (read) {
+                buf.resize(len);
+                if (!readAt(&buf[0], len, off + BLOCK_HEAD) || crc32(buf.data(), len) != crc) break;
+            }
+            fn(rows, buf.data(), buf.size());
+            off += BLOCK_HEAD + len;
+        }
+        return off;
+    }
+public:
+    static const size_t BATCH = 4096;
+
+    ~CancelledArchive() { close(); }
+
+    // Opens (or creates) the archive, cutting off a torn last block. Blocks
+    // written since the last checkpoint are read to learn which IDs the
+    // journal replay must skip.
+    bool open(const string& path) {
+        close();
+        lock_guard<mutex> lk(mu);
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) return false;
+        struct stat st;
+        fstat(fd, &st);
+        uint64_t size = (uint64_t)st.st_size;
+        archived = 0;
+        replaySkip.clear();
+        if (size < HEADER) {
+            checkpointEnd = fileEnd = HEADER;
+            writeHeader();
+            if (ftruncate(fd, (off_t)HEADER) != 0) perror("archive truncate");
+            return true;
+        }
+        char h[HEADER];
+        if (!readAt(h, HEADER, 0) || memcmp(h, MAGIC, 8) != 0) {
+            cout << "Archive " << path << " is not a cancellation archive, not using it\n";
+            ::close(fd);
+            fd = -1;
+            return false;
+        }
+        memcpy(&checkpointEnd, h + 8, 8);
+        checkpointEnd = min(max(checkpointEnd, HEADER), size);
+        uint64_t mid = scan(HEADER, checkpointEnd, false, [&](uint32_t rows, const char*, size_t) { archived += rows; });
+        fileEnd = scan(mid, size, true, [&](uint32_t rows, const char* p, size_t n) {
+            archived += rows;
+            decodeArchiveBlock(p, n, rows, [&](const ArchivedBooking& a) { replaySkip.insert(a.id); });
+        });
+        if (fileEnd < size) {
+            cout << "Archive: discarded " << (size - fileEnd) << " bytes of incomplete tail\n";
+            if (ftruncate(fd, (off_t)fileEnd) != 0) perror("archive truncate");
+        }
+        return true;
+    }
+
+    void close() {
+        lock_guard<mutex> lk(mu);
+        if (fd < 0) return;
+        ::close(fd);
+        fd = -1;
+    }
+
+    // Journal replay is over; IDs from here on are new cancellations.
+    void endReplay() {
+        lock_guard<mutex> lk(mu);
+        replaySkip.clear();
+    }
+
+    // Takes a cancelled booking; it stays in memory for at least BATCH
+    // further cancellations. False if journal replay found it was archived
+    // before a crash (the booking is dropped).
+    bool add(unique_ptr<Booking> b) {
+        lock_guard<mutex> lk(mu);
+        if (replaySkip.erase(b->id)) return false;
+        hot.push_back(move(b));
+        if (unwrittenLocked() >= BATCH) spillLocked(BATCH);
+        return true;
+    }
+
+    size_t size() const {
+        lock_guard<mutex> lk(mu);
+        return archived + unwrittenLocked();
+    }
+
+    uint64_t fileBytes() const {
+        lock_guard<mutex> lk(mu);
+        return fd < 0 ? 0 : fileEnd;
+    }
+
+    // A checkpoint moves the mark in three steps. markCut() notes how many
+    // cancellations precede the cut, while no cancellation is running;
+    // flushToCut() writes all of those out durably before the snapshot is
+    // installed; commitCut() then moves the mark to where they end. Later
+    // cancellations are still in the journal and stay past the mark.
+    void markCut() {
+        lock_guard<mutex> lk(mu);
+        cutPending = true;
+        cutRows = archived + unwrittenLocked();
+        cutEnd = fileEnd;
+    }
+
+    // The syncs run outside the lock, so cancellations do not wait on the disk.
+    void flushToCut() {
+        int out;
+        {
+            lock_guard<mutex> lk(mu);
+            if (fd < 0 || !cutPending) return;
+            while (archived < cutRows && unwrittenLocked() > 0) spillLocked(min(unwrittenLocked(), BATCH));
+            out = fd;
+        }
+        fdatasync(out);
+    }
+
+    void commitCut() {
+        int out;
+        {
+            lock_guard<mutex> lk(mu);
+            if (!cutPending) return;
+            cutPending = false;
+            if (fd < 0 || archived < cutRows) return; // a spill failed; keep the old mark
+            checkpointEnd = cutEnd;
+            writeHeader();
+            out = fd;
+        }
+        fdatasync(out);
+    }
+
+    // The snapshot was not installed; the mark stays where it was
+    void abandonCut() {
+        lock_guard<mutex> lk(mu);
+        cutPending = false;
+    }
+
+    // Streams every cancellation, oldest first. Only one block is held in
+    // memory at a time.
+    void forEach(const function<void(const ArchivedBooking&)>& fn) const {
+        uint64_t end;
+        string recent;
+        uint32_t recentRows;
+        {
+            lock_guard<mutex> lk(mu);
+            end = fd < 0 ? 0 : fileEnd;
+            vector<const Booking*> rows;
+            for (size_t i = hotWritten; i < hot.size(); ++i) rows.push_back(hot[i].get());
+            recent = encodeArchiveBlock(rows);
+            recentRows = (uint32_t)rows.size();
+        }
+        if (end) scan(HEADER, end, true, [&](uint32_t rows, const char* p, size_t n) { decodeArchiveBlock(p, n, rows, fn); });
+        decodeArchiveBlock(recent.data(), recent.size(), recentRows, fn);
+    }
+
+    // Forgets every cancellation (benchmarks)
+    void clear() {
+        lock_guard<mutex> lk(mu);
+        hot.clear();
+        hotWritten = 0;
+        replaySkip.clear();
+        archived = 0;
+        cutPending = false;
+        if (fd < 0) return;
+        checkpointEnd = fileEnd = HEADER;
+        if (ftruncate(fd, (off_t)HEADER) != 0) perror("archive truncate");
+        writeHeader();
+    }
+};
+
+// ----------------- Idempotency Keys -----------------
+// Client-chosen keys of recent booking requests and the booking each one
+// made, so a retried submission gets the first booking back instead of a
+// second seat and charge. Bounded: once CAPACITY keys are held the oldest
+// is forgotten. Keys live in memory only.
+class IdempotencyCache {
+    struct Entry {
+        int bookingId;  // 0 while the first request is still running
+        uint64_t seq;   // matches the key's place in `order`
+    };
+    unordered_map<string, Entry> entries;
+    deque<pair<string, uint64_t>> order; // oldest first; stale after abandon()
+    uint64_t seq = 0;
+    size_t capacity;
+    mutable mutex mu;
+public:
+    static const size_t CAPACITY = 1 << 16;
+    enum State { NEW, RUNNING, DONE };
+
+    explicit IdempotencyCache(size_t cap = CAPACITY) : capacity(cap) {}
+
+    // NEW: the key is now the caller's, to finish() or abandon(). RUNNING:
+    // another request with it has not finished. DONE: bookingId is set.
+    State claim(const string& key, int& bookingId) {
+        lock_guard<mutex> lk(mu);
+        auto it = entries.find(key);
+        if (it != entries.end()) {
+            bookingId = it->second.bookingId;
+            return bookingId ? DONE : RUNNING;
+        }
+        while (entries.size() >= capacity && !order.empty()) {
+            auto old = entries.find(order.front().first);
+            if (old != entries.end() && old->second.seq == order.front().second) entries.erase(old);
+            order.pop_front();
+        }
+        entries.emplace(key, Entry{ 0, ++seq });
+        order.emplace_back(key, seq);
+        return NEW;
+    }
+
+    void finish(const string& key, int bookingId) {
+        lock_guard<mutex> lk(mu);
+        auto it = entries.find(key);
+        if (it != entries.end()) it->second.bookingId = bookingId;
+    }
+
+    // The request failed; a retry may try again
+    void abandon(const string& key) {
+        lock_guard<mutex> lk(mu);
+        entries.erase(key);
+    }
+
+    size_t size() const {
+        lock_guard<mutex> lk(mu);
+        return entries.size();
+    }
+
+    void clear() {
+        lock_guard<mutex> lk(mu);
+        entries.clear();
+        order.clear();
+    }
+};
+
+// ----------------- Globals -----------------
+extern FlightCatalog catalog;
+extern Flight* currentFlight; // flight the booking menu sells
+extern BookingTable bookings; // active bookings
+extern CancelledArchive cancelledArchive;
+const string ARCHIVE_FILE = "cancelled.archive";
+extern SearchIndex searchIndex;
+extern ReportStats reportTotals; // catalog-wide; per-flight totals live on Flight
+extern mutex reportTotalsMu; // guards reportTotals
+extern Journal journal;
+const string JOURNAL_FILE = "bookings.journal";
+extern atomic<int> bookingCounter; // next booking ID
+extern IdempotencyCache idempotencyKeys; // of booking requests
+
+int nextBookingId();
+
+// Keeps IDs handed out later above `id` (loading and replay)
+void reserveBookingId(int id);
+
+// ----------------- Snapshot -----------------
+// Versioned binary snapshot (bookings.snap), used in place via mmap:
+//   header | SnapFlight[flightCount] | u64 seat words | SnapRecord[bookingCount] | string heap
+// Records are fixed-width and sorted by booking ID; strings are (offset,
+// length) references into the heap. Seat availability and report
+// aggregates are stored per flight, so opening a snapshot costs O(flights)
+// and bookings are only hydrated into `bookings` when first touched.
+// All integers are native (little-endian) byte order.
+const uint32_t SNAPSHOT_VERSION = 1;
+const char SNAPSHOT_MAGIC[8] = { 'A', 'M', 'S', 'S', 'N', 'A', 'P', '\0' };
+
+struct SnapStr { uint32_t off, len; };
+
+struct SnapHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    uint64_t bookingCount, recordsOff;
+    uint64_t flightCount, flightsOff, wordsOff;
+    uint64_t heapOff, heapSize;
+    int32_t nextBookingId;
+    uint32_t journalGeneration; // journal segments up to this one are included
+};
+
+struct SnapFlight {
+    SnapStr flightNo;
+    uint32_t wordCount;
+    uint32_t firstWord;        // index into the seat-word array
+    double revenue[NUM_SEAT_CLASSES];
+    int32_t count[NUM_SEAT_CLASSES];
+    int32_t meals[4];
+};
+
+struct SnapRecord {
+    int32_t id;
+    int32_t luggageKg;
+    double amount;
+    uint16_t seatRow;
+    char seatLetter;
+    uint8_t meal, wheelchair, payMethod;
+    uint8_t reserved[2];
+    SnapStr flightNo, name, phone, email, gender, bookingTime, txnId;
+};
+static_assert(sizeof(SnapRecord) == 80, "snapshot record layout changed; bump SNAPSHOT_VERSION");
+
+class SnapshotView {
+    const char* base = nullptr;
+    size_t length = 0;
+    const SnapHeader* header = nullptr;
+    const SnapRecord* records = nullptr;
+    const char* heap = nullptr;
+    vector<bool> taken;        // record already hydrated (possibly since cancelled)
+    uint32_t gen = 0;          // journalGeneration of the last file opened
+    int pins = 0;              // checkpoints reading records; the file stays mapped
+    uint32_t stamp = 0;        // savedEpoch given to bookings hydrated from now on
+    atomic<size_t> remaining{0}; // records not yet hydrated
+    mutex mu;                  // serializes hydration
+
+    string_view str(SnapStr s) const { return string_view(heap + s.off, s.len); }
+
+    void unmap() {
+        if (base) munmap((void*)base, length);
+        base = nullptr; header = nullptr; records = nullptr; heap = nullptr;
+        taken.clear();
+        remaining = 0;
+    }
+
+    // Builds the in-memory booking for record i. Seat bits and report
+    // aggregates were restored from the flight section, so only the map
+    // and the search index are touched.
+    Booking* hydrate(size_t i) {
+        taken[i] = true;
+        remaining--;
+        const SnapRecord& r = records[i];
+        Flight* fl = catalog.find(string(str(r.flightNo)));
+        int seat = fl ? fl->seats.layout().find(r.seatRow, r.seatLetter) : -1;
+        auto pay = make_unique<Payment>(r.amount, static_cast<PaymentMethod>(r.payMethod & 3), storedTime(str(r.bookingTime)),
+                                        Str::store(str(r.txnId)));
+        Passenger p{str(r.name), str(r.phone), str(r.email), str(r.gender),
+                    static_cast<MealPreference>(r.meal & 3), r.wheelchair != 0, r.luggageKg};
+        auto b = make_unique<Booking>(r.id, move(p), fl, seat, move(pay));
+        b->savedEpoch = stamp;
+        Booking* raw = b.get();
+        searchIndex.add(raw->id, raw->passenger);
+        {
+            lock_guard<mutex> lk(bookings.lockFor(raw->id));
+            bookings.putLocked(move(b));
+        }
+        if (remaining == 0 && pins == 0) unmap();
+        return raw;
+    }
+public:
+    ~SnapshotView() { unmap(); }
+
+    bool pending() const { return remaining > 0; }
+    size_t pendingCount() const { return remaining; }
+    uint32_t generation() const { return gen; }
+
+    // Maps the file and restores flight state. Returns false if the file is
+    // missing, malformed, or does not match the current schedule.
+    bool open(const string& path) {
+        unmap();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SnapHeader)) { ::close(fd); return false; }
+        length = (size_t)st.st_size;
+        void* m = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (m == MAP_FAILED) return false;
+        base = (const char*)m;
+        header = (const SnapHeader*)base;
+        const SnapHeader& h = *header;
+        if (memcmp(h.magic, SNAPSHOT_MAGIC, 8) != 0 || h.version != SNAPSHOT_VERSION || h.recordSize != sizeof(SnapRecord) ||
+            h.recordsOff + h.bookingCount * sizeof(SnapRecord) > length ||
+            h.flightsOff + h.flightCount * sizeof(SnapFlight) > length ||
+            h.heapOff + h.heapSize > length) {
+            cout << path << ": unsupported or corrupt snapshot\n";
+            unmap();
+            return false;
+        }
+        records = (const SnapRecord*)(base + h.recordsOff);
+        heap = base + h.heapOff;
+
+        // restore seat bits and aggregates; all-or-nothing
+        const SnapFlight* flights = (const SnapFlight*)(base + h.flightsOff);
+        const uint64_t* words = (const uint64_t*)(base + h.wordsOff);
+        vector<Flight*> targets(h.flightCount);
+        for (uint64_t f = 0; f < h.flightCount; ++f) {
+            targets[f] = catalog.find(string(str(flights[f].flightNo)));
+            if (!targets[f] || (size_t)flights[f].wordCount != targets[f]->seats.available.size() ||
+                h.wordsOff + (flights[f].firstWord + (uint64_t)flights[f].wordCount) * 8 > length) {
+                cout << path << ": flight " << str(flights[f].flightNo) << " does not match the schedule\n";
+                unmap();
+                return false;
+            }
+        }
+        for (uint64_t f = 0; f < h.flightCount; ++f) {
+            const SnapFlight& sf = flights[f];
+            Flight* fl = targets[f];
+            memcpy(fl->seats.available.data(), words + sf.firstWord, sf.wordCount * 8);
+            for (int c = 0; c < NUM_SEAT_CLASSES; ++c) { fl->stats.revenue[c] = sf.revenue[c]; fl->stats.count[c] = sf.count[c]; }
+            for (int m = 0; m < 4; ++m) fl->stats.meals[m] = sf.meals[m];
+            for (int c = 0; c < NUM_SEAT_CLASSES; ++c) {
+                reportTotals.revenue[c] += sf.revenue[c];
+                reportTotals.count[c] += sf.count[c];
+            }
+            for (int m = 0; m < 4; ++m) reportTotals.meals[m] += sf.meals[m];
+        }
+        reserveBookingId(h.nextBookingId - 1);
+        gen = h.journalGeneration;
+        taken.assign(h.bookingCount, false);
+        remaining = h.bookingCount;
+        if (remaining == 0) unmap();
+        return true;
+    }
+
+    // Hydrates booking `id` if the snapshot still holds it; O(log n). If
+    // another thread got there first, returns what it put in `bookings`.
+    Booking* find(int id) {
+        if (!remaining) return bookings.find(id);
+        lock_guard<mutex> lk(mu);
+        if (!remaining) return bookings.find(id);
+        const SnapRecord* end = records + header->bookingCount;
+        const SnapRecord* r = lower_bound(records, end, id, [](const SnapRecord& a, int v) { return a.id < v; });
+        if (r == end || r->id != id) return nullptr;
+        if (taken[r - records]) return bookings.find(id);
+        return hydrate(r - records);
+    }
+
+    // At a checkpoint's cut: records not hydrated yet are saved straight
+    // from the file (they cannot have changed), so `lazy` gets which those
+    // are and bookings hydrated from now on are stamped `epoch`, keeping
+    // them out of the capture. False if every record is already hydrated;
+    // otherwise the file stays mapped until unpin().
+    bool pin(uint32_t epoch, vector<bool>& lazy) {
+        lock_guard<mutex> lk(mu);
+        stamp = epoch;
+        if (!remaining) return false;
+        pins++;
+        lazy = taken;
+        lazy.flip();
+        return true;
+    }
+
+    void unpin() {
+        lock_guard<mutex> lk(mu);
+        if (--pins == 0 && remaining == 0) unmap();
+    }
+
+    // Record i of the pinned file and its strings
+    const SnapRecord& record(size_t i) const { return records[i]; }
+    string_view text(SnapStr s) const { return str(s); }
+
+    void hydrateAll() {
+        lock_guard<mutex> lk(mu);
+        for (size_t i = 0; remaining > 0 && i < taken.size(); ++i) {
+            if (!taken[i]) hydrate(i);
+        }
+    }
+};
+
+extern SnapshotView snapshot;
+const string SNAPSHOT_FILE = "bookings.snap";
+
+// Any code that walks every booking must call this first
+void ensureHydrated();
+
+// Active booking by ID, hydrating it from the snapshot on first access
+Booking* findBooking(int id);
+
+// ----------------- Booking Store -----------------
+// All changes to `bookings` go through here so the secondary indexes and
+// report aggregates stay in step. Every operation is safe to call from
+// several threads at once. Seats are claimed atomically before a booking
+// is stored, and a change is journaled before the seat it gives up is
+// released, so whoever takes that seat next is also journaled after it.
+// Lock order: snapshot, booking shard, flight stats, report totals, index.
+// Each of the operations below is one MutationScope (see Checkpoints);
+// addBooking and removeBooking leave that to their callers.
+void applyToReports(const Booking& b, int sign);
+
+Booking* addBooking(unique_ptr<Booking> b);
+
+unique_ptr<Booking> removeBooking(int id);
+
+string encodeBookRecord(const Booking& b);
+
+// Claims the seat, stores the booking and journals it. Returns nullptr
+// (dropping the booking) if the seat was already taken.
+Booking* confirmBooking(unique_ptr<Booking> b);
+
+// What a cancellation leaves its caller. The Booking itself belongs to
+// the archive from then on, which may free it, so this is copied out.
+struct Cancellation {
+    bool ok = false;         // false: the ID was not active
+    Flight* flight = nullptr;
+    int seat = -1;           // the seat freed, or -1
+    double refund = 0.0;
+};
+
+// Frees the seat and moves the booking to the cancelled archive. Not ok if
+// the ID is not active (or another thread cancelled it first).
+Cancellation cancelBooking(int id);
+
+// Moves booking `id` to another free seat (a slot of its own flight's
+// layout) of the same class. Fails if the seat is taken or the booking was
+// cancelled meanwhile. The flight and the seat given up are stored in
+// *flightOut and *oldSeatOut if requested.
+bool changeSeat(int id, int newSeat, int* oldSeatOut = nullptr, Flight** flightOut = nullptr);
+
+bool changeMeal(int id, MealPreference meal);
+
+// Applies one journal record on top of the loaded snapshot. Records the
+// snapshot already reflects (e.g. after a crash between installing a
+// snapshot and removing the journal segments it covers) are skipped, so
+// replay is idempotent.
+void applyJournalRecord(const char* data, size_t n);
+
+// Recomputes every aggregate from scratch and compares it with the running
+// totals. Reports each mismatch; returns true when everything agrees.
+bool verifyReportAggregates();
+
+bool bookingMatches(const Booking& b, const string& q);
+
+// Exact booking ID, or substring of name/phone/email. Results ordered by ID.
+vector<Booking*> findBookings(const string& q);
+
+// ----------------- Operations -----------------
+// The booking operations as the menu and --batch both perform them:
+// validation, seat choice and waitlist handling, with no prompts or
+// output. Failures come back as a short reason for the front end to show.
+struct BookingRequest {
+    Flight* flight = nullptr;
+    Passenger passenger;
+    SeatClass cls = ECONOMY;
+    int pref = -1;              // SeatPref, or -1 for any
+    string seatNo;              // empty: first free seat of cls/pref
+    PaymentMethod method = CASH;
+    string idempotencyKey;      // optional; see IdempotencyCache
+};
+
+// The seat's quoted fare plus the luggage fee
+double ticketPrice(const Flight& flight, int seat, int luggageKg);
+
+double refundFor(const Booking& b);
+
+// Empty string if the passenger's details are acceptable
+string checkPassenger(const Passenger& p);
+
+// How a bookSeat call ended, for front ends that answer with a status
+enum BookResult {
+    BOOKED,
+    REPLAYED,     // the idempotency key's earlier request made the booking
+    INVALID,      // unknown flight or seat, wrong class, bad passenger details
+    UNAVAILABLE,  // the seat is taken, or none of the class is free
+    KEY_CONFLICT  // the key's request is still running or its booking was cancelled
+};
+
+// Validates the request and books it. An explicit seat must be free and of
+// the requested class; otherwise the first free matching seat is taken,
+// moving on to the next one if another session claims it first.
+// A request repeating an earlier one's idempotency key books nothing: it
+// gets the earlier booking back (REPLAYED), or an error if that request is
+// still running or its booking has been cancelled (KEY_CONFLICT).
+Booking* bookSeat(const BookingRequest& req, string& error, BookResult* result = nullptr);
+
+// A party booked together on one flight, every passenger in the same class
+struct GroupRequest {
+    Flight* flight = nullptr;
+    vector<Passenger> passengers;
+    SeatClass cls = ECONOMY;
+    int pref = -1;              // SeatPref at least one of the seats has, or -1
+    PaymentMethod method = CASH;
+};
+
+// Books every passenger or none, into seats picked by SeatStore::findGroup
+// and claimed at once; the bookings are journaled in one write. Returns
+// them in passenger order, or an empty list with the reason in error.
+// `together` is set when the party sits side by side in one row.
+vector<Booking*> bookGroup(const GroupRequest& req, string& error, bool* together = nullptr);
+
+// Books a just-freed seat for whoever is first in line for it. If another
+// session takes the seat first, the passenger keeps their place.
+Booking* fillFromWaitlist(Flight& flight, int seat);
+
+// cancelBooking, then the freed seat goes straight to the waitlist.
+// `reassigned` receives the waitlisted passenger's new booking, if any.
+Cancellation cancelAndRefill(int id, Booking*& reassigned);
+
+// changeSeat, then the seat given up goes to the waitlist.
+bool changeSeatAndRefill(int id, int newSeat, Booking*& reassigned);
+
+void writeReportStats(ostream& os, const ReportStats& st, int totalSeats);
+
+// The admin report: catalog-wide aggregates, `flight`'s own (when there
+// are several flights) and the cancellation count
+void writeReports(ostream& os, Flight* flight);
+
+// ----------------- Save / Load -----------------
+// Format per booking:
+// id|name|phone|email|gender|meal|wheelchair|luggage|seatNo|bookingTime|paymentMethod|paymentAmount|flightNo|txnId
+// flightNo was added later; lines without it belong to the first flight in the catalog.
+// So was txnId; lines without it (or with it empty) get a new transaction ID.
+// Written to a temp file and renamed over the old one, so a crash mid-save
+// leaves the previous snapshot intact.
+// Both save what is in the table now, without a cut or journal rotation
+// (conversions); checkpoints go through Checkpointer::run().
+bool saveBookingsToFile(const string& path = "bookings.txt");
+
+bool writeSnapshot(const string& path = SNAPSHOT_FILE);
+
+// Opens bookings.snap, unless bookings.txt is newer (e.g. written by
+// app.py) or the snapshot is unusable, in which case the text file is parsed.
+// Returns the journal generation the loaded state includes (0 for text).
+uint32_t loadLatestBookings();
+
+// Loader for the pipe-delimited format above. The file is mmapped, split
+// into chunks at newline boundaries and the chunks are tokenized in
+// parallel with from_chars into string_views (no per-line allocation).
+// Chunks are then merged in file order, so the result does not depend on
+// thread timing. The leading count is only a hint (app.py can leave it
+// stale); malformed lines are reported with their line number.
+struct ParsedBooking {
+    string_view name, phone, email, gender, seatNo, bookingTime, flightNo, txnId;
+    int id, meal, luggage, payMethod;
+    bool wheelchair;
+    double amount;
+    uint32_t line;      // line number within the chunk, 1-based
+};
+
+struct ParseError {
+    uint32_t line;
+    const char* reason;
+};
+
+struct ParsedChunk {
+    vector<ParsedBooking> rows;
+    vector<ParseError> errors;
+    uint32_t lines = 0;
+};
+
+template <class T>
+bool parseNumber(string_view v, T& out) {
+    auto r = from_chars(v.data(), v.data() + v.size(), out);
+    return r.ec == errc() && r.ptr == v.data() + v.size();
+}
+
+void parseBookingChunk(const char* p, const char* end, ParsedChunk& out);
+
+// threads == 0: one per hardware thread
+void loadBookingsFromFile(const string& path = "bookings.txt", int threads = 0);
+
+// ----------------- Checkpoints -----------------
+// A checkpoint saves the state as of one instant (the cut) while bookings
+// keep being taken. Every operation that changes bookings runs inside a
+// MutationScope. The cut closes the gate, waits for the operations already
+// inside to finish, rotates the journal and reopens the gate, so the pause
+// lasts as long as the slowest operation in flight, whatever the number
+// of bookings. The walk that follows copies each booking as it was at the
+// cut: one about to be changed or removed before the walk reaches it is
+// copied first (copy-on-write, under its shard lock), and one added after
+// the cut is left to the journal. Bookings still only in the mapped
+// snapshot are saved from its bytes, so a checkpoint does not hydrate them.
+//
+// The journal file cut off is kept as bookings.journal.<generation> until
+// the snapshot holding its records is installed; recovery replays the
+// segments after the snapshot's generation, then the live journal.
+class MutationGate {
+    struct alignas(64) Slot { atomic<int> inside{0}; };
+    static const int SLOTS = 64;
+    Slot slots[SLOTS];
+    atomic<bool> closed{false};
+    mutex cutMu;
+
+    Slot& mine() {
+        static atomic<unsigned> nextSlot{0};
+        thread_local unsigned i = nextSlot++ % SLOTS;
+        return slots[i];
+    }
+public:
+    void enter() {
+        Slot& s = mine();
+        while (true) {
+            s.inside.fetch_add(1);
+            if (!closed.load()) return;
+            s.inside.fetch_sub(1);
+            while (closed.load()) this_thread::yield();
+        }
+    }
+
+    void leave() { mine().inside.fetch_sub(1); }
+
+    // Runs fn once no operation is inside, keeping new ones out meanwhile.
+    // fn must not start an operation itself.
+    template <class Fn>
+    void cut(Fn fn) {
+        lock_guard<mutex> lk(cutMu);
+        closed.store(true);
+        for (Slot& s : slots) {
+            while (s.inside.load() != 0) this_thread::yield();
+        }
+        fn();
+        closed.store(false);
+    }
+};
+
+extern MutationGate mutationGate;
+
+// Nested scopes on one thread count once, so an operation may call another.
+class MutationScope {
+    static inline thread_local int depth = 0;
+public:
+    MutationScope() { if (depth++ == 0) mutationGate.enter(); }
+    ~MutationScope() { if (--depth == 0) mutationGate.leave(); }
+    MutationScope(const MutationScope&) = delete;
+    MutationScope& operator=(const MutationScope&) = delete;
+};
+
+// Bookings copied at a cut, already in snapshot form (records + heap).
+// Seat bits and report aggregates are derived from `rows`, not read from
+// the live flights, which have moved on since.
+struct StateImage {
+    struct Row {
+        const Flight* flight;
+        int seat;
+        double total;   // Booking::totalAmount() at the cut
+        bool paid;
+    };
+    vector<SnapRecord> records;
+    vector<Row> rows;   // parallel to records
+    string heap;
+    int32_t nextBookingId = 1;
+    uint32_t generation = 0;
+
+    string_view str(SnapStr s) const { return string_view(heap.data() + s.off, s.len); }
+    void add(const Booking& b);
+    // A record still only in the mmapped snapshot; strings are copied
+    void addRecord(const SnapRecord& r, const SnapshotView& from, const Flight* flight, int seat);
+    void sortById();
+    void clear();
+};
+
+// Writers for a captured image. Both replace the file atomically; the
+// snapshot is synced to disk before it is renamed into place.
+bool writeSnapshot(const StateImage& img, const string& path);
+bool writeBookingsText(const StateImage& img, const string& path);
+
+struct CheckpointStats {
+    bool ok = false;
+    double cutUs = 0;       // gate closed
+    double captureMs = 0;   // walk over the table
+    double writeMs = 0;     // journal/archive sync and both files
+    size_t bookings = 0;
+    size_t copiedOnWrite = 0; // bookings copied by the operation changing them
+};
+
+class Checkpointer {
+    mutex runMu;              // one checkpoint at a time
+    mutex imageMu;            // guards image while capturing
+    StateImage image;
+    atomic<uint32_t> epoch{0};
+    atomic<bool> capturing{false};
+    uint32_t generation = 0;  // of the last segment a snapshot covers or recovery replayed
+    size_t copied = 0;        // under imageMu
+    atomic<uint64_t> savedSeq{0}; // journal position of the last cut
+
+    mutex workerMu;
+    condition_variable wake;
+    bool stopping = false;
+    thread worker;
+
+    void copyLocked(Booking& b);
+public:
+    string snapshotPath = SNAPSHOT_FILE;
+    string textPath = "bookings.txt";
+    CheckpointStats last;     // of the last run()
+
+    ~Checkpointer() { stop(); }
+
+    uint32_t currentEpoch() const { return epoch.load(); }
+
+    // Called with b's shard lock held, before b is changed or removed
+    void preserveLocked(Booking& b) {
+        if (capturing.load() && b.savedEpoch < epoch.load()) copyLocked(b);
+    }
+
+    // Recovery has replayed journal segments up to `gen`
+    void setGeneration(uint32_t gen) { generation = gen; }
+
+    // One checkpoint: cut, capture, write bookings.txt and bookings.snap,
+    // then drop the journal segments and archive blocks they cover.
+    bool run();
+
+    // Checkpoints every `seconds` on a background thread while the journal
+    // has grown since the last one; 0 does nothing.
+    void start(int seconds);
+    void stop();
+};
+
+extern Checkpointer checkpointer;
+
+// Names of journal segments for `journalPath` numbered above `after`, ascending
+vector<pair<uint32_t, string>> journalSegments(const string& journalPath, uint32_t after = 0);
+
+// Foreground checkpoint (exit, the admin menu, benchmarks)
+void checkpoint();
+
+// ----------------- Export -----------------
+// Bulk export of active and cancelled bookings, one row per booking with
+// flight, seat class, fare breakdown and payment. Rows are streamed
+// through a 1MB buffer (active bookings one table shard at a time, the
+// archive one block at a time), so memory stays flat at any size.
+struct ExportFilter {
+    string flightNo;      // "" = every flight
+    int cls = -1;         // SeatClass, -1 = any
+    string from, to;      // booking time bounds, inclusive; "2025-01" covers the whole month
+    bool active = true;
+    bool cancelled = true;
+};
+
+struct ExportCounts {
+    size_t active = 0, cancelled = 0;
+    uint64_t bytes = 0;
+};
+
+// JSON Lines for *.jsonl / *.json paths, CSV with a header row otherwise.
+// The file is replaced atomically. Active rows come unordered. False
+// when the file cannot be written or a time bound cannot be read.
+bool exportBookings(const string& path, const ExportFilter& filter, ExportCounts* counts = nullptr);
+
+// ----------------- Startup -----------------
+// Initialize the flight schedule; fall back to the single default flight
+void initCatalog();
+
+// Catalog, last snapshot, then everything journaled since
+void openStore();
+
+// --to-snapshot <bookings.txt> <out.snap> / --to-text <in.snap> <bookings.txt>
+int convertBookings(const string& mode, const string& in, const string& out);
+
+// ----------------- HTTP Server -----------------
+// The web UI's JSON API (same endpoints as app.py), served from memory:
+//   GET  /api/flight-info[?flight=NO][&since=VERSION]
+//                                       seat map and stats (default: first flight);
+//                                       with since, only seats changed after it
+//   GET  /api/bookings[?flight=NO]      active bookings, ordered by ID
+//   POST /api/book                      {name, phone, email, gender, meal, wheelchair,
+//                                        luggage, paymentMethod, seatNo[, flightNo]
+//                                        [, idempotencyKey]}; the key may also come
+//                                        as an Idempotency-Key header
+//   GET  /metrics                       operation latencies, Prometheus text
+// plus index.html, style.css and script.js from the web root. Each worker
+// thread runs its own epoll loop over non-blocking keep-alive connections.
+// A booking's reply is held until the journal has it on disk; all the
+// bookings answered in one pass of a loop share that fsync.
+struct HttpResponse {
+    int status = 200;
+    string contentType = "application/json";
+    string body;
+};
+
+class HttpServer {
+    int listenFd = -1;
+    int stopFd = -1; // eventfd, readable once stop() is called
+    int boundPort = 0;
+    unordered_map<string, pair<string, string>> files; // path -> content type, contents
+
+    void loop();
+public:
+    static const size_t MAX_HEADER = 16 * 1024;
+    static const size_t MAX_BODY = 1024 * 1024;
+
+    HttpServer();
+    ~HttpServer();
+    HttpServer(const HttpServer&) = delete;
+    HttpServer& operator=(const HttpServer&) = delete;
+
+    // Binds host:port; port 0 picks a free one. Returns "" or the error.
+    string listen(const string& host, int port);
+    int port() const { return boundPort; }
+
+    // Caches the web UI's files; missing ones answer 404
+    void loadStatic(const string& webRoot);
+
+    // Serves on `threads` loops (0: one per hardware thread) until stop()
+    void run(int threads);
+
+    // Safe to call from any thread or a signal handler
+    void stop();
+
+    // Handles one request. Sets `wrote` when the reply must wait for the journal.
+    HttpResponse route(string_view method, string_view target, string_view body, bool& wrote,
+                       string_view idempotencyKey = string_view()) const;
+};
+
+#endif // AMS_CORE_H
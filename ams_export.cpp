@@ -0,0 +1,326 @@
+// ams_export.cpp
+#include "ams_core.h"
+
+// ----------------- Export -----------------
+namespace {
+// One output row, whichever tier the booking came from
+struct ExportRow {
+    bool cancelled = false;
+    int id = 0;
+    string_view flightNo, date, src, dest, seatNo, name, phone, email, gender, bookingTime, txnId;
+    SeatClass cls = ECONOMY;
+    MealPreference meal = NO_MEAL;
+    PaymentMethod method = CASH;
+    bool wheelchair = false;
+    int luggageKg = 0;
+    double fare = 0.0, total = 0.0, paid = 0.0;
+};
+
+const char* const COLUMNS[] = {
+    "status", "id", "flight", "date", "src", "dest", "seat", "class", "name", "phone", "email", "gender", "meal",
+    "wheelchair", "luggage_kg", "base_fare", "luggage_fee", "total", "paid", "payment_method", "txn_id", "booking_time" };
+
+const string_view MEALS[] = { "Vegetarian", "Non-Veg", "Vegan", "No Meal" };
+const string_view METHODS[] = { "Credit Card", "Debit Card", "UPI", "Cash" };
+
+// Buffered writer straight to the file descriptor; numbers are formatted
+// by hand so no locale or stream state is involved. Fields longer than
+// the buffer bypass it.
+class ExportWriter {
+    int fd;
+    unique_ptr<char[]> buf;
+    size_t len = 0;
+    bool failed = false;
+    bool holding = false;
+    vector<pair<unique_ptr<char[]>, size_t>> held; // buffers filled since hold()
+    vector<unique_ptr<char[]>> spare;              // written ones, for reuse
+
+    void writeOut(const char* p, size_t n) {
+        bytes += n;
+        while (n > 0 && !failed) {
+            ssize_t w = ::write(fd, p, n);
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                perror("export write");
+                failed = true;
+                break;
+            }
+            p += w;
+            n -= (size_t)w;
+        }
+    }
+    // Room for n more bytes
+    void reserve(size_t n) { if (len + n > BUFFER) flush(); }
+public:
+    static const size_t BUFFER = 1 << 20;
+    uint64_t bytes = 0;
+
+    explicit ExportWriter(int f) : fd(f), buf(new char[BUFFER]) {}
+
+    bool ok() const { return !failed; }
+
+    void flush() {
+        if (!holding) writeOut(buf.get(), len);
+        else if (len) {
+            held.emplace_back(move(buf), len);
+            if (spare.empty()) buf.reset(new char[BUFFER]);
+            else { buf = move(spare.back()); spare.pop_back(); }
+        }
+        len = 0;
+    }
+
+    // Between hold() and release() full buffers are kept rather than
+    // written, so rows can be formatted under a lock and written once it is
+    // dropped.
+    void hold() { holding = true; }
+    void release() {
+        holding = false;
+        for (auto& h : held) {
+            writeOut(h.first.get(), h.second);
+            spare.push_back(move(h.first));
+        }
+        held.clear();
+    }
+
+    void put(char c) {
+        reserve(1);
+        buf[len++] = c;
+    }
+    void put(string_view s) {
+        if (s.size() > BUFFER / 2) {
+            if (holding) { put(s.substr(0, BUFFER / 2)); put(s.substr(BUFFER / 2)); return; }
+            flush();
+            writeOut(s.data(), s.size());
+            return;
+        }
+        reserve(s.size());
+        memcpy(buf.get() + len, s.data(), s.size());
+        len += s.size();
+    }
+
+    void putInt(long long v) {
+        char tmp[24];
+        char* e = tmp + sizeof(tmp);
+        char* p = e;
+        unsigned long long u = v < 0 ? 0ULL - (unsigned long long)v : (unsigned long long)v;
+        do { *--p = (char)('0' + u % 10); u /= 10; } while (u);
+        if (v < 0) *--p = '-';
+        put(string_view(p, (size_t)(e - p)));
+    }
+
+    // Rounded to cents, always two decimals
+    void putMoney(double v) {
+        long long cents = llround(v * 100);
+        if (cents < 0) { put('-'); cents = -cents; }
+        putInt(cents / 100);
+        put('.');
+        put((char)('0' + cents % 100 / 10));
+        put((char)('0' + cents % 10));
+    }
+
+    // Quoted only when it has to be (RFC 4180)
+    void putCsv(string_view s) {
+        if (s.find_first_of(",\"\r\n") == string_view::npos) { put(s); return; }
+        put('"');
+        for (char c : s) {
+            if (c == '"') put('"');
+            put(c);
+        }
+        put('"');
+    }
+
+    void putJson(string_view s) {
+        static const char HEX[] = "0123456789abcdef";
+        put('"');
+        size_t run = 0;
+        for (size_t i = 0; i < s.size(); ++i) {
+            unsigned char c = (unsigned char)s[i];
+            if (c >= 0x20 && c != '"' && c != '\\') continue;
+            put(s.substr(run, i - run));
+            run = i + 1;
+            if (c == '"' || c == '\\') { put('\\'); put((char)c); }
+            else if (c == '\n') put("\\n");
+            else if (c == '\t') put("\\t");
+            else { put("\\u00"); put(HEX[c >> 4]); put(HEX[c & 15]); }
+        }
+        put(s.substr(run));
+        put('"');
+    }
+};
+
+void writeRow(ExportWriter& w, const ExportRow& r, bool json) {
+    const string_view status = r.cancelled ? "cancelled" : "active";
+    const string_view cls = seatClassString(r.cls);
+    const string_view meal = MEALS[r.meal & 3];
+    const string_view method = METHODS[r.method & 3];
+    double luggageFee = r.total - r.fare;
+    if (!json) {
+        w.put(status); w.put(',');
+        w.putInt(r.id); w.put(',');
+        for (string_view s : { r.flightNo, r.date, r.src, r.dest, r.seatNo, cls, r.name, r.phone, r.email, r.gender, meal }) {
+            w.putCsv(s);
+            w.put(',');
+        }
+        w.put(r.wheelchair ? "1," : "0,");
+        w.putInt(r.luggageKg); w.put(',');
+        w.putMoney(r.fare); w.put(',');
+        w.putMoney(luggageFee); w.put(',');
+        w.putMoney(r.total); w.put(',');
+        w.putMoney(r.paid); w.put(',');
+        w.putCsv(method); w.put(',');
+        w.putCsv(r.txnId); w.put(',');
+        w.putCsv(r.bookingTime);
+        w.put('\n');
+        return;
+    }
+    int col = 0;
+    auto key = [&] {
+        w.put(col ? ",\"" : "{\"");
+        w.put(COLUMNS[col++]);
+        w.put("\":");
+    };
+    key(); w.putJson(status);
+    key(); w.putInt(r.id);
+    for (string_view s : { r.flightNo, r.date, r.src, r.dest, r.seatNo, cls, r.name, r.phone, r.email, r.gender, meal }) {
+        key();
+        w.putJson(s);
+    }
+    key(); w.put(r.wheelchair ? "true" : "false");
+    key(); w.putInt(r.luggageKg);
+    key(); w.putMoney(r.fare);
+    key(); w.putMoney(luggageFee);
+    key(); w.putMoney(r.total);
+    key(); w.putMoney(r.paid);
+    key(); w.putJson(method);
+    key(); w.putJson(r.txnId);
+    key(); w.putJson(r.bookingTime);
+    w.put("}\n");
+}
+
+// The filter's bounds as epoch seconds, and as the text the archive
+// holds, which sorts the same way
+struct TimeRange {
+    int64_t from = INT64_MIN, to = INT64_MAX;
+    string fromText, toText;
+
+    bool parse(const ExportFilter& f) {
+        if (!f.from.empty() && !parseTime(f.from, from)) return false;
+        if (!f.to.empty() && !parseTime(f.to, to, true)) return false;
+        fromText = formatTime(from);
+        toText = f.to.empty() ? string() : formatTime(to);
+        return true;
+    }
+    bool has(int64_t t) const { return t >= from && t <= to; }
+    bool has(string_view t) const { return t >= fromText && (toText.empty() || t <= toText); }
+};
+
+void setFlightFields(ExportRow& r, const Flight* fl) {
+    if (!fl) return;
+    r.date = fl->date;
+    r.src = fl->src;
+    r.dest = fl->dest;
+}
+}
+
+bool exportBookings(const string& path, const ExportFilter& filter, ExportCounts* counts) {
+    ExportCounts n;
+    TimeRange range;
+    if (!range.parse(filter)) return false;
+    const string tmp = path + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    bool json = (path.size() >= 6 && path.compare(path.size() - 6, 6, ".jsonl") == 0) ||
+                (path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0);
+    ExportWriter w(fd);
+    if (!json) {
+        for (size_t c = 0; c < size(COLUMNS); ++c) {
+            if (c) w.put(',');
+            w.put(COLUMNS[c]);
+        }
+        w.put('\n');
+    }
+
+    // a flight no longer scheduled can still have archived rows
+    const Flight* only = filter.flightNo.empty() ? nullptr : catalog.find(filter.flightNo);
+    if (filter.active && (filter.flightNo.empty() || only)) {
+        ensureHydrated();
+        // One shard at a time, unordered: a shard's rows are formatted under
+        // its lock and written after it, so bookings on it never wait on the
+        // disk, and memory holds one shard's rows however many there are.
+        auto row = [&](const Booking& b) {
+            if (only && b.flight != only) return;
+            if (!b.hasSeat() || (filter.cls >= 0 && b.seatClass() != filter.cls)) return;
+            if (!range.has(b.bookedAt)) return;
+            ExportRow r;
+            r.id = b.id;
+            r.flightNo = b.flight->flightNo;
+            setFlightFields(r, b.flight);
+            const SeatLayout& layout = b.flight->seats.layout();
+            char seat[8];
+            int len = snprintf(seat, sizeof(seat), "%u%c", (unsigned)layout.row[b.seat], layout.letter[b.seat]);
+            r.seatNo = string_view(seat, (size_t)len);
+            r.cls = b.seatClass();
+            r.name = b.passenger.name.view();
+            r.phone = b.passenger.phone.view();
+            r.email = b.passenger.email.view();
+            r.gender = b.passenger.gender.view();
+            r.meal = b.passenger.meal;
+            r.wheelchair = b.passenger.wheelchair;
+            r.luggageKg = b.passenger.luggageKg;
+            r.fare = b.fare();
+            r.total = b.totalAmount();
+            r.paid = b.payment ? b.payment->amount : 0.0;
+            r.method = b.payment ? b.payment->method : CASH;
+            r.txnId = b.payment ? b.payment->txnId.view() : string_view();
+            char when[TIME_TEXT];
+            r.bookingTime = string_view(when, formatTime(b.bookedAt, when, sizeof(when)));
+            writeRow(w, r, json);
+            n.active++;
+        };
+        for (int s = 0; s < BookingTable::SHARDS; ++s) {
+            w.hold();
+            bookings.forEachInShard(s, row);
+            w.release();
+        }
+    }
+    if (filter.cancelled) {
+        const Flight* last = nullptr; // archived rows come in runs of the same flight
+        cancelledArchive.forEach([&](const ArchivedBooking& a) {
+            if (!filter.flightNo.empty() && a.flightNo != filter.flightNo) return;
+            if (filter.cls >= 0 && a.seatClass != filter.cls) return;
+            if (!range.has(a.bookingTime)) return;
+            ExportRow r;
+            r.cancelled = true;
+            r.id = a.id;
+            r.flightNo = a.flightNo;
+            if (!last || last->flightNo != a.flightNo) last = a.flightNo.empty() ? nullptr : catalog.find(string(a.flightNo));
+            if (last && last->flightNo == a.flightNo) setFlightFields(r, last);
+            r.seatNo = a.seatNo;
+            r.cls = static_cast<SeatClass>(a.seatClass % NUM_SEAT_CLASSES);
+            r.name = a.name;
+            r.phone = a.phone;
+            r.email = a.email;
+            r.gender = a.gender;
+            r.meal = static_cast<MealPreference>(a.meal & 3);
+            r.wheelchair = a.wheelchair != 0;
+            r.luggageKg = a.luggageKg;
+            r.fare = a.fare;
+            r.total = r.paid = a.total;
+            r.method = static_cast<PaymentMethod>(a.payMethod & 3);
+            r.txnId = a.txnId;
+            r.bookingTime = a.bookingTime;
+            writeRow(w, r, json);
+            n.cancelled++;
+        });
+    }
+    w.flush();
+    n.bytes = w.bytes;
+    bool ok = w.ok();
+    if (::close(fd) != 0) ok = false;
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        remove(tmp.c_str());
+        return false;
+    }
+    if (counts) *counts = n;
+    return true;
+}
@@ -0,0 +1,582 @@
+// ams_http.cpp
+#include "ams_core.h"
+
+// ----------------- HTTP Server -----------------
+namespace {
+struct HttpConn {
+    int fd;
+    string in;            // bytes received, not yet parsed
+    string out;           // responses not yet sent
+    size_t sent = 0;      // bytes of out already sent
+    bool closeAfter = false; // answer nothing more; close once out is sent
+    bool peerClosed = false; // peer has finished sending
+    bool dead = false;       // socket error: close now
+    uint32_t events = EPOLLIN | EPOLLRDHUP; // what epoll watches for
+    explicit HttpConn(int f) : fd(f) {}
+};
+
+struct HttpRequest {
+    string_view method, target, body, idempotencyKey;
+    bool keepAlive = true;
+    bool http10 = false;
+};
+
+const char* statusText(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 409: return "Conflict";
+        case 413: return "Payload Too Large";
+        case 501: return "Not Implemented";
+        default: return "Internal Server Error";
+    }
+}
+
+HttpResponse jsonError(int status, string_view why) {
+    HttpResponse r;
+    r.status = status;
+    r.body = "{\"error\":" + jsonString(why) + "}";
+    return r;
+}
+
+bool equalsNoCase(string_view a, string_view b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (tolower((unsigned char)a[i]) != tolower((unsigned char)b[i])) return false;
+    }
+    return true;
+}
+
+string_view trim(string_view v) {
+    while (!v.empty() && (v.front() == ' ' || v.front() == '\t')) v.remove_prefix(1);
+    while (!v.empty() && (v.back() == ' ' || v.back() == '\t')) v.remove_suffix(1);
+    return v;
+}
+
+int hexDigit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Value of name in a query string like a=1&flight=AI101, %-decoded
+string queryParam(string_view query, string_view name) {
+    while (!query.empty()) {
+        size_t amp = query.find('&');
+        string_view pair = query.substr(0, amp);
+        query = amp == string_view::npos ? string_view() : query.substr(amp + 1);
+        size_t eq = pair.find('=');
+        if (pair.substr(0, eq) != name) continue;
+        string_view v = eq == string_view::npos ? string_view() : pair.substr(eq + 1);
+        string out;
+        for (size_t i = 0; i < v.size(); ++i) {
+            if (v[i] == '+') out += ' ';
+            else if (v[i] == '%' && i + 2 < v.size() && hexDigit(v[i+1]) >= 0 && hexDigit(v[i+2]) >= 0) {
+                out += (char)(hexDigit(v[i+1]) * 16 + hexDigit(v[i+2]));
+                i += 2;
+            }
+            else out += v[i];
+        }
+        return out;
+    }
+    return "";
+}
+
+void appendUtf8(string& out, uint32_t cp) {
+    if (cp < 0x80) out += (char)cp;
+    else if (cp < 0x800) { out += (char)(0xC0 | cp >> 6); out += (char)(0x80 | (cp & 0x3F)); }
+    else if (cp < 0x10000) {
+        out += (char)(0xE0 | cp >> 12); out += (char)(0x80 | (cp >> 6 & 0x3F)); out += (char)(0x80 | (cp & 0x3F));
+    } else {
+        out += (char)(0xF0 | cp >> 18); out += (char)(0x80 | (cp >> 12 & 0x3F));
+        out += (char)(0x80 | (cp >> 6 & 0x3F)); out += (char)(0x80 | (cp & 0x3F));
+    }
+}
+
+// Reads a JSON string starting at s[i] == '"'; leaves i past the closing quote
+bool parseJsonString(string_view s, size_t& i, string& out) {
+    out.clear();
+    for (++i; i < s.size(); ++i) {
+        char c = s[i];
+        if (c == '"') { ++i; return true; }
+        if (c != '\\') { out += c; continue; }
+        if (++i >= s.size()) return false;
+        switch (s[i]) {
+            case '"': case '\\': case '/': out += s[i]; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                auto hex4 = [&](size_t at, uint32_t& v) {
+                    if (at + 4 > s.size()) return false;
+                    v = 0;
+                    for (size_t k = at; k < at + 4; ++k) {
+                        int d = hexDigit(s[k]);
+                        if (d < 0) return false;
+                        v = v * 16 + (uint32_t)d;
+                    }
+                    return true;
+                };
+                uint32_t cp, low;
+                if (!hex4(i + 1, cp)) return false;
+                i += 4;
+                if (cp >= 0xD800 && cp < 0xDC00 && i + 6 < s.size() && s[i+1] == '\\' && s[i+2] == 'u' &&
+                    hex4(i + 3, low) && low >= 0xDC00 && low < 0xE000) {
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    i += 6;
+                }
+                appendUtf8(out, cp);
+                break;
+            }
+            default: return false;
+        }
+    }
+    return false;
+}
+
+// A flat JSON object of strings, numbers and booleans, as name -> text
+// (strings unescaped, other values as written). Nested values are rejected.
+bool parseJsonObject(string_view s, unordered_map<string, string>& out) {
+    size_t i = 0;
+    auto ws = [&] { while (i < s.size() && isspace((unsigned char)s[i])) ++i; };
+    ws();
+    if (i >= s.size() || s[i] != '{') return false;
+    ++i; ws();
+    if (i < s.size() && s[i] == '}') return true;
+    string key, value;
+    while (i < s.size()) {
+        if (s[i] != '"' || !parseJsonString(s, i, key)) return false;
+        ws();
+        if (i >= s.size() || s[i] != ':') return false;
+        ++i; ws();
+        if (i >= s.size()) return false;
+        if (s[i] == '"') {
+            if (!parseJsonString(s, i, value)) return false;
+        } else {
+            size_t start = i;
+            while (i < s.size() && s[i] != ',' && s[i] != '}' && !isspace((unsigned char)s[i])) ++i;
+            value = string(s.substr(start, i - start));
+            double d;
+            if (value != "true" && value != "false" && value != "null" && !parseNumber(value, d)) return false;
+        }
+        out[key] = value;
+        ws();
+        if (i < s.size() && s[i] == '}') return true;
+        if (i >= s.size() || s[i] != ',') return false;
+        ++i; ws();
+    }
+    return false;
+}
+
+string bookingJson(const Booking& b) {
+    string j = "{\"id\":" + to_string(b.id);
+    j += ",\"name\":" + jsonString(b.passenger.name.view());
+    j += ",\"phone\":" + jsonString(b.passenger.phone.view());
+    j += ",\"email\":" + jsonString(b.passenger.email.view());
+    j += ",\"gender\":" + jsonString(b.passenger.gender.view());
+    j += ",\"meal\":" + to_string((int)b.passenger.meal);
+    j += ",\"wheelchair\":" + string(b.passenger.wheelchair ? "true" : "false");
+    j += ",\"luggage\":" + to_string(b.passenger.luggageKg);
+    j += ",\"seatNo\":" + jsonString(b.seatNo());
+    j += ",\"bookingTime\":" + jsonString(formatTime(b.bookedAt));
+    j += ",\"paymentMethod\":" + to_string(b.payment ? (int)b.payment->method : -1);
+    j += ",\"amount\":" + jsonMoney(b.payment ? b.payment->amount : 0.0);
+    j += ",\"txnId\":" + jsonString(b.payment ? b.payment->txnId.view() : string_view());
+    j += ",\"flightNo\":" + jsonString(b.flight ? b.flight->flightNo : "NONE");
+    return j + "}";
+}
+
+// The whole seat map, or with `since` (a version from an earlier reply)
+// only the seats changed after it; "full" says which one it is. Seat
+// prices are list prices; "fares" carries the current load multiplier and
+// luggage rule, so a delta never has to resend unchanged seats.
+HttpResponse flightInfo(Flight& f, uint64_t since) {
+    vector<int> changed;
+    bool full = true;
+    uint64_t version = since ? f.seats.changesSince(since, changed, full) : f.seats.version();
+    HttpResponse r;
+    string& j = r.body;
+    j = "{\"info\":{\"flightNo\":" + jsonString(f.flightNo) + ",\"src\":" + jsonString(f.src) +
+        ",\"dest\":" + jsonString(f.dest) + ",\"date\":" + jsonString(f.date) +
+        ",\"depTime\":" + jsonString(f.depTime) + ",\"arrTime\":" + jsonString(f.arrTime) + ",\"aircraft\":" + jsonString(f.seats.layout().name) + "},\"version\":" +
+        to_string(version) + ",\"full\":" + (full ? "true" : "false") + ",\"seats\":[";
+    if (full && changed.empty()) {
+        for (int i = 0; i < f.seats.size(); ++i) changed.push_back(i);
+    }
+    const SeatLayout& layout = f.seats.layout();
+    for (size_t k = 0; k < changed.size(); ++k) {
+        int i = changed[k];
+        if (k) j += ",";
+        j += "{\"id\":" + jsonString(layout.code(i)) + ",\"class\":" + jsonString(seatClassString(f.seats.cls(i))) +
+             ",\"price\":" + jsonMoney(layout.price[i]) + ",\"pref\":" + jsonString(seatPrefString(f.seats.pref(i))) +
+             ",\"booked\":" + (f.seats.isBooked(i) ? "true" : "false") + "}";
+    }
+    const LuggageRule& luggage = fareEngine.current().luggage;
+    j += "],\"fares\":{\"multiplier\":" + jsonNumber(fareEngine.multiplier(f.seats)) +
+         ",\"luggageFreeKg\":" + to_string(luggage.freeKg) + ",\"luggagePerKg\":" + jsonMoney(luggage.perKg) + "}";
+    ReportStats stats;
+    {
+        lock_guard<mutex> lk(f.statsMu);
+        stats = f.stats;
+    }
+    j += ",\"stats\":{\"revenue\":" + jsonMoney(stats.totalRevenue()) + ",\"occupancy\":" + to_string(stats.booked()) +
+         ",\"total_seats\":" + to_string(f.seats.size()) + "}}";
+    return r;
+}
+
+HttpResponse listBookings(const Flight* only) {
+    ensureHydrated();
+    vector<pair<int, string>> rows;
+    rows.reserve(bookings.size());
+    // serialized under the shard locks so a concurrent seat change is not half-read
+    bookings.forEach([&](Booking& b) {
+        if (!only || b.flight == only) rows.emplace_back(b.id, bookingJson(b));
+    });
+    sort(rows.begin(), rows.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    HttpResponse r;
+    r.body = "[";
+    for (size_t i = 0; i < rows.size(); ++i) {
+        if (i) r.body += ",";
+        r.body += rows[i].second;
+    }
+    r.body += "]";
+    return r;
+}
+
+// The Idempotency-Key header, or an idempotencyKey field, makes a retried
+// submission return the first booking
+HttpResponse bookFromJson(string_view body, string_view key, bool& wrote) {
+    unordered_map<string, string> in;
+    if (!parseJsonObject(body, in)) return jsonError(400, "body must be a JSON object");
+    for (const char* field : { "name", "phone", "email", "gender", "meal", "paymentMethod", "seatNo" }) {
+        if (!in.count(field)) return jsonError(400, string("missing ") + field);
+    }
+    BookingRequest req;
+    req.flight = in["flightNo"].empty() ? catalog.front() : catalog.find(in["flightNo"]);
+    if (!req.flight) return jsonError(400, "unknown flight " + in["flightNo"]);
+    int meal, method, luggage = 0;
+    if (!parseNumber(in["meal"], meal) || meal < 0 || meal > 3) return jsonError(400, "bad meal");
+    if (!parseNumber(in["paymentMethod"], method) || method < 0 || method > 3) return jsonError(400, "bad paymentMethod");
+    if (!in["luggage"].empty() && (!parseNumber(in["luggage"], luggage) || luggage < 0)) return jsonError(400, "bad luggage");
+    const string& w = in["wheelchair"];
+    int seat = req.flight->findSeat(in["seatNo"]);
+    if (seat < 0) return jsonError(400, "Invalid seat");
+    req.passenger = Passenger{in["name"], in["phone"], in["email"], in["gender"], static_cast<MealPreference>(meal),
+                              !w.empty() && w != "false" && w != "0" && w != "null", luggage};
+    req.cls = req.flight->seats.cls(seat);
+    req.seatNo = in["seatNo"];
+    req.method = static_cast<PaymentMethod>(method);
+    req.idempotencyKey = key.empty() ? in["idempotencyKey"] : string(key);
+    string error;
+    BookResult result;
+    Booking* b = bookSeat(req, error, &result);
+    if (!b) return jsonError(result == KEY_CONFLICT ? 409 : 400, error);
+    wrote = true; // a replayed booking may still be on its way to disk
+    HttpResponse r;
+    r.body = "{\"success\":true," + string(result == REPLAYED ? "\"replayed\":true," : "") + "\"booking\":" + bookingJson(*b) + "}";
+    return r;
+}
+
+// Parses one request from the front of buf. Returns the bytes it spans,
+// 0 if it is not complete yet, or -1 with `error` set if it is malformed.
+long parseRequest(string_view buf, HttpRequest& req, HttpResponse& error) {
+    size_t end = buf.find("\r\n\r\n");
+    if (end == string_view::npos) {
+        if (buf.size() > HttpServer::MAX_HEADER) { error = jsonError(413, "headers too large"); return -1; }
+        return 0;
+    }
+    if (end > HttpServer::MAX_HEADER) { error = jsonError(413, "headers too large"); return -1; }
+    string_view head = buf.substr(0, end);
+    size_t eol = head.find("\r\n");
+    string_view line = head.substr(0, eol);
+    size_t sp1 = line.find(' '), sp2 = line.rfind(' ');
+    if (sp1 == string_view::npos || sp2 == sp1) { error = jsonError(400, "bad request line"); return -1; }
+    req.method = line.substr(0, sp1);
+    req.target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+    string_view version = line.substr(sp2 + 1);
+    if (version != "HTTP/1.1" && version != "HTTP/1.0") { error = jsonError(400, "bad HTTP version"); return -1; }
+    req.http10 = version == "HTTP/1.0";
+    req.keepAlive = !req.http10;
+    size_t length = 0;
+    while (eol != string_view::npos) {
+        size_t start = eol + 2;
+        eol = head.find("\r\n", start);
+        string_view h = head.substr(start, eol == string_view::npos ? string_view::npos : eol - start);
+        size_t colon = h.find(':');
+        if (colon == string_view::npos) continue;
+        string_view name = h.substr(0, colon), value = trim(h.substr(colon + 1));
+        if (equalsNoCase(name, "Content-Length")) {
+            if (!parseNumber(value, length)) { error = jsonError(400, "bad Content-Length"); return -1; }
+        } else if (equalsNoCase(name, "Connection")) {
+            if (equalsNoCase(value, "close")) req.keepAlive = false;
+            else if (equalsNoCase(value, "keep-alive")) req.keepAlive = true;
+        } else if (equalsNoCase(name, "Idempotency-Key")) {
+            req.idempotencyKey = value;
+        } else if (equalsNoCase(name, "Transfer-Encoding")) {
+            error = jsonError(501, "chunked bodies are not supported");
+            return -1;
+        }
+    }
+    if (length > HttpServer::MAX_BODY) { error = jsonError(413, "body too large"); return -1; }
+    if (buf.size() < end + 4 + length) return 0;
+    req.body = buf.substr(end + 4, length);
+    return (long)(end + 4 + length);
+}
+
+void appendResponse(string& out, const HttpResponse& r, bool keepAlive, bool http10) {
+    out += "HTTP/1.1 ";
+    out += to_string(r.status);
+    out += ' ';
+    out += statusText(r.status);
+    out += "\r\nContent-Type: ";
+    out += r.contentType;
+    out += "\r\nContent-Length: ";
+    out += to_string(r.body.size());
+    if (!keepAlive) out += "\r\nConnection: close";
+    else if (http10) out += "\r\nConnection: keep-alive";
+    out += "\r\n\r\n";
+    out += r.body;
+}
+}
+
+HttpServer::HttpServer() {
+    stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+HttpServer::~HttpServer() {
+    if (listenFd >= 0) ::close(listenFd);
+    if (stopFd >= 0) ::close(stopFd);
+}
+
+string HttpServer::listen(const string& host, int port) {
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) return "bad address " + host;
+    listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) return strerror(errno);
+    int on = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (bind(listenFd, (sockaddr*)&addr, sizeof(addr)) != 0 || ::listen(listenFd, SOMAXCONN) != 0) {
+        string error = strerror(errno);
+        ::close(listenFd);
+        listenFd = -1;
+        return error;
+    }
+    socklen_t len = sizeof(addr);
+    getsockname(listenFd, (sockaddr*)&addr, &len);
+    boundPort = ntohs(addr.sin_port);
+    return "";
+}
+
+void HttpServer::loadStatic(const string& webRoot) {
+    static const char* const FILES[][3] = {
+        { "/", "index.html", "text/html; charset=utf-8" },
+        { "/index.html", "index.html", "text/html; charset=utf-8" },
+        { "/static/style.css", "style.css", "text/css" },
+        { "/static/script.js", "script.js", "application/javascript" },
+    };
+    for (const auto& f : FILES) {
+        ifstream in(webRoot + "/" + f[1], ios::binary);
+        if (!in) continue;
+        files[f[0]] = { f[2], string((istreambuf_iterator<char>(in)), istreambuf_iterator<char>()) };
+    }
+}
+
+void HttpServer::stop() {
+    uint64_t one = 1;
+    ssize_t w = ::write(stopFd, &one, sizeof(one)); // stays readable, so every loop sees it
+    (void)w;
+}
+
+void HttpServer::run(int threads) {
+    if (threads <= 0) threads = max(1u, thread::hardware_concurrency());
+    vector<thread> loops;
+    for (int i = 1; i < threads; ++i) loops.emplace_back(&HttpServer::loop, this);
+    loop();
+    for (auto& t : loops) t.join();
+}
+
+HttpResponse HttpServer::route(string_view method, string_view target, string_view body, bool& wrote,
+                               string_view idempotencyKey) const {
+    size_t q = target.find('?');
+    string_view path = target.substr(0, q);
+    string_view query = q == string_view::npos ? string_view() : target.substr(q + 1);
+    bool get = method == "GET" || method == "HEAD";
+
+    auto file = files.find(string(path));
+    if (file != files.end()) {
+        if (!get) return jsonError(405, "use GET");
+        HttpResponse r;
+        r.contentType = file->second.first;
+        r.body = file->second.second;
+        return r;
+    }
+    if (path == "/api/flight-info" || path == "/api/bookings") {
+        if (!get) return jsonError(405, "use GET");
+        string no = queryParam(query, "flight");
+        Flight* f = no.empty() ? nullptr : catalog.find(no);
+        if (!no.empty() && !f) return jsonError(404, "unknown flight " + no);
+        if (path == "/api/bookings") return listBookings(f); // all flights unless one is named
+        if (!f) f = catalog.front();
+        if (!f) return jsonError(404, "no flights");
+        uint64_t since = 0;
+        string v = queryParam(query, "since");
+        if (!v.empty() && !parseNumber(v, since)) return jsonError(400, "bad since");
+        return flightInfo(*f, since);
+    }
+    if (path == "/api/routes") {
+        if (!get) return jsonError(405, "use GET");
+        RouteQuery rq;
+        rq.from = queryParam(query, "from");
+        rq.to = queryParam(query, "to");
+        rq.date = queryParam(query, "date");
+        string cls = queryParam(query, "class"), count = queryParam(query, "count"), sort = queryParam(query, "sort");
+        int c = 0;
+        if (!cls.empty() && (!parseNumber(cls, c) || c < 0 || c >= NUM_SEAT_CLASSES)) return jsonError(400, "bad class");
+        rq.cls = static_cast<SeatClass>(c);
+        if (!count.empty() && (!parseNumber(count, rq.count) || rq.count < 1 || rq.count > 50)) return jsonError(400, "count is 1-50");
+        if (!sort.empty() && sort != "time" && sort != "fare") return jsonError(400, "sort is time or fare");
+        rq.byFare = sort == "fare";
+        vector<Itinerary> found;
+        if (!routePlanner.search(rq, found)) return jsonError(404, "unknown airport or bad date");
+        HttpResponse r;
+        r.body = "{\"itineraries\":[";
+        for (size_t k = 0; k < found.size(); ++k) r.body += (k ? "," : "") + itineraryJson(found[k]);
+        r.body += "]}";
+        return r;
+    }
+    if (path == "/api/book") {
+        if (method != "POST") return jsonError(405, "use POST");
+        return bookFromJson(body, idempotencyKey, wrote);
+    }
+    if (path == "/metrics") {
+        if (!get) return jsonError(405, "use GET");
+        ostringstream text;
+        writeMetricsText(text, readMetrics());
+        HttpResponse r;
+        r.contentType = "text/plain; version=0.0.4";
+        r.body = text.str();
+        return r;
+    }
+    return jsonError(404, "not found");
+}
+
+void HttpServer::loop() {
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    if (ep < 0) { perror("epoll_create1"); return; }
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLEXCLUSIVE; // one loop wakes per new connection
+    ev.data.ptr = nullptr;
+    epoll_ctl(ep, EPOLL_CTL_ADD, listenFd, &ev);
+    ev.events = EPOLLIN;
+    ev.data.ptr = &stopFd;
+    epoll_ctl(ep, EPOLL_CTL_ADD, stopFd, &ev);
+
+    unordered_map<HttpConn*, unique_ptr<HttpConn>> conns;
+    vector<HttpConn*> touched;
+    epoll_event events[256];
+    char buf[64 * 1024];
+    bool running = true;
+
+    auto closeConn = [&](HttpConn* c) {
+        ::close(c->fd);
+        conns.erase(c);
+    };
+    // Answers every complete request in c->in
+    auto serve = [&](HttpConn* c, bool& wrote) {
+        size_t off = 0;
+        while (!c->closeAfter) {
+            HttpRequest req;
+            HttpResponse error;
+            long n = parseRequest(string_view(c->in).substr(off), req, error);
+            if (n == 0) break;
+            if (n < 0) {
+                appendResponse(c->out, error, false, false);
+                c->closeAfter = true;
+                break;
+            }
+            HttpResponse r = route(req.method, req.target, req.body, wrote, req.idempotencyKey);
+            appendResponse(c->out, r, req.keepAlive, req.http10);
+            if (req.method == "HEAD") c->out.resize(c->out.size() - r.body.size());
+            if (!req.keepAlive) c->closeAfter = true;
+            off += (size_t)n;
+        }
+        c->in.erase(0, off);
+        if (c->peerClosed) c->closeAfter = true;
+    };
+
+    while (running) {
+        int n = epoll_wait(ep, events, 256, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+        bool wrote = false;
+        touched.clear();
+        for (int i = 0; i < n; ++i) {
+            void* tag = events[i].data.ptr;
+            if (tag == &stopFd) { running = false; continue; }
+            if (tag == nullptr) {
+                while (true) {
+                    int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                    if (fd < 0) break;
+                    int on = 1;
+                    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+                    auto c = make_unique<HttpConn>(fd);
+                    epoll_event cev{};
+                    cev.events = EPOLLIN | EPOLLRDHUP;
+                    cev.data.ptr = c.get();
+                    epoll_ctl(ep, EPOLL_CTL_ADD, fd, &cev);
+                    conns.emplace(c.get(), move(c));
+                }
+                continue;
+            }
+            HttpConn* c = static_cast<HttpConn*>(tag);
+            touched.push_back(c);
+            if (events[i].events & EPOLLERR) { c->dead = true; continue; }
+            if (!c->peerClosed && (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP))) {
+                while (true) {
+                    ssize_t r = ::read(c->fd, buf, sizeof(buf));
+                    if (r > 0) { c->in.append(buf, (size_t)r); continue; }
+                    if (r == 0) c->peerClosed = true;
+                    else if (errno == EINTR) continue;
+                    else if (errno != EAGAIN && errno != EWOULDBLOCK) c->dead = true;
+                    break;
+                }
+                serve(c, wrote);
+            }
+        }
+        // bookings are only acknowledged once durable
+        if (wrote) journal.waitDurable();
+        for (HttpConn* c : touched) {
+            while (!c->dead && c->sent < c->out.size()) {
+                ssize_t w = ::send(c->fd, c->out.data() + c->sent, c->out.size() - c->sent, MSG_NOSIGNAL);
+                if (w > 0) { c->sent += (size_t)w; continue; }
+                if (w < 0 && errno == EINTR) continue;
+                if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+                c->dead = true;
+            }
+            bool pending = c->sent < c->out.size();
+            if (!pending) { c->out.clear(); c->sent = 0; }
+            if (c->dead || (!pending && c->closeAfter)) { closeConn(c); continue; }
+            // stop reading once nothing more will be answered
+            uint32_t want = (c->closeAfter ? 0u : (uint32_t)(EPOLLIN | EPOLLRDHUP)) | (pending ? (uint32_t)EPOLLOUT : 0u);
+            if (want != c->events) {
+                epoll_event cev{};
+                cev.events = want;
+                cev.data.ptr = c;
+                epoll_ctl(ep, EPOLL_CTL_MOD, c->fd, &cev);
+                c->events = want;
+            }
+        }
+    }
+    for (auto& kv : conns) ::close(kv.first->fd);
+    ::close(ep);
+}
@@ -15,26 +15,99 @@ FLIGHT_INFO = {
     "arrTime": "1:30 PM"
 }
 
-# Seat Configuration
+# Seat Configuration: base fares per class, as in defaultSeatLayout()
+CLASS_FARE_MULTIPLIER = {"Economy": 1.0, "Business": 2.0, "First Class": 3.0}
 SEATS = []
+def add_seat(seat_id, cls, base, pref):
+    SEATS.append({"id": seat_id, "class": cls, "price": base * CLASS_FARE_MULTIPLIER[cls], "pref": pref})
+
+# Aircraft layouts shared with the C++ app (layouts.txt next to bookings.txt):
+#   layout|name
+#   cabin|class|firstRow-lastRow|letters|prefs|baseFare
+LAYOUTS_FILE = os.path.join(os.path.dirname(BOOKINGS_FILE), 'layouts.txt')
+SEAT_CLASSES = ["Economy", "Business", "First Class"]
+SEAT_PREFS = {"W": "Window", "A": "Aisle", "M": "Middle"}
+def read_layout(name):
+    """Cabins of the named layout as (class, rows, letters, prefs, base), or None."""
+    if not os.path.exists(LAYOUTS_FILE):
+        return None
+    layouts, name_read, current = {}, None, None
+    with open(LAYOUTS_FILE, 'r') as f:
+        for line in f:
+            line = line.strip()
+            if not line or line.startswith('#'): continue
+            parts = line.split('|')
+            if len(parts) == 2 and parts[0] == 'layout':
+                name_read, current = parts[1], layouts.setdefault(parts[1], [])
+            elif len(parts) == 6 and parts[0] == 'cabin' and current is not None:
+                try:
+                    first, last = (int(x) for x in parts[2].split('-'))
+                    if len(parts[4]) != len(parts[3]): raise ValueError(line)
+                    current.append((SEAT_CLASSES[int(parts[1])], range(first, last + 1), parts[3],
+                                    [SEAT_PREFS[p] for p in parts[4]], float(parts[5])))
+                except (ValueError, IndexError, KeyError):
+                    # as in C++, a layout with a bad cabin is not used at all
+                    layouts[name_read], current = None, None
+    return layouts.get(name) or None
+
 def init_seats():
-    global SEATS
-    SEATS = []
+    SEATS.clear()
+    cabins = read_layout("default")
+    if cabins:
+        for cls, rows, letters, prefs, base in cabins:
+            for r in rows:
+                for letter, pref in zip(letters, prefs):
+                    add_seat(f"{r}{letter}", cls, base, pref)
+        return
     # Economy 1-5: A-D
     for r in range(1, 6):
-        SEATS.append({"id": f"{r}A", "class": "Economy", "price": 100.0, "pref": "Window"})
-        SEATS.append({"id": f"{r}B", "class": "Economy", "price": 100.0, "pref": "Middle"})
-        SEATS.append({"id": f"{r}C", "class": "Economy", "price": 100.0, "pref": "Aisle"})
-        SEATS.append({"id": f"{r}D", "class": "Economy", "price": 100.0, "pref": "Window"})
+        add_seat(f"{r}A", "Economy", 100.0, "Window")
+        add_seat(f"{r}B", "Economy", 100.0, "Middle")
+        add_seat(f"{r}C", "Economy", 100.0, "Aisle")
+        add_seat(f"{r}D", "Economy", 100.0, "Window")
     # Business 6-8: A-C
     for r in range(6, 9):
-        SEATS.append({"id": f"{r}A", "class": "Business", "price": 300.0, "pref": "Window"}) # 150 * 2
-        SEATS.append({"id": f"{r}B", "class": "Business", "price": 300.0, "pref": "Aisle"})
-        SEATS.append({"id": f"{r}C", "class": "Business", "price": 300.0, "pref": "Window"})
+        add_seat(f"{r}A", "Business", 150.0, "Window")
+        add_seat(f"{r}B", "Business", 150.0, "Aisle")
+        add_seat(f"{r}C", "Business", 150.0, "Window")
     # First Class 9-10: A-B
     for r in range(9, 11):
-        SEATS.append({"id": f"{r}A", "class": "First Class", "price": 600.0, "pref": "Window"}) # 200 * 3
-        SEATS.append({"id": f"{r}B", "class": "First Class", "price": 600.0, "pref": "Aisle"})
+        add_seat(f"{r}A", "First Class", 200.0, "Window")
+        add_seat(f"{r}B", "First Class", 200.0, "Aisle")
+
+# Fare rules shared with the C++ fare engine (fares.txt next to bookings.txt):
+#   luggage|freeKg|perKg
+#   load|fraction sold|multiplier
+FARES_FILE = os.path.join(os.path.dirname(BOOKINGS_FILE), 'fares.txt')
+def read_fare_rules():
+    rules = {"luggageFreeKg": 20, "luggagePerKg": 10.0, "bands": []}
+    if not os.path.exists(FARES_FILE):
+        return rules
+    with open(FARES_FILE, 'r') as f:
+        for line in f:
+            line = line.strip()
+            if not line or line.startswith('#'): continue
+            parts = line.split('|')
+            try:
+                if len(parts) == 3 and parts[0] == 'luggage':
+                    rules["luggageFreeKg"], rules["luggagePerKg"] = int(parts[1]), float(parts[2])
+                elif len(parts) == 3 and parts[0] == 'load':
+                    rules["bands"].append((float(parts[1]), float(parts[2])))
+            except ValueError:
+                continue
+    rules["bands"].sort()
+    return rules
+
+def fare_multiplier(rules, booked_count):
+    load = booked_count / len(SEATS) if SEATS else 0.0
+    m = 1.0
+    for band_load, band_multiplier in rules["bands"]:
+        if load < band_load: break
+        m = band_multiplier
+    return m
+
+def luggage_fee(rules, kg):
+    return (kg - rules["luggageFreeKg"]) * rules["luggagePerKg"] if kg > rules["luggageFreeKg"] else 0.0
 
 init_seats()
 
@@ -57,7 +130,8 @@ def read_bookings():
                 if len(parts) < 12: continue
                 
                 # Parse based on C++ format:
-                # id|name|phone|email|gender|meal|wheelchair|luggage|seatNo|bookingTime|paymentMethod|paymentAmount
+                # id|name|phone|email|gender|meal|wheelchair|luggage|seatNo|bookingTime|paymentMethod|paymentAmount|flightNo|txnId
+                # (flightNo and txnId are optional; older files only have the first 12 fields)
                 booking = {
                     "id": int(parts[0]),
                     "name": parts[1],
@@ -70,7 +144,9 @@ def read_bookings():
                     "seatNo": parts[8],
                     "bookingTime": parts[9],
                     "paymentMethod": int(parts[10]),
-                    "amount": float(parts[11])
+                    "amount": float(parts[11]),
+                    "flightNo": parts[12] if len(parts) > 12 else FLIGHT_INFO["flightNo"],
+                    "txnId": parts[13] if len(parts) > 13 else ""
                 }
                 bookings.append(booking)
     except Exception as e:
@@ -87,7 +163,7 @@ def write_booking(booking):
         for b in bookings:
             line = f"{b['id']}|{b['name']}|{b['phone']}|{b['email']}|{b['gender']}|{b['meal']}|"
             line += f"{'1' if b['wheelchair'] else '0'}|{b['luggage']}|{b['seatNo']}|{b['bookingTime']}|"
-            line += f"{b['paymentMethod']}|{b['amount']}\n"
+            line += f"{b['paymentMethod']}|{b['amount']}|{b['flightNo']}|{b.get('txnId', '')}\n"
             f.write(line)
 
 @app.route('/')
@@ -96,7 +172,7 @@ def index():
 
 @app.route('/api/flight-info')
 def get_flight_info():
-    bookings = read_bookings()
+    bookings = [b for b in read_bookings() if b['flightNo'] == FLIGHT_INFO["flightNo"]]
     booked_seats = [b['seatNo'] for b in bookings if b['seatNo'] != "NONE"]
     
     # Calculate stats
@@ -108,10 +184,16 @@ def get_flight_info():
         s = seat.copy()
         s['booked'] = s['id'] in booked_seats
         seats_with_status.append(s)
-        
+
+    rules = read_fare_rules()
     return jsonify({
         "info": FLIGHT_INFO,
         "seats": seats_with_status,
+        "fares": {
+            "multiplier": fare_multiplier(rules, occupancy),
+            "luggageFreeKg": rules["luggageFreeKg"],
+            "luggagePerKg": rules["luggagePerKg"]
+        },
         "stats": {
             "revenue": revenue,
             "occupancy": occupancy,
@@ -135,7 +217,7 @@ def create_booking():
         
     # Validate seat
     seat_id = data.get('seatNo')
-    if any(b['seatNo'] == seat_id for b in bookings):
+    if any(b['seatNo'] == seat_id and b['flightNo'] == FLIGHT_INFO["flightNo"] for b in bookings):
         return jsonify({"error": "Seat already booked"}), 400
         
     # Calculate price (backend validation)
@@ -144,9 +226,9 @@ def create_booking():
         return jsonify({"error": "Invalid seat"}), 400
         
     luggage = int(data.get('luggage', 0))
-    price = seat['price']
-    if luggage > 20:
-        price += (luggage - 20) * 10
+    rules = read_fare_rules()
+    booked_count = sum(1 for b in bookings if b['flightNo'] == FLIGHT_INFO["flightNo"] and b['seatNo'] != "NONE")
+    price = seat['price'] * fare_multiplier(rules, booked_count) + luggage_fee(rules, luggage)
         
     new_booking = {
         "id": new_id,
@@ -160,7 +242,8 @@ def create_booking():
         "seatNo": seat_id,
         "bookingTime": datetime.datetime.now().strftime("%Y-%m-%d %H:%M:%S"),
         "paymentMethod": int(data['paymentMethod']),
-        "amount": price
+        "amount": price,
+        "flightNo": FLIGHT_INFO["flightNo"]
     }
     
     write_booking(new_booking)
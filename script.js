@@ -1,19 +1,43 @@
 document.addEventListener('DOMContentLoaded', () => {
     fetchFlightInfo();
     fetchBookings();
+    setInterval(fetchFlightInfo, SEAT_POLL_MS);
 });
 
+const SEAT_POLL_MS = 3000;
+
 let selectedSeat = null;
 let flightData = null;
+let seatVersion = null; // seat-map version of the last reply, if the server has versions
+let bookingKey = null;  // idempotency key of the submission in progress; kept across retries
+const seatEls = {};     // seat id -> element
+// Load multiplier and luggage rule of the last reply; seat prices are list prices
+let fares = { multiplier: 1, luggageFreeKg: 20, luggagePerKg: 10 };
 
 async function fetchFlightInfo() {
-    const res = await fetch('/api/flight-info');
+    // Ask only for the seats changed since the last reply
+    const res = await fetch(seatVersion ? `/api/flight-info?since=${seatVersion}` : '/api/flight-info');
     const data = await res.json();
     flightData = data;
     
     renderFlightInfo(data.info);
     renderStats(data.stats);
-    renderSeatMap(data.seats);
+    if (data.full === false) {
+        updateSeats(data.seats);
+    } else {
+        renderSeatMap(data.seats);
+    }
+    seatVersion = data.version || null;
+    if (data.fares) fares = data.fares;
+    updateTotal();
+}
+
+function seatFare(seat) {
+    return Math.round(seat.price * fares.multiplier * 100) / 100;
+}
+
+function luggageFee(kg) {
+    return kg > fares.luggageFreeKg ? (kg - fares.luggageFreeKg) * fares.luggagePerKg : 0;
 }
 
 async function fetchBookings() {
@@ -40,6 +64,7 @@ function renderStats(stats) {
 function renderSeatMap(seats) {
     const container = document.getElementById('seat-map');
     container.innerHTML = '';
+    for (const id in seatEls) delete seatEls[id];
     
     // Group by row
     const rows = {};
@@ -60,12 +85,9 @@ function renderSeatMap(seats) {
         
         rowSeats.forEach(seat => {
             const seatEl = document.createElement('div');
-            seatEl.className = `seat ${seat.class.toLowerCase().replace(' ', '-')} ${seat.booked ? 'booked' : ''}`;
             seatEl.textContent = seat.id;
-            
-            if (!seat.booked) {
-                seatEl.onclick = () => selectSeat(seat, seatEl);
-            }
+            setSeatState(seatEl, seat);
+            seatEls[seat.id] = seatEl;
             
             rowDiv.appendChild(seatEl);
             
@@ -82,6 +104,25 @@ function renderSeatMap(seats) {
     });
 }
 
+function setSeatState(seatEl, seat) {
+    seatEl.className = `seat ${seat.class.toLowerCase().replace(' ', '-')} ${seat.booked ? 'booked' : ''}`;
+    seatEl.onclick = seat.booked ? null : () => selectSeat(seat, seatEl);
+}
+
+// Applies a delta reply: only the seats whose state changed
+function updateSeats(seats) {
+    seats.forEach(seat => {
+        const seatEl = seatEls[seat.id];
+        if (!seatEl) return;
+        setSeatState(seatEl, seat);
+        if (seat.booked && selectedSeat && selectedSeat.id === seat.id) {
+            selectedSeat = null;
+            document.getElementById('selected-seat-display').textContent = '-';
+            document.getElementById('total-price').textContent = '$0';
+        }
+    });
+}
+
 function selectSeat(seat, el) {
     // Deselect previous
     document.querySelectorAll('.seat.selected').forEach(e => e.classList.remove('selected'));
@@ -90,18 +131,14 @@ function selectSeat(seat, el) {
     el.classList.add('selected');
     
     document.getElementById('selected-seat-display').textContent = `${seat.id} (${seat.class})`;
-    document.getElementById('base-price').textContent = `$${seat.price}`;
     updateTotal();
 }
 
 function updateTotal() {
     if (!selectedSeat) return;
-    let total = selectedSeat.price;
     const luggage = parseInt(document.getElementById('luggage').value) || 0;
-    if (luggage > 20) {
-        total += (luggage - 20) * 10;
-    }
-    document.getElementById('total-price').textContent = `$${total}`;
+    document.getElementById('base-price').textContent = `$${seatFare(selectedSeat)}`;
+    document.getElementById('total-price').textContent = `$${Math.round((seatFare(selectedSeat) + luggageFee(luggage)) * 100) / 100}`;
 }
 
 document.getElementById('luggage').addEventListener('input', updateTotal);
@@ -113,6 +150,8 @@ document.getElementById('booking-form').addEventListener('submit', async (e) =>
         return;
     }
     
+    // a retry after a lost reply reuses the key, so the server books only once
+    if (!bookingKey) bookingKey = window.crypto && crypto.randomUUID ? crypto.randomUUID() : `${Date.now()}-${Math.random()}`;
     const formData = {
         name: document.getElementById('name').value,
         phone: document.getElementById('phone').value,
@@ -128,11 +167,12 @@ document.getElementById('booking-form').addEventListener('submit', async (e) =>
     try {
         const res = await fetch('/api/book', {
             method: 'POST',
-            headers: {'Content-Type': 'application/json'},
+            headers: {'Content-Type': 'application/json', 'Idempotency-Key': bookingKey},
             body: JSON.stringify(formData)
         });
         
         const result = await res.json();
+        if (res.status !== 409) bookingKey = null; // 409: the first attempt is still running
         if (result.success) {
             showSuccess(result.booking);
             fetchFlightInfo(); // Refresh map